@@ -156,10 +156,8 @@ namespace jalib {
     REAL_FUNC_PASSTHROUGH(ssize_t, write) (fd, buf, count);
   }
 
-  int select(int nfds, fd_set *readfds, fd_set *writefds,
-             fd_set *exceptfds, struct timeval *timeout) {
-    REAL_FUNC_PASSTHROUGH(int, select) (nfds, readfds, writefds, exceptfds,
-                                        timeout);
+  int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    REAL_FUNC_PASSTHROUGH(int, poll) (fds, nfds, timeout);
   }
 
   int socket(int domain, int type, int protocol) {
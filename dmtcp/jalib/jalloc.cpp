@@ -133,6 +133,25 @@ public:
     item->next = _root;
     _root = item;
   }
+
+  //allocate a list of n chunks of size N, linked through their first word
+  void* allocateBatch(size_t n) {
+    FreeItem* head = NULL;
+    for (size_t i = 0; i < n; i++) {
+      if(_root == NULL) expand();
+      FreeItem* item = _root;
+      _root = item->next;
+      item->next = head;
+      head = item;
+    }
+    return head;
+  }
+
+  //deallocate a list of chunks, from head to tail, linked as above
+  void deallocateBatch(void* head, void* tail) {
+    static_cast<FreeItem*>(tail)->next = _root;
+    _root = static_cast<FreeItem*>(head);
+  }
 protected:
   //allocate more raw memory when stack is empty
   void expand() {
@@ -166,48 +185,106 @@ private:
   char padding[128];
 };
 
+/* Per-thread caches ("magazines") of free chunks, one per size class.  A
+ * thread allocates from and frees to its own magazine without taking
+ * allocateLock; only when the magazine runs empty (or full) is it refilled
+ * from (or half of it flushed to) the global JFixedAllocStack, a batch at a
+ * time, under allocateLock.  Since no other thread ever touches a magazine,
+ * JALIB_CKPT_LOCK() still guarantees that no thread is in the middle of
+ * changing the global stacks, and a forked child can keep using the forking
+ * thread's magazine.  Magazines of threads that exit without calling
+ * flush_thread_cache() are leaked.
+ *
+ * Android builds define JALIB_USE_MALLOC above, so the fixed-size stacks
+ * that the magazines sit in front of are not compiled there; every call is
+ * a locked ::malloc()/::free().  (jalib is also below dmtcp::TLS, the only
+ * thread-local storage there is on Android.)  Record-replay needs the same
+ * addresses on replay, so it too keeps locking around every call.
+ */
+#if !defined(ANDROID) && !defined(RECORD_REPLAY)
+# define JALIB_THREAD_CACHE
+#endif
+
+#ifdef JALIB_THREAD_CACHE
+struct ThreadCache {
+  void* head;
+  size_t count;
+};
+static __thread ThreadCache _threadCache[4];
+
+static inline void*& nextChunk(void* item) {
+  return *static_cast<void**>(item);
+}
+#endif
+
 // FIXME: Do we really need this class now?     --Kapil
-template < typename Alloc >
+template < typename Alloc, int CACHE_INDEX, size_t CACHE_SIZE >
 class JGlobalAlloc {
 public:
   enum { N = Alloc::N };
 
   static void* allocate(){
-#if 0
-    if(pthread_mutex_lock(theMutex()) != 0)
-      perror("JGlobalAlloc::allocate");
-#endif
-
+#ifdef JALIB_THREAD_CACHE
+    ThreadCache& cache = _threadCache[CACHE_INDEX];
+    if (cache.count == 0) {
+      JAllocDispatcher::lock();
+      cache.head = theAlloc().allocateBatch(CACHE_SIZE / 2);
+      JAllocDispatcher::unlock();
+      cache.count = CACHE_SIZE / 2;
+    }
+    void* ptr = cache.head;
+    cache.head = nextChunk(ptr);
+    cache.count--;
+    nextChunk(ptr) = NULL;
+#else
+    JAllocDispatcher::lock();
     void* ptr = theAlloc().allocate();
-
-#if 0
-    if(pthread_mutex_unlock(theMutex()) != 0)
-      perror("JGlobalAlloc::allocate");
+    JAllocDispatcher::unlock();
 #endif
-
     return ptr;
   }
 
   //deallocate a chunk of size N
   static void deallocate(void* ptr){
-#if 0
-    if(pthread_mutex_lock(theMutex()) != 0)
-      perror("JGlobalAlloc::allocate");
-#endif
-
+#ifdef JALIB_THREAD_CACHE
+    ThreadCache& cache = _threadCache[CACHE_INDEX];
+    if (cache.count == CACHE_SIZE) {
+      flush(cache, CACHE_SIZE / 2);
+    }
+    nextChunk(ptr) = cache.head;
+    cache.head = ptr;
+    cache.count++;
+#else
+    JAllocDispatcher::lock();
     theAlloc().deallocate(ptr);
-
-#if 0
-    if(pthread_mutex_unlock(theMutex()) != 0)
-      perror("JGlobalAlloc::allocate");
+    JAllocDispatcher::unlock();
 #endif
   }
 
+#ifdef JALIB_THREAD_CACHE
+  //return all chunks cached by this thread to the global stack
+  static void flushThreadCache() {
+    flush(_threadCache[CACHE_INDEX], _threadCache[CACHE_INDEX].count);
+  }
+
 private:
-  static pthread_mutex_t* theMutex() {
-    static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
-    return &m;
+  //return the first n chunks of the magazine to the global stack
+  static void flush(ThreadCache& cache, size_t n) {
+    if (n == 0) return;
+    void* head = cache.head;
+    void* tail = head;
+    for (size_t i = 1; i < n; i++) {
+      tail = nextChunk(tail);
+    }
+    cache.head = nextChunk(tail);
+    cache.count -= n;
+    JAllocDispatcher::lock();
+    theAlloc().deallocateBatch(head, tail);
+    JAllocDispatcher::unlock();
   }
+#endif
+
+private:
   static Alloc& theAlloc() {
     static Alloc a;
     return a;
@@ -217,19 +294,18 @@ private:
 #ifdef RECORD_REPLAY
 /* We need a greater arena size to eliminate mmap() calls that could happen
    at different times for record vs. replay. */
-typedef JGlobalAlloc< JFixedAllocStack<64 ,  1024*1024*16 > > lvl1;
-typedef JGlobalAlloc< JFixedAllocStack<256,  1024*1024*128 > > lvl2;
-typedef JGlobalAlloc< JFixedAllocStack<1024, 1024*32 > > lvl3;
-typedef JGlobalAlloc< JFixedAllocStack<2048, 1024*32 > > lvl4;
+typedef JGlobalAlloc< JFixedAllocStack<64 ,  1024*1024*16 >, 0, 64 > lvl1;
+typedef JGlobalAlloc< JFixedAllocStack<256,  1024*1024*128 >, 1, 32 > lvl2;
+typedef JGlobalAlloc< JFixedAllocStack<1024, 1024*32 >, 2, 16 > lvl3;
+typedef JGlobalAlloc< JFixedAllocStack<2048, 1024*32 >, 3, 8 > lvl4;
 #else
-typedef JGlobalAlloc< JFixedAllocStack<64 ,  1024*16 > > lvl1;
-typedef JGlobalAlloc< JFixedAllocStack<256,  1024*16 > > lvl2;
-typedef JGlobalAlloc< JFixedAllocStack<1024, 1024*32 > > lvl3;
-typedef JGlobalAlloc< JFixedAllocStack<2048, 1024*32 > > lvl4;
+typedef JGlobalAlloc< JFixedAllocStack<64 ,  1024*16 >, 0, 64 > lvl1;
+typedef JGlobalAlloc< JFixedAllocStack<256,  1024*16 >, 1, 32 > lvl2;
+typedef JGlobalAlloc< JFixedAllocStack<1024, 1024*32 >, 2, 16 > lvl3;
+typedef JGlobalAlloc< JFixedAllocStack<2048, 1024*32 >, 3, 8 > lvl4;
 #endif
 
 void* JAllocDispatcher::allocate(size_t n) {
-  lock();
   void *retVal;
 #ifndef ANDROID
   if(n <= lvl1::N) retVal = lvl1::allocate(); else
@@ -237,21 +313,35 @@ void* JAllocDispatcher::allocate(size_t n) {
   if(n <= lvl3::N) retVal = lvl3::allocate(); else
   if(n <= lvl4::N) retVal = lvl4::allocate(); else
 #endif
-  retVal = _alloc_raw(n);
-  unlock();
+  {
+    lock();
+    retVal = _alloc_raw(n);
+    unlock();
+  }
   return retVal;
 }
 void JAllocDispatcher::deallocate(void* ptr, size_t n){
   if (ptr == NULL || n == 0) return;
-  lock();
 #ifndef ANDROID
   if(n <= lvl1::N) lvl1::deallocate(ptr); else
   if(n <= lvl2::N) lvl2::deallocate(ptr); else
   if(n <= lvl3::N) lvl3::deallocate(ptr); else
   if(n <= lvl4::N) lvl4::deallocate(ptr); else
 #endif
-  _dealloc_raw(ptr, n);
-  unlock();
+  {
+    lock();
+    _dealloc_raw(ptr, n);
+    unlock();
+  }
+}
+
+void JAllocDispatcher::flush_thread_cache() {
+#ifdef JALIB_THREAD_CACHE
+  lvl1::flushThreadCache();
+  lvl2::flushThreadCache();
+  lvl3::flushThreadCache();
+  lvl4::flushThreadCache();
+#endif
 }
 
 } // namespace jalib
@@ -272,6 +362,9 @@ void jalib::JAllocDispatcher::deallocate(void* ptr, size_t){
   unlock();
 }
 
+void jalib::JAllocDispatcher::flush_thread_cache() {
+}
+
 #endif
 
 #ifndef RECORD_REPLAY
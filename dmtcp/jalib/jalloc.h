@@ -51,6 +51,8 @@ public:
   static void disable_locks();
   static void enable_locks();
   static void reset_on_fork();
+  // Return the chunks cached by the calling thread; call before it exits.
+  static void flush_thread_cache();
 };
 
 }
@@ -61,6 +63,8 @@ public:
 #define JALLOC_HELPER_ENABLE_LOCKS() jalib::JAllocDispatcher::enable_locks();
 
 #define JALLOC_HELPER_RESET_ON_FORK() jalib::JAllocDispatcher::reset_on_fork();
+#define JALLOC_HELPER_FLUSH_THREAD_CACHE() \
+  jalib::JAllocDispatcher::flush_thread_cache();
 
 #define JALLOC_HELPER_NEW(nbytes) return jalib::JAllocDispatcher::malloc(nbytes)
 #define JALLOC_HELPER_DELETE(p) return jalib::JAllocDispatcher::free(p)
@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dlfcn.h>
+#include <time.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include <fstream>
 #ifndef ANDROID
@@ -68,12 +71,43 @@ void jassert_internal::jassert_set_console_fd(int fd)
 
 jassert_internal::JAssert& jassert_internal::JAssert::Text ( const char* msg )
 {
+  if ( _record != NULL ) {
+    JBinaryArg* a = binary_arg ( _record, "Message: " );
+    if ( a != NULL ) binary_encode ( a, msg );
+    return *this;
+  }
   Print ( "Message: " );
   Print ( msg );
   Print ( "\n" );
   return *this;
 }
 
+jassert_internal::JAssert&
+jassert_internal::JAssert::Context ( const char* type, const char* file,
+                                     int line, const char* func,
+                                     pid_t (*pidFn)(), pid_t (*tidFn)() )
+{
+  if ( _record != NULL ) {
+    binary_log_context ( _record, type, file, line, func, pidFn, tidFn );
+    return *this;
+  }
+  Print ( '[' ).Print ( pidFn() ).Print ( "] [" ).Print ( tidFn() );
+  Print ( "] " ).Print ( type ).Print ( " at " );
+  Print ( jassert_basename ( file ) ).Print ( ':' ).Print ( line );
+  Print ( " in " ).Print ( func );
+  return *this;
+}
+
+jassert_internal::JAssert&
+jassert_internal::JAssert::Reason ( const char* reason )
+{
+  if ( _record != NULL ) {
+    _record->reason = reason;
+    return *this;
+  }
+  return Print ( reason );
+}
+
 #ifndef ANDROID
 static pthread_mutex_t logLock = PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP;
 #else
@@ -97,36 +131,56 @@ void jassert_internal::unlockLog()
   }
 }
 
-jassert_internal::JAssert::JAssert ( bool exitWhenDone )
+static void writeBinaryRings();
+
+jassert_internal::JAssert::JAssert ( bool exitWhenDone, bool useBinaryLog )
     : JASSERT_CONT_A ( *this )
     , JASSERT_CONT_B ( *this )
     , _exitWhenDone ( exitWhenDone )
+    , _logLockAcquired ( false )
+    , _record ( NULL )
+    , _ss ( NULL )
 {
+  if ( useBinaryLog && jassert_binary_log_enabled ) {
+    _record = binary_log_begin();
+    return;
+  }
+  _ss = new ( _ssBuf ) dmtcp::ostringstream;
   _logLockAcquired = jassert_internal::lockLog();
 }
 
+template < typename T > static void destroy ( T* p ) { p->~T(); }
+
 jassert_internal::JAssert::~JAssert()
 {
+  if ( _record != NULL ) {
+    binary_log_end ( _record );
+    return;
+  }
+
   if ( _exitWhenDone ) {
+    if ( _logLockAcquired )
+      writeBinaryRings();
     Print ( jalib::Filesystem::GetProgramName() );
     Print ( " (" );
     Print ( getpid() );
     Print ( "): Terminating...\n" );
-    jassert_safe_print ( ss.str().c_str() );
-    ss.str("");
+    jassert_safe_print ( stream().str().c_str() );
+    stream().str("");
 #ifdef DEBUG
     jbacktrace();
 #endif
   }
 
-  if (!ss.str().empty())
-    jassert_safe_print ( ss.str().c_str() );
+  if (!stream().str().empty())
+    jassert_safe_print ( stream().str().c_str() );
   if ( _logLockAcquired )
     jassert_internal::unlockLog();
 
   if ( _exitWhenDone ) {
     _exit ( jalib::dmtcp_fail_rc );
   }
+  destroy ( _ss );
 }
 
 const char* jassert_internal::jassert_basename ( const char* str )
@@ -239,10 +293,308 @@ jassert_internal::JAssert& jassert_internal::JAssert::jbacktrace ()
   return *this;  // Needed as part of JASSERT macro
 }
 
+/* Binary log (see jassert.h).  Each thread owns a single-producer ring;
+ * records are consumed only by a thread holding logLock, so each ring has at
+ * most one consumer at a time.  Rings are never freed; a ring released by an
+ * exiting thread is reused by the next new thread.
+ */
+#define JBINARY_RING_SIZE 128
+#define JBINARY_MAGIC "JBINLOG1"
+
+enum {
+  JBINARY_ENTRY_STRING = 1,     // u64 ptr, u32 len, u32 0, chars
+  JBINARY_ENTRY_RECORDS,        // u32 count, u32 0, count JBinaryRecords
+  JBINARY_ENTRY_DROPPED         // u32 tid, u32 count
+};
+
+struct JBinaryRing {
+  JBinaryRing* next;
+  volatile int owned;
+  pid_t pid;
+  pid_t tid;
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+  jassert_internal::JBinaryRecord scratch;   // used when the ring is full
+  jassert_internal::JBinaryRecord records[JBINARY_RING_SIZE];
+};
+
+bool jassert_internal::jassert_binary_log_enabled = false;
+static int theBinaryLogFd = -1;
+static JBinaryRing* volatile theBinaryRings = NULL;
+
+#ifndef ANDROID
+static __thread JBinaryRing* theThreadRing = NULL;
+#else
+static pthread_key_t theThreadRingKey;
+static pthread_once_t theThreadRingKeyOnce = PTHREAD_ONCE_INIT;
+static void createThreadRingKey()
+{
+  pthread_key_create(&theThreadRingKey, NULL);
+}
+#endif
+
+static JBinaryRing* getThreadRing()
+{
+#ifndef ANDROID
+  JBinaryRing* ring = theThreadRing;
+#else
+  pthread_once(&theThreadRingKeyOnce, createThreadRingKey);
+  JBinaryRing* ring = (JBinaryRing*) pthread_getspecific(theThreadRingKey);
+#endif
+  if (ring != NULL) return ring;
+
+  for (ring = theBinaryRings; ring != NULL; ring = ring->next) {
+    if (ring->owned == 0 && __sync_bool_compare_and_swap(&ring->owned, 0, 1))
+      break;
+  }
+  if (ring == NULL) {
+    // Memory from _alloc_raw is zero-filled.
+    ring = (JBinaryRing*) jalib::JAllocDispatcher::allocate(sizeof(*ring));
+    ring->owned = 1;
+    do {
+      ring->next = theBinaryRings;
+    } while (!__sync_bool_compare_and_swap(&theBinaryRings, ring->next, ring));
+  }
+  ring->pid = 0;
+  ring->tid = 0;
+#ifndef ANDROID
+  theThreadRing = ring;
+#else
+  pthread_setspecific(theThreadRingKey, ring);
+#endif
+  return ring;
+}
+
+jassert_internal::JBinaryRecord* jassert_internal::binary_log_begin()
+{
+  JBinaryRing* ring = getThreadRing();
+  JBinaryRecord* rec;
+  if (ring->head - ring->tail >= JBINARY_RING_SIZE) {
+    __sync_fetch_and_add(&ring->dropped, 1);
+    rec = &ring->scratch;
+  } else {
+    rec = &ring->records[ring->head % JBINARY_RING_SIZE];
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  rec->timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  rec->nargs = 0;
+  return rec;
+}
+
+void jassert_internal::binary_log_end(JBinaryRecord* rec)
+{
+  JBinaryRing* ring = getThreadRing();
+  if (rec == &ring->scratch) return;
+  __sync_synchronize();
+  ring->head++;
+  if (ring->head - ring->tail >= JBINARY_RING_SIZE / 2 &&
+      jalib::pthread_mutex_trylock(&logLock) == 0) {
+    writeBinaryRings();
+    unlockLog();
+  }
+}
+
+void jassert_internal::binary_log_context(JBinaryRecord* rec,
+                                          const char* type,
+                                          const char* file, int line,
+                                          const char* func,
+                                          pid_t (*pidFn)(), pid_t (*tidFn)())
+{
+  JBinaryRing* ring = getThreadRing();
+  if (ring->tid == 0) {
+    ring->pid = pidFn();
+    ring->tid = tidFn();
+  }
+  rec->type = type;
+  rec->reason = NULL;
+  rec->file = file;
+  rec->func = func;
+  rec->line = line;
+  rec->pid = ring->pid;
+  rec->tid = ring->tid;
+}
+
+/* The file refers to strings by their address; each string is written once,
+ * before the first record using it.  The table of written addresses is a
+ * fixed-size hash set; when it fills up, it is cleared and strings are
+ * simply written again.
+ */
+#define JBINARY_STRTAB_SIZE 4096
+static const void* theBinaryStrtab[JBINARY_STRTAB_SIZE];
+static int theBinaryStrtabCount = 0;
+
+static void writeBinaryString(const char* str)
+{
+  if (str == NULL) return;
+  size_t h = ((uintptr_t) str >> 3) % JBINARY_STRTAB_SIZE;
+  while (theBinaryStrtab[h] != NULL) {
+    if (theBinaryStrtab[h] == str) return;
+    h = (h + 1) % JBINARY_STRTAB_SIZE;
+  }
+  if (theBinaryStrtabCount >= JBINARY_STRTAB_SIZE / 2) {
+    memset(theBinaryStrtab, 0, sizeof(theBinaryStrtab));
+    theBinaryStrtabCount = 0;
+    h = ((uintptr_t) str >> 3) % JBINARY_STRTAB_SIZE;
+  }
+  theBinaryStrtab[h] = str;
+  theBinaryStrtabCount++;
+
+  uint32_t hdr[2] = { JBINARY_ENTRY_STRING, (uint32_t) strlen(str) };
+  uint64_t ptr = (uintptr_t) str;
+  jalib::writeAll(theBinaryLogFd, hdr, sizeof(hdr));
+  jalib::writeAll(theBinaryLogFd, &ptr, sizeof(ptr));
+  jalib::writeAll(theBinaryLogFd, str, hdr[1]);
+}
+
+// Caller must hold logLock.
+static void writeBinaryRings()
+{
+  for (JBinaryRing* ring = theBinaryRings; ring != NULL; ring = ring->next) {
+    uint32_t dropped = ring->dropped;
+    if (dropped != 0) {
+      __sync_fetch_and_sub(&ring->dropped, dropped);
+      if (theBinaryLogFd != -1) {
+        uint32_t entry[4] = { JBINARY_ENTRY_DROPPED, 0, (uint32_t) ring->tid,
+                               dropped };
+        jalib::writeAll(theBinaryLogFd, entry, sizeof(entry));
+      }
+    }
+    uint32_t tail = ring->tail;
+    uint32_t head = ring->head;
+    __sync_synchronize();
+    if (head == tail) continue;
+    if (theBinaryLogFd != -1) {
+      for (uint32_t i = tail; i != head; i++) {
+        const jassert_internal::JBinaryRecord* rec =
+          &ring->records[i % JBINARY_RING_SIZE];
+        writeBinaryString(rec->type);
+        writeBinaryString(rec->reason);
+        writeBinaryString(rec->file);
+        writeBinaryString(rec->func);
+        for (int j = 0; j < rec->nargs && j < jassert_internal::JBINARY_MAX_ARGS;
+             j++) {
+          writeBinaryString(rec->args[j].name);
+        }
+      }
+      // The records may wrap around the end of the ring.
+      uint32_t first = tail % JBINARY_RING_SIZE;
+      uint32_t count = head - tail;
+      uint32_t n = JBINARY_RING_SIZE - first < count
+                     ? JBINARY_RING_SIZE - first : count;
+      uint32_t hdr[2] = { JBINARY_ENTRY_RECORDS, n };
+      jalib::writeAll(theBinaryLogFd, hdr, sizeof(hdr));
+      jalib::writeAll(theBinaryLogFd, &ring->records[first],
+                      n * sizeof(ring->records[0]));
+      if (n < count) {
+        hdr[1] = count - n;
+        jalib::writeAll(theBinaryLogFd, hdr, sizeof(hdr));
+        jalib::writeAll(theBinaryLogFd, &ring->records[0],
+                        hdr[1] * sizeof(ring->records[0]));
+      }
+    }
+    __sync_synchronize();
+    ring->tail = head;
+  }
+}
+
+void jassert_internal::flush_binary_log ( )
+{
+  if (!jassert_binary_log_enabled) return;
+  bool locked = lockLog();
+  writeBinaryRings();
+  if (locked) unlockLog();
+}
+
+static void flushBinaryLogAtExit()
+{
+  jassert_internal::flush_binary_log();
+}
+
+void jassert_internal::release_thread_binary_log ( )
+{
+#ifndef ANDROID
+  JBinaryRing* ring = theThreadRing;
+  theThreadRing = NULL;
+#else
+  pthread_once(&theThreadRingKeyOnce, createThreadRingKey);
+  JBinaryRing* ring = (JBinaryRing*) pthread_getspecific(theThreadRingKey);
+  pthread_setspecific(theThreadRingKey, NULL);
+#endif
+  if (ring != NULL) {
+    __sync_synchronize();
+    ring->owned = 0;
+  }
+}
+
+void jassert_internal::set_binary_log_file ( const jalib::string& path,
+                                             int protectedFd )
+{
+  static bool atexitRegistered = false;
+  if ( theBinaryLogFd != -1 ) close ( theBinaryLogFd );
+  theBinaryLogFd = -1;
+  if ( path.length() > 0 ) {
+    theBinaryLogFd = _open_log_safe ( path, protectedFd );
+  }
+  if ( theBinaryLogFd != -1 && !atexitRegistered ) {
+    atexit ( flushBinaryLogAtExit );
+    atexitRegistered = true;
+  }
+  restart_binary_log();
+}
+
+void jassert_internal::restart_binary_log ( )
+{
+  // After restart, the fd is whatever dmtcp_restart opened (if anything), so
+  // the strings have to be written again.
+  memset(theBinaryStrtab, 0, sizeof(theBinaryStrtab));
+  theBinaryStrtabCount = 0;
+  off_t size = -1;
+  if ( theBinaryLogFd != -1 ) {
+    size = lseek ( theBinaryLogFd, 0, SEEK_END );
+  }
+  if ( size == -1 ) {
+    theBinaryLogFd = -1;
+    jassert_binary_log_enabled = false;
+    return;
+  }
+  if ( size == 0 ) {
+    char magic[8];
+    uint32_t hdr[2] = { sizeof(void*), sizeof(JBinaryRecord) };
+    memcpy(magic, JBINARY_MAGIC, sizeof(magic));
+    jalib::writeAll(theBinaryLogFd, magic, sizeof(magic));
+    jalib::writeAll(theBinaryLogFd, hdr, sizeof(hdr));
+  }
+  jassert_binary_log_enabled = true;
+}
+
 void jassert_internal::reset_on_fork ( )
 {
   pthread_mutex_t newLock = PTHREAD_MUTEX_INITIALIZER;
   logLock = newLock;
+
+  // The parent writes out what is already in the rings; only the forking
+  // thread exists in the child.
+#ifndef ANDROID
+  JBinaryRing* self = theThreadRing;
+#else
+  JBinaryRing* self = NULL;
+  if (jassert_binary_log_enabled) {
+    self = (JBinaryRing*) pthread_getspecific(theThreadRingKey);
+  }
+#endif
+  for (JBinaryRing* ring = theBinaryRings; ring != NULL; ring = ring->next) {
+    ring->tail = ring->head;
+    ring->dropped = 0;
+    if (ring != self) {
+      ring->owned = 0;
+    }
+  }
+  if (self != NULL) {
+    self->pid = 0;
+    self->tid = 0;
+  }
 }
 
 void jassert_internal::set_log_file ( const jalib::string& path )
@@ -27,9 +27,11 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <new>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
 #ifndef ANDROID
 #include <execinfo.h> /* For backtrace() */
 #endif
@@ -82,10 +84,129 @@ extern int jassert_quiet;
  *
  * It has the ability to output any variable understood by std::ostream.
  *
+ *
+ * BINARY LOG:
+ *   If DMTCP_BINARY_LOG is set, JTRACE and JNOTE do not format anything.  They
+ *   fill in a fixed-size JBinaryRecord (pointers to the literal strings of the
+ *   call site, a timestamp, the pid/tid and up to JBINARY_MAX_ARGS values) in a
+ *   per-thread ring buffer, without taking the log lock.  The rings are written
+ *   to jassertlog.*.bin by whichever thread finds its ring half full and can
+ *   get the log lock, by the checkpoint thread, and at exit;
+ *   utils/jassert_decode.py renders the file as text.  Integers, floating
+ *   point numbers, pointers and strings are stored as-is (strings truncated to
+ *   JBINARY_STR_LEN-1 chars); other types are formatted with operator<< and
+ *   truncated.  JASSERT and JWARNING always print as text.
  */
 
 namespace jassert_internal
 {
+  enum {
+    JBINARY_MAX_ARGS = 5,
+    JBINARY_STR_LEN = 24
+  };
+
+  enum JBinaryArgType {
+    JBINARY_INT = 1,
+    JBINARY_UINT,
+    JBINARY_DOUBLE,
+    JBINARY_PTR,
+    JBINARY_STR,
+    JBINARY_CHAR
+  };
+
+  struct JBinaryArg {
+    const char* name;           // "     term = ", or NULL for Text()/Print()
+    uint32_t type;
+    uint32_t len;
+    union {
+      int64_t i;
+      uint64_t u;
+      double d;
+      char s[JBINARY_STR_LEN];
+    } val;
+  };
+
+  struct JBinaryRecord {
+    uint64_t timestamp;         // CLOCK_REALTIME, in ns
+    const char* type;
+    const char* reason;         // "; REASON='...'\n", or NULL if an arg
+    const char* file;
+    const char* func;
+    int32_t line;
+    int32_t pid;
+    int32_t tid;
+    int32_t nargs;              // may exceed JBINARY_MAX_ARGS
+    JBinaryArg args[JBINARY_MAX_ARGS];
+  };
+
+  extern bool jassert_binary_log_enabled;
+  JBinaryRecord* binary_log_begin();
+  void binary_log_end(JBinaryRecord* rec);
+  void binary_log_context(JBinaryRecord* rec, const char* type,
+                          const char* file, int line, const char* func,
+                          pid_t (*pidFn)(), pid_t (*tidFn)());
+
+  inline JBinaryArg* binary_arg(JBinaryRecord* rec, const char* name)
+  {
+    int n = rec->nargs++;
+    if (n >= JBINARY_MAX_ARGS) return NULL;
+    rec->args[n].name = name;
+    return &rec->args[n];
+  }
+
+  inline void binary_str(JBinaryArg* a, const char* s, size_t len)
+  {
+    a->type = JBINARY_STR;
+    a->len = len;
+    if (len >= JBINARY_STR_LEN) len = JBINARY_STR_LEN - 1;
+    memcpy(a->val.s, s, len);
+    a->val.s[len] = '\0';
+  }
+
+  inline void binary_encode(JBinaryArg* a, bool v)
+  { a->type = JBINARY_INT; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, char v)
+  { a->type = JBINARY_CHAR; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, int v)
+  { a->type = JBINARY_INT; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, long v)
+  { a->type = JBINARY_INT; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, long long v)
+  { a->type = JBINARY_INT; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, short v)
+  { a->type = JBINARY_INT; a->val.i = v; }
+  inline void binary_encode(JBinaryArg* a, unsigned char v)
+  { a->type = JBINARY_UINT; a->val.u = v; }
+  inline void binary_encode(JBinaryArg* a, unsigned short v)
+  { a->type = JBINARY_UINT; a->val.u = v; }
+  inline void binary_encode(JBinaryArg* a, unsigned int v)
+  { a->type = JBINARY_UINT; a->val.u = v; }
+  inline void binary_encode(JBinaryArg* a, unsigned long v)
+  { a->type = JBINARY_UINT; a->val.u = v; }
+  inline void binary_encode(JBinaryArg* a, unsigned long long v)
+  { a->type = JBINARY_UINT; a->val.u = v; }
+  inline void binary_encode(JBinaryArg* a, double v)
+  { a->type = JBINARY_DOUBLE; a->val.d = v; }
+  inline void binary_encode(JBinaryArg* a, const char* v)
+  {
+    if (v == NULL) v = "(null)";
+    binary_str(a, v, strlen(v));
+  }
+  inline void binary_encode(JBinaryArg* a, char* v)
+  { binary_encode(a, (const char*) v); }
+  inline void binary_encode(JBinaryArg* a, const dmtcp::string& v)
+  { binary_str(a, v.c_str(), v.length()); }
+  inline void binary_encode(JBinaryArg* a, const std::string& v)
+  { binary_str(a, v.c_str(), v.length()); }
+  template < typename T > inline void binary_encode(JBinaryArg* a, T* v)
+  { a->type = JBINARY_PTR; a->val.u = (uintptr_t) v; }
+  // Anything else goes through operator<< (slow path).
+  template < typename T > inline void binary_encode(JBinaryArg* a, const T& v)
+  {
+    dmtcp::ostringstream o;
+    o << v;
+    binary_str(a, o.str().c_str(), o.str().length());
+  }
 
   class JAssert
   {
@@ -100,14 +221,27 @@ namespace jassert_internal
       template < typename T > JAssert& Print ( const T& t );
       template < typename T > JAssert& Print ( const dmtcp::vector<T>& t );
       ///
+      /// print "name" followed by value and a newline
+      template < typename T > JAssert& Arg ( const char* name, const T& t );
+      ///
+      /// print "[pid] [tid] type at file:line in func"
+      JAssert& Context ( const char* type, const char* file, int line,
+                         const char* func, pid_t (*pidFn)(),
+                         pid_t (*tidFn)() );
+      ///
+      /// print "; REASON='...'\n" (usually a literal; may be a string)
+      JAssert& Reason ( const char* reason );
+      template < typename T > JAssert& Reason ( const T& reason )
+      { return Print ( reason ); }
+      ///
       /// print out a string in format "Message: msg"
       JAssert& Text ( const char* msg );
       ///
       /// prints stack backtrace and always returns true
       JAssert& jbacktrace ();
       ///
-      /// constructor: sets members
-      JAssert ( bool exitWhenDone );
+      /// constructor: sets members; JTRACE/JNOTE pass useBinaryLog
+      JAssert ( bool exitWhenDone, bool useBinaryLog = false );
       ///
       /// destructor: exits program if exitWhenDone is set
       ~JAssert();
@@ -121,11 +255,20 @@ namespace jassert_internal
       template < typename T > JAssert& operator << ( const T& t )
       { Print ( t ); return *this; }
     private:
+      dmtcp::ostringstream& stream() { return *_ss; }
       ///
       /// if set true (on construction) call exit() on destruction
       bool _exitWhenDone;
       bool _logLockAcquired;
-      dmtcp::ostringstream ss;
+      ///
+      /// set when writing to the binary log; then _ss is not constructed
+      JBinaryRecord* _record;
+      dmtcp::ostringstream* _ss;
+      union {
+        char _ssBuf[sizeof(dmtcp::ostringstream)];
+        long double _ssAlign;
+        void* _ssAlignPtr;
+      };
   };
 
 
@@ -139,10 +282,15 @@ namespace jassert_internal
   template < typename T >
   inline JAssert& JAssert::Print ( const T& t )
   {
+    if ( _record != NULL ) {
+      JBinaryArg* a = binary_arg ( _record, NULL );
+      if ( a != NULL ) binary_encode ( a, t );
+      return *this;
+    }
 #ifdef JASSERT_FAST
     jassert_output_stream() << t;
 #else
-    ss << t;
+    stream() << t;
 #endif
     return *this;
   }
@@ -150,13 +298,39 @@ namespace jassert_internal
   template < typename T >
   inline JAssert& JAssert::Print ( const dmtcp::vector<T>& t )
   {
+    if ( _record != NULL ) {
+      JBinaryArg* a = binary_arg ( _record, NULL );
+      if ( a != NULL ) {
+        dmtcp::ostringstream o;
+        for (size_t i = 0; i < t.size(); i++) {
+          o << t[i] << "\n";
+        }
+        binary_encode ( a, o.str() );
+      }
+      return *this;
+    }
     for (size_t i = 0; i < t.size(); i++) {
-      ss << t[i] << "\n";
+      stream() << t[i] << "\n";
     }
     return *this;
   }
 
+  template < typename T >
+  inline JAssert& JAssert::Arg ( const char* name, const T& t )
+  {
+    if ( _record != NULL ) {
+      JBinaryArg* a = binary_arg ( _record, name );
+      if ( a != NULL ) binary_encode ( a, t );
+      return *this;
+    }
+    return Print ( name ).Print ( t ).Print ( "\n" );
+  }
+
   void set_log_file ( const jalib::string& path );
+  void set_binary_log_file ( const jalib::string& path, int protectedFd );
+  void flush_binary_log ( );
+  void restart_binary_log ( );
+  void release_thread_binary_log ( );
   void reset_on_fork ( );
 
   int jassert_console_fd();
@@ -172,6 +346,13 @@ namespace jassert_internal
 #define JASSERT_CKPT_LOCK() (jassert_internal::lockLog());
 #define JASSERT_CKPT_UNLOCK() (jassert_internal::unlockLog());
 
+#define JASSERT_SET_BINARY_LOGFILE(p, fd) \
+  (jassert_internal::set_binary_log_file(p, fd));
+#define JASSERT_FLUSH_BINARY_LOG() (jassert_internal::flush_binary_log());
+#define JASSERT_RESTART_BINARY_LOG() (jassert_internal::restart_binary_log());
+#define JASSERT_RELEASE_THREAD_LOG() \
+  (jassert_internal::release_thread_binary_log());
+
 #define JASSERT_ERRNO (strerror(errno))
 
 #define JASSERT_SET_CONSOLE_FD(fd) \
@@ -181,7 +362,7 @@ namespace jassert_internal
 #define JASSERT_STDERR      jassert_internal::JAssert(false)
 #define JASSERT_STDERR_FD   (jassert_internal::jassert_console_fd())
 
-#define JASSERT_CONT(AB,term) Print("     " #term " = ").Print(term).Print("\n").JASSERT_CONT_##AB
+#define JASSERT_CONT(AB,term) Arg("     " #term " = ", term).JASSERT_CONT_##AB
 #define JASSERT_CONT_A(term) JASSERT_CONT(B,term)
 #define JASSERT_CONT_B(term) JASSERT_CONT(A,term)
 
@@ -190,10 +371,10 @@ namespace jassert_internal
 #define JASSERT_FUNC __FUNCTION__
 #define JASSERT_LINE JASSERT_STRINGIFY(__LINE__)
 #define JASSERT_FILE jassert_internal::jassert_basename(__FILE__)
-#define JASSERT_CONTEXT(type,reason) Print('[').Print(getpid()).Print("] [").Print(gettid()).Print("] "type " at ").Print(JASSERT_FILE).Print(":" JASSERT_LINE " in ").Print(JASSERT_FUNC).Print("; REASON='" reason "'\n")
+#define JASSERT_CONTEXT(type,reason) Context(type, __FILE__, __LINE__, JASSERT_FUNC, getpid, gettid).Reason("; REASON='" reason "'\n")
 
 #ifdef DEBUG
-#define JTRACE(msg) jassert_internal::JAssert(false).JASSERT_CONTEXT("TRACE",msg).JASSERT_CONT_A
+#define JTRACE(msg) jassert_internal::JAssert(false, true).JASSERT_CONTEXT("TRACE",msg).JASSERT_CONT_A
 #else
 #define JTRACE(msg) if(true){}else jassert_internal::JAssert(false).JASSERT_CONTEXT("NOTE",msg).JASSERT_CONT_A
 #endif
@@ -202,7 +383,7 @@ namespace jassert_internal
 #define JNOTE(msg) if(true){}else jassert_internal::JAssert(false).JASSERT_CONTEXT("NOTE",msg).JASSERT_CONT_A
 #else
 #define JNOTE(msg) if(jassert_quiet >= 1){}else \
-    jassert_internal::JAssert(false).JASSERT_CONTEXT("NOTE",msg).JASSERT_CONT_A
+    jassert_internal::JAssert(false, true).JASSERT_CONTEXT("NOTE",msg).JASSERT_CONT_A
 #endif
 
 #ifdef QUIET
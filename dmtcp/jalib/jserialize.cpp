@@ -20,6 +20,8 @@
  ****************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,6 +32,8 @@
 jalib::JBinarySerializeWriterRaw::JBinarySerializeWriterRaw ( const jalib::string& path, int fd )
     : JBinarySerializer ( path )
     , _fd ( fd )
+    , _buf ( NULL )
+    , _bufLen ( 0 )
 {
   JASSERT (_fd >= 0)(path)(JASSERT_ERRNO).Text("open(path) failed");
 }
@@ -41,21 +45,46 @@ jalib::JBinarySerializeWriter::JBinarySerializeWriter ( const jalib::string& pat
 jalib::JBinarySerializeReaderRaw::JBinarySerializeReaderRaw ( const jalib::string& path, int fd )
   : JBinarySerializer ( path )
   , _fd ( fd )
+  , _buf ( NULL )
+  , _bufPos ( 0 )
+  , _bufEnd ( 0 )
 {
   JASSERT (_fd >= 0)(path)(JASSERT_ERRNO).Text("open(path) failed");
+  // Read-ahead must be undone in the destructor; not possible on a pipe.
+  if (lseek(_fd, 0, SEEK_CUR) != -1) {
+    _buf = (char*) JALLOC_HELPER_MALLOC(JSERIALIZE_BUFFER_SIZE);
+  }
 }
 
 jalib::JBinarySerializeReader::JBinarySerializeReader ( const jalib::string& path )
   : JBinarySerializeReaderRaw ( path , jalib::open ( path.c_str(), O_RDONLY, 0 ) )
 {}
 
+jalib::JBinarySerializeWriterRaw::~JBinarySerializeWriterRaw()
+{
+  flush();
+  if (_buf != NULL) {
+    JALLOC_HELPER_FREE(_buf);
+  }
+}
+
 jalib::JBinarySerializeWriter::~JBinarySerializeWriter()
 {
+  flush();
   close ( _fd );
 }
 
+jalib::JBinarySerializeReaderRaw::~JBinarySerializeReaderRaw()
+{
+  unread();
+  if (_buf != NULL) {
+    JALLOC_HELPER_FREE(_buf);
+  }
+}
+
 jalib::JBinarySerializeReader::~JBinarySerializeReader()
 {
+  dropBuffer();
   close ( _fd );
 }
 
@@ -67,16 +96,19 @@ bool jalib::JBinarySerializeReaderRaw::isReader() {return true;}
 // Rewind file descriptor to start value
 void jalib::JBinarySerializeWriterRaw::rewind()
 {
+  flush();
   JASSERT(lseek(_fd,0,SEEK_SET) == 0)(strerror(errno)).Text("Cannot rewind");
 }
 
 void jalib::JBinarySerializeReaderRaw::rewind()
 {
+  dropBuffer();
   JASSERT(lseek(_fd,0,SEEK_SET) == 0)(strerror(errno)).Text("Cannot rewind");
 }
 
 bool jalib::JBinarySerializeWriterRaw::isempty()
 {
+  flush();
   struct stat buf;
   JASSERT(fstat(_fd, &buf) == 0);
   return buf.st_size == 0;
@@ -91,6 +123,10 @@ bool jalib::JBinarySerializeReaderRaw::isempty()
 
 bool jalib::JBinarySerializeReaderRaw::isEOF()
 {
+  if (_bufPos < _bufEnd) {
+    return false;
+  }
+
   struct stat buf;
   JASSERT(fstat(_fd, &buf) == 0);
 
@@ -100,18 +136,96 @@ bool jalib::JBinarySerializeReaderRaw::isEOF()
   return cur == buf.st_size;
 }
 
-void jalib::JBinarySerializeWriterRaw::readOrWrite ( void* buffer, size_t len )
+void jalib::JBinarySerializeWriterRaw::flush()
 {
-  size_t ret = jalib::writeAll(_fd, buffer, len);
-  JASSERT(ret == len) (filename()) (len) (JASSERT_ERRNO)
+  if (_bufLen == 0) {
+    return;
+  }
+  size_t ret = jalib::writeAll(_fd, _buf, _bufLen);
+  JASSERT(ret == _bufLen) (filename()) (_bufLen) (JASSERT_ERRNO)
     .Text( "write() failed" );
+  _bufLen = 0;
+}
+
+void jalib::JBinarySerializeWriterRaw::readOrWrite ( void* buffer, size_t len )
+{
+  if (_bufLen + len > JSERIALIZE_BUFFER_SIZE) {
+    flush();
+  }
+  if (len >= JSERIALIZE_BUFFER_SIZE) {
+    size_t ret = jalib::writeAll(_fd, buffer, len);
+    JASSERT(ret == len) (filename()) (len) (JASSERT_ERRNO)
+      .Text( "write() failed" );
+  } else {
+    if (_buf == NULL) {
+      _buf = (char*) JALLOC_HELPER_MALLOC(JSERIALIZE_BUFFER_SIZE);
+    }
+    memcpy(_buf + _bufLen, buffer, len);
+    _bufLen += len;
+  }
   _bytes += len;
 }
 
+// Forget the read-ahead data, e.g. because the fd is about to be closed or
+// repositioned.
+void jalib::JBinarySerializeReaderRaw::dropBuffer()
+{
+  _bufPos = _bufEnd = 0;
+}
+
+// Give back the read-ahead data, so that the fd offset is right after the
+// last field consumed.
+void jalib::JBinarySerializeReaderRaw::unread()
+{
+  if (_bufPos < _bufEnd) {
+    off_t unconsumed = _bufEnd - _bufPos;
+    JWARNING(lseek(_fd, -unconsumed, SEEK_CUR) != -1)
+      (filename()) (unconsumed) (JASSERT_ERRNO);
+  }
+  dropBuffer();
+}
+
 void jalib::JBinarySerializeReaderRaw::readOrWrite ( void* buffer, size_t len )
 {
-  size_t ret = jalib::readAll(_fd, buffer, len);
-  JASSERT(ret == len) (filename()) (JASSERT_ERRNO) (ret) (len)
-    .Text("read() failed");
+  char *dest = (char*) buffer;
+  size_t done = 0;
+
+  while (done < len) {
+    if (_bufPos < _bufEnd) {
+      size_t n = _bufEnd - _bufPos;
+      if (n > len - done) n = len - done;
+      memcpy(dest + done, _buf + _bufPos, n);
+      _bufPos += n;
+      done += n;
+    } else if (_buf == NULL || len - done >= JSERIALIZE_BUFFER_SIZE) {
+      size_t ret = jalib::readAll(_fd, dest + done, len - done);
+      JASSERT(ret == len - done) (filename()) (JASSERT_ERRNO) (ret) (len)
+        .Text("read() failed");
+      done = len;
+    } else {
+      ssize_t ret;
+      do {
+        ret = jalib::read(_fd, _buf, JSERIALIZE_BUFFER_SIZE);
+      } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+      JASSERT(ret > 0) (filename()) (JASSERT_ERRNO) (ret) (len)
+        .Text("read() failed");
+      _bufPos = 0;
+      _bufEnd = ret;
+    }
+  }
+  _bytes += len;
+}
+
+void jalib::JBinarySerializeWriterMem::readOrWrite ( void* buffer, size_t len )
+{
+  _data.append((const char*) buffer, len);
+  _bytes += len;
+}
+
+void jalib::JBinarySerializeReaderMem::readOrWrite ( void* buffer, size_t len )
+{
+  JASSERT(_bytes + len <= _len) (filename()) (_bytes) (len) (_len)
+    .Text("read past end of buffer");
+  memcpy(buffer, _data + _bytes, len);
   _bytes += len;
 }
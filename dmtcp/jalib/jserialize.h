@@ -155,16 +155,32 @@ namespace jalib
     serializeVector( t );
   }
 
+  /* The file serializers below buffer their I/O (JSERIALIZE_BUFFER_SIZE
+   * bytes), so that serializing a table field by field does not cost one
+   * syscall per field.  A writer writes out its buffer in flush(), rewind(),
+   * isempty() and on destruction; call flush() explicitly before anything
+   * else writes to (or locks/unlocks) the same fd.  A reader only reads ahead
+   * on seekable fds, and seeks back over what was not consumed on
+   * destruction, so the fd is left right after the last serialized field, as
+   * if it were unbuffered.
+   */
+  enum { JSERIALIZE_BUFFER_SIZE = 64 * 1024 };
+
   class JBinarySerializeWriterRaw : public JBinarySerializer
   {
     public:
       JBinarySerializeWriterRaw ( const jalib::string& file, int fd );
+      ~JBinarySerializeWriterRaw();
       void readOrWrite ( void* buffer, size_t len );
       bool isReader();
       void rewind();
       bool isempty();
+      void flush();
     protected:
       int _fd;
+    private:
+      char *_buf;
+      size_t _bufLen;
   };
 
   class JBinarySerializeWriter : public JBinarySerializeWriterRaw
@@ -178,13 +194,20 @@ namespace jalib
   {
     public:
       JBinarySerializeReaderRaw ( const jalib::string& file, int fd );
+      ~JBinarySerializeReaderRaw();
       void readOrWrite ( void* buffer, size_t len );
       bool isReader();
       void rewind();
       bool isempty();
       bool isEOF();
     protected:
+      void dropBuffer();
       int _fd;
+    private:
+      void unread();
+      char *_buf;
+      size_t _bufPos;
+      size_t _bufEnd;
   };
 
   class JBinarySerializeReader : public JBinarySerializeReaderRaw
@@ -194,7 +217,40 @@ namespace jalib
       ~JBinarySerializeReader();
   };
 
+  /* Serialize to/from memory, e.g. to build a table before taking a lock on
+   * the file it goes to, and write it with a single writeAll().
+   */
+  class JBinarySerializeWriterMem : public JBinarySerializer
+  {
+    public:
+      JBinarySerializeWriterMem ( const jalib::string& name )
+        : JBinarySerializer ( name ) {}
+      void readOrWrite ( void* buffer, size_t len );
+      bool isReader() { return false; }
+      void rewind() { _data.clear(); _bytes = 0; }
+      bool isempty() { return _data.empty(); }
+      const char *data() const { return _data.data(); }
+      size_t size() const { return _data.size(); }
+    private:
+      jalib::string _data;
+  };
 
+  class JBinarySerializeReaderMem : public JBinarySerializer
+  {
+    public:
+      JBinarySerializeReaderMem ( const jalib::string& name,
+                                  const void *data, size_t len )
+        : JBinarySerializer ( name ), _data ( (const char*) data ), _len ( len )
+      {}
+      void readOrWrite ( void* buffer, size_t len );
+      bool isReader() { return true; }
+      void rewind() { _bytes = 0; }
+      bool isempty() { return _len == 0; }
+      bool isEOF() { return _bytes == _len; }
+    private:
+      const char *_data;
+      size_t _len;
+  };
 
 }
 
@@ -268,8 +268,6 @@ ssize_t jalib::JSocket::readAll ( char* buf, size_t len )
   int origLen = len;
   while ( len > 0 )
   {
-    fd_set rfds;
-    struct timeval tv;
     int retval;
 
     int tmp_sockfd = _sockfd;
@@ -277,15 +275,13 @@ ssize_t jalib::JSocket::readAll ( char* buf, size_t len )
       return -1;
     }
 
-    /* Watch stdin (fd 0) to see when it has input. */
-    FD_ZERO ( &rfds );
-    FD_SET ( tmp_sockfd, &rfds );
-
-    tv.tv_sec = 120;
-    tv.tv_usec = 0;
-
-    retval = jalib::select ( tmp_sockfd+1, &rfds, NULL, NULL, &tv );
-    /* Don't rely on the value of tv now! */
+    /* poll() rather than select():  tmp_sockfd may be above FD_SETSIZE. */
+    struct pollfd pfd = { tmp_sockfd, POLLIN, 0 };
+    retval = jalib::poll ( &pfd, 1, 120 * 1000 );
+    if ( retval > 0 && ( pfd.revents & POLLNVAL ) != 0 ) {
+      retval = -1;
+      errno = EBADF;
+    }
 
     if ( retval == -1 )
     {
@@ -294,7 +290,7 @@ ssize_t jalib::JSocket::readAll ( char* buf, size_t len )
         return -1;
       } else if( errno != EINTR ){
         JWARNING ( retval >= 0 )
-          ( tmp_sockfd ) ( JASSERT_ERRNO ).Text ( "select() failed" );
+          ( tmp_sockfd ) ( JASSERT_ERRNO ).Text ( "poll() failed" );
         return -1;
       }
     }
@@ -331,8 +327,6 @@ ssize_t jalib::JSocket::writeAll ( const char* buf, size_t len )
   JTRACE("BAB readAll writeAll in JSocket, sockfd: ") (len);
   int origLen = len;
   while (len > 0) {
-    fd_set wfds;
-    struct timeval tv;
     int retval;
 
     int tmp_sockfd = _sockfd;
@@ -340,17 +334,13 @@ ssize_t jalib::JSocket::writeAll ( const char* buf, size_t len )
       return -1;
     }
 
-    /* Watch stdin (fd 0) to see when it has input. */
-    FD_ZERO(&wfds);
-    FD_SET(tmp_sockfd, &wfds);
-
-    /* Wait up to five seconds. */
-    tv.tv_sec = 30;
-    tv.tv_usec = 0;
-
-    retval = jalib::select(tmp_sockfd+1, NULL, &wfds, NULL, &tv);
-    /* Don't rely on the value of tv now! */
-
+    /* poll() rather than select():  tmp_sockfd may be above FD_SETSIZE. */
+    struct pollfd pfd = { tmp_sockfd, POLLOUT, 0 };
+    retval = jalib::poll(&pfd, 1, 30 * 1000);
+    if (retval > 0 && (pfd.revents & POLLNVAL) != 0) {
+      retval = -1;
+      errno = EBADF;
+    }
 
     if (retval == -1) {
       if (errno == EBADF || errno == EPIPE) {
@@ -358,7 +348,7 @@ ssize_t jalib::JSocket::writeAll ( const char* buf, size_t len )
         return -1;
       }
       JWARNING(retval >= 0) (tmp_sockfd) (JASSERT_ERRNO)
-        .Text ("select() failed");
+        .Text ("poll() failed");
       return -1;
     } else if (retval) {
       errno = 0;
@@ -578,16 +568,16 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
   timeout = timeoutEnabled ? &timeoutBuf : NULL;
 
   IntSet closedFds;
-  fd_set rfds;
-  fd_set wfds;
-  int maxFd;
+  // poll() rather than select(), so that fds above FD_SETSIZE work:  during
+  // restart, dmtcp_restart rewires the sockets of all of its processes here.
+  // The pollfds are laid out as:  listen sockets, data sockets, writes.
+  dmtcp::vector<struct pollfd> pfds;
+  size_t numListen, numData, numWrites;
   size_t i;
   for ( ;; )
   {
     closedFds.clear();
-    maxFd = -1;
-    FD_ZERO ( &rfds );
-    FD_ZERO ( &wfds );
+    pfds.clear();
 
     if( timeout == NULL && timeoutEnabled){
       timeoutBuf=timeoutInterval;
@@ -596,15 +586,10 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
       timeout = NULL;
     }
 
-    //collect listen fds in rfds, cleanup dead sockets
+    //cleanup dead listen sockets
     for ( i=0; i<_listenSockets.size(); ++i )
     {
-      if ( _listenSockets[i].isValid() )
-      {
-        FD_SET ( _listenSockets[i].sockfd(), &rfds );
-        maxFd = std::max ( maxFd,_listenSockets[i].sockfd() );
-      }
-      else
+      if ( !_listenSockets[i].isValid() )
       {
         _listenSockets[i].close();
         //socket is dead... remove it
@@ -616,15 +601,10 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
       }
     }
 
-    //collect data fds in rfds, cleanup dead sockets
+    //cleanup dead data sockets
     for ( i=0; i<_dataSockets.size(); ++i )
     {
-      if ( !_dataSockets[i]->hadError() )
-      {
-        FD_SET ( _dataSockets[i]->socket().sockfd(), &rfds );
-        maxFd = std::max ( maxFd,_dataSockets[i]->socket().sockfd() );
-      }
-      else
+      if ( _dataSockets[i]->hadError() )
       {
         closedFds.insert(_dataSockets[i]->socket().sockfd());
         //socket is dead... remove it
@@ -642,17 +622,12 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
       }
     }
 
-    //collect all writes in wfds, cleanup finished/dead
+    //cleanup finished/dead writes
     for ( i=0; i<_writes.size(); ++i )
     {
-      if (  !_writes[i]->hadError()
-         && !_writes[i]->isDone()
-         && closedFds.find(_writes[i]->socket().sockfd())==closedFds.end() )
-      {
-        FD_SET ( _writes[i]->socket().sockfd(), &wfds );
-        maxFd = std::max ( maxFd,_writes[i]->socket().sockfd() );
-      }
-      else
+      if (  _writes[i]->hadError()
+         || _writes[i]->isDone()
+         || closedFds.find(_writes[i]->socket().sockfd())!=closedFds.end() )
       {
         //socket is or write done... pop it
         delete _writes[i];
@@ -664,11 +639,30 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
       }
     }
 
-    if ( maxFd == -1 )
+    numListen = _listenSockets.size();
+    numData = _dataSockets.size();
+    numWrites = _writes.size();
+    if ( numListen + numData + numWrites == 0 )
     {
       //JTRACE ( "no sockets left" );
       return;
     }
+    pfds.resize ( numListen + numData + numWrites );
+    for ( i=0; i<numListen; ++i )
+    {
+      pfds[i].fd = _listenSockets[i].sockfd();
+      pfds[i].events = POLLIN;
+    }
+    for ( i=0; i<numData; ++i )
+    {
+      pfds[numListen+i].fd = _dataSockets[i]->socket().sockfd();
+      pfds[numListen+i].events = POLLIN;
+    }
+    for ( i=0; i<numWrites; ++i )
+    {
+      pfds[numListen+numData+i].fd = _writes[i]->socket().sockfd();
+      pfds[numListen+numData+i].events = POLLOUT;
+    }
 
     //NOTE:  The top level routine of dmtcp_coordinator calls monitorSockets(),
     //  which then waits on activity from clients connecting to the coordinator.
@@ -678,21 +672,30 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
     //  completion, they then return to monitorSockets() to wait for more
     //  work to do.  dmtcp_coordinator.cpp also describes some of this logic.
     //this will block till we have some work to do
-    int retval = jalib::select ( maxFd+1, &rfds, &wfds, NULL, timeout );
+    int timeoutMs = -1;
+    if ( timeout != NULL )
+    {
+      timeoutMs = timeout->tv_sec * 1000 + ( timeout->tv_usec + 999 ) / 1000;
+    }
+    int retval = jalib::poll ( &pfds[0], pfds.size(), timeoutMs );
 
     if ( retval == -1 )
     {
       JWARNING ( retval != -1 )
-        ( maxFd ) ( retval ) ( JASSERT_ERRNO ).Text ( "select failed" );
+        ( pfds.size() ) ( retval ) ( JASSERT_ERRNO ).Text ( "poll failed" );
       return;
     }
     else if ( retval > 0 )
     {
+      //Callbacks below may add sockets and writes (at the end of the
+      //vectors), but only the ones that were polled are looked at.
+
       //write all data
-      for ( i=0; i<_writes.size(); ++i )
+      for ( i=0; i<numWrites; ++i )
       {
         int fd = _writes[i]->socket().sockfd();
-        if ( fd >= 0 && FD_ISSET ( fd, &wfds ) )
+        if ( fd >= 0 && fd == pfds[numListen+numData+i].fd
+             && pfds[numListen+numData+i].revents != 0 )
         {
 //                    JTRACE("writing data")(_writes[i]->socket().sockfd());
           _writes[i]->writeOnce();
@@ -701,10 +704,11 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
 
 
       //read all new data
-      for ( i=0; i<_dataSockets.size(); ++i )
+      for ( i=0; i<numData; ++i )
       {
         int fd = _dataSockets[i]->socket().sockfd();
-        if ( fd >= 0 && FD_ISSET ( fd, &rfds ) )
+        if ( fd >= 0 && fd == pfds[numListen+i].fd
+             && pfds[numListen+i].revents != 0 )
         {
 //                   JTRACE("receiving data")(i)(_dataSockets[i].socket().sockfd());
           if ( _dataSockets[i]->readOnce() )
@@ -717,24 +721,36 @@ void jalib::JMultiSocketProgram::monitorSockets ( double dblTimeout )
 
 
       //accept all new connections
-      for ( i=0; i<_listenSockets.size(); ++i )
+      for ( i=0; i<numListen; ++i )
       {
         int fd = _listenSockets[i].sockfd();
-        if ( fd >= 0 && FD_ISSET ( fd, &rfds ) )
+        if ( fd >= 0 && fd == pfds[i].fd && pfds[i].revents != 0 )
         {
-          struct sockaddr_storage addr;
-          socklen_t addrlen = sizeof ( addr );
-          JSocket sk = _listenSockets[i].accept ( &addr,&addrlen );
-          JTRACE ( "accepting new connection" ) ( i ) ( sk.sockfd() )
-            ( _listenSockets[i].sockfd() ) ( JASSERT_ERRNO );
-          if ( sk.isValid() )
+          //accept all pending connections, not one per poll(): there can
+          //be thousands at once during restart
+          struct pollfd more = { fd, POLLIN, 0 };
+          do
           {
-            onConnect ( sk, ( sockaddr* ) &addr,addrlen );
-          }
-          else if ( errno != EAGAIN && errno != EINTR )
-          {
-            _listenSockets[i].close();
-          }
+            struct sockaddr_storage addr;
+            socklen_t addrlen = sizeof ( addr );
+            JSocket sk = _listenSockets[i].accept ( &addr,&addrlen );
+            JTRACE ( "accepting new connection" ) ( i ) ( sk.sockfd() )
+              ( _listenSockets[i].sockfd() ) ( JASSERT_ERRNO );
+            if ( sk.isValid() )
+            {
+              onConnect ( sk, ( sockaddr* ) &addr,addrlen );
+            }
+            else
+            {
+              if ( errno != EAGAIN && errno != EINTR )
+              {
+                _listenSockets[i].close();
+              }
+              break;
+            }
+            more.revents = 0;
+          } while ( _listenSockets[i].sockfd() == fd
+                    && jalib::poll ( &more, 1, 0 ) == 1 );
         }
       }
     }
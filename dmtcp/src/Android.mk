@@ -56,6 +56,7 @@ LOCAL_SRC_FILES := dmtcpawareapi.cpp \
         glibcsystem.cpp filewrappers.cpp \
         mallocwrappers.cpp \
         dmtcpplugin.cpp \
+        sharedfileareas.cpp \
 
 LOCAL_STATIC_LIBRARIES := libdmtcpinternal libjal libsyscallsreal
 LOCAL_SHARED_LIBRARIES := libdl libstlport libdmtcphijackhelper
@@ -27,6 +27,7 @@
 #include "syscallwrappers.h"
 #include "connectionstate.h"
 #include "ckptserializer.h"
+#include "util.h"
 
 static pid_t ext_decomp_pid = -1;
 
@@ -236,20 +237,100 @@ int dmtcp::CkptSerializer::loadFromFile(const dmtcp::string& path,
 {
   int fd = openDmtcpCheckpointFile(path);
   JASSERT(fd != -1);
-  jalib::JBinarySerializeReaderRaw rdr(path, fd);
+  int bytes;
+  // The reader gives back its read-ahead in its destructor, which needs fd.
+  {
+    jalib::JBinarySerializeReaderRaw rdr(path, fd);
+    conToFds->serialize(rdr);
+    processInfo->serialize(rdr);
+    bytes = rdr.bytes();
+  }
+  close_ckpt_to_read(fd);
+  return bytes + strlen(DMTCP_FILE_HEADER);
+}
+
+namespace
+{
+  // Reads through another serializer and keeps a copy of the bytes read.
+  class TeeReader : public jalib::JBinarySerializer
+  {
+    public:
+      TeeReader ( jalib::JBinarySerializer& in )
+        : JBinarySerializer ( in.filename() ), _in ( in ) {}
+      void readOrWrite ( void* buffer, size_t len ) {
+        _in.readOrWrite(buffer, len);
+        _copy.append((const char*) buffer, len);
+        _bytes += len;
+      }
+      bool isReader() { return true; }
+      void rewind() { _in.rewind(); _copy.clear(); _bytes = 0; }
+      bool isempty() { return _in.isempty(); }
+      const jalib::string& copy() const { return _copy; }
+    private:
+      jalib::JBinarySerializer& _in;
+      jalib::string _copy;
+  };
+}
+
+// Reads the DMTCP header of the checkpoint image at 'path' (decompressing it
+// if needed) and writes a copy of it to outFd, for loadFromHeaderCopy().
+// This does all of the slow part of loadFromFile(), and is safe to run in a
+// forked child, so that dmtcp_restart can read several images in parallel.
+void dmtcp::CkptSerializer::copyHeader(const dmtcp::string& path, int outFd)
+{
+  ConnectionToFds conToFds;
+  ProcessInfo processInfo;
+  int fd = openDmtcpCheckpointFile(path);
+  JASSERT(fd != -1);
+  // As in loadFromFile(), the reader must be gone before fd is closed.
+  {
+    jalib::JBinarySerializeReaderRaw rdr(path, fd);
+    TeeReader tee(rdr);
+    conToFds.serialize(tee);
+    processInfo.serialize(tee);
+
+    int offset = rdr.bytes() + strlen(DMTCP_FILE_HEADER);
+    size_t len = tee.copy().length();
+    JASSERT(Util::writeAll(outFd, &offset, sizeof(offset)) == sizeof(offset) &&
+            Util::writeAll(outFd, &len, sizeof(len)) == sizeof(len) &&
+            Util::writeAll(outFd, tee.copy().data(), len) == (ssize_t) len)
+      (path) (JASSERT_ERRNO);
+  }
+  close_ckpt_to_read(fd);
+}
+
+// Same as loadFromFile(), from the copy of the header that copyHeader()
+// wrote to fd.
+int dmtcp::CkptSerializer::loadFromHeaderCopy(const dmtcp::string& path,
+                                              int fd,
+                                              dmtcp::ConnectionToFds *conToFds,
+                                              dmtcp::ProcessInfo *processInfo)
+{
+  int offset;
+  size_t len;
+  JASSERT(lseek(fd, 0, SEEK_SET) == 0) (path) (JASSERT_ERRNO);
+  JASSERT(Util::readAll(fd, &offset, sizeof(offset)) == sizeof(offset) &&
+          Util::readAll(fd, &len, sizeof(len)) == sizeof(len) && len > 0)
+    (path) .Text("Truncated copy of checkpoint header");
+
+  char *buf = (char*) JALLOC_HELPER_MALLOC(len);
+  JASSERT(Util::readAll(fd, buf, len) == (ssize_t) len) (path) (len)
+    .Text("Truncated copy of checkpoint header");
+  jalib::JBinarySerializeReaderMem rdr(path, buf, len);
   conToFds->serialize(rdr);
   processInfo->serialize(rdr);
-  close_ckpt_to_read(fd);
-  return rdr.bytes() + strlen(DMTCP_FILE_HEADER);
+  JASSERT(rdr.isEOF()) (path) (rdr.bytes()) (len);
+  JALLOC_HELPER_FREE(buf);
+  return offset;
 }
 
 void dmtcp::CkptSerializer::writeCkptPrefix(int fd,
                                             dmtcp::ConnectionState *state)
 {
-  const int len = strlen(DMTCP_FILE_HEADER);
-  JASSERT(write(fd, DMTCP_FILE_HEADER, len)==len);
-
+  // The magic string and the tables go out through the same buffer, in as
+  // few write()s as possible.
   jalib::JBinarySerializeWriterRaw wr ( "mtcp-file-prefix", fd );
+  wr.readOrWrite((void*) DMTCP_FILE_HEADER, strlen(DMTCP_FILE_HEADER));
 
   state->outputDmtcpConnectionTable(wr);
   ProcessInfo::instance().serialize(wr);
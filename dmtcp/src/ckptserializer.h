@@ -50,6 +50,10 @@ namespace dmtcp
       static int loadFromFile(const dmtcp::string& filename,
                               ConnectionToFds *conToFds,
                               ProcessInfo *processInfo);
+      static void copyHeader(const dmtcp::string& filename, int outFd);
+      static int loadFromHeaderCopy(const dmtcp::string& filename, int fd,
+                                    ConnectionToFds *conToFds,
+                                    ProcessInfo *processInfo);
       static void writeCkptPrefix(int fd, dmtcp::ConnectionState *state);
   };
 }
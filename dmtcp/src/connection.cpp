@@ -35,6 +35,8 @@
 #include "resource_manager.h"
 #include  "../jalib/jsocket.h"
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <sys/select.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -1378,8 +1380,224 @@ static void CreateDirectoryStructure(const dmtcp::string& path)
 
 static void CopyFile(const dmtcp::string& src, const dmtcp::string& dest)
 {
-  dmtcp::string command = "cp -f " + src + " " + dest;
-  JASSERT(_real_system(command.c_str()) != -1);
+  struct stat st;
+  int srcFd = _real_open(src.c_str(), O_RDONLY, 0);
+  JASSERT(srcFd != -1) (src) (JASSERT_ERRNO) .Text("open() failed");
+  JASSERT(fstat(srcFd, &st) != -1) (src) (JASSERT_ERRNO);
+
+  int destFd = _real_open(dest.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+                          st.st_mode & 07777);
+  JASSERT(destFd != -1) (dest) (JASSERT_ERRNO) .Text("open() failed");
+
+  JASSERT(dmtcp::Util::copyFileData(srcFd, destFd, st.st_size) == 0)
+    (src) (dest) (JASSERT_ERRNO) .Text("Copying file failed");
+  _real_close(destFd);
+  _real_close(srcFd);
+}
+
+/*
+ * Open files saved at checkpoint time (--checkpoint-open-files, deleted
+ * files, etc.) are copied by up to DMTCP_CKPT_OPEN_FILES_JOBS helper
+ * processes, so that several large files are copied concurrently and while
+ * the KernelBufferDrainer is still draining the sockets.  The helpers are
+ * created with a raw clone() without CLONE_VM and without an exit signal:
+ *   - they get a private copy of our memory (so the job below is readable),
+ *     but no user atfork handlers are run and no SIGCHLD is ever sent to the
+ *     user process;
+ *   - they restrict themselves to _real_XXX calls (no JASSERT, no JALLOC);
+ *   - the result is passed back through a small MAP_SHARED page.
+ * FileConnection::waitForSavedFileCopies() reaps all of them.
+ */
+namespace
+{
+  struct SavedFileCopyResult
+  {
+    int      status;     // 0 on success, errno otherwise
+    bool     reused;     // previous copy was found unchanged and reused
+    bool     hashValid;  // hash below was computed
+    uint64_t hash;       // of the saved copy
+  };
+
+  struct SavedFileCopyJob
+  {
+    dmtcp::FileConnection *con;
+    dmtcp::string srcPath;  // empty: copy from srcFd
+    int           srcFd;
+    off_t         size;
+    mode_t        mode;
+    dmtcp::string destPath;
+    dmtcp::string prevPath; // empty: no candidate for reuse
+    bool          prevHashValid; // false: not computed yet
+    uint64_t      prevHash;
+    pid_t         helper;
+    SavedFileCopyResult *result;
+  };
+
+  static dmtcp::vector<SavedFileCopyJob>& savedFileCopyJobs()
+  {
+    static dmtcp::vector<SavedFileCopyJob> *jobs = NULL;
+    if (jobs == NULL) {
+      jobs = new dmtcp::vector<SavedFileCopyJob>();
+    }
+    return *jobs;
+  }
+
+  static size_t savedFileCopyMaxJobs()
+  {
+    const char *str = getenv(ENV_VAR_CKPT_OPEN_FILES_JOBS);
+    int n = str == NULL ? DEFAULT_CKPT_OPEN_FILES_JOBS : atoi(str);
+    return n < 0 ? 0 : n;
+  }
+}
+
+static void runSavedFileCopyJob(const SavedFileCopyJob& job,
+                                SavedFileCopyResult *result)
+{
+  int srcFd = job.srcFd;
+  result->status = 0;
+  result->reused = false;
+  result->hashValid = false;
+  result->hash = 0;
+
+  if (!job.srcPath.empty()) {
+    srcFd = _real_open(job.srcPath.c_str(), O_RDONLY, 0);
+    if (srcFd == -1) {
+      result->status = errno;
+      return;
+    }
+  }
+
+  // Size and mtime match the copy saved at the previous checkpoint; compare
+  // the contents before deciding to skip the copy.  Files are only hashed
+  // here: the hash of the previous copy is computed the first time it is
+  // needed, and kept for later checkpoints.  A file that is copied is not
+  // read a second time.
+  if (!job.prevPath.empty()) {
+    bool prevHashValid = job.prevHashValid;
+    uint64_t prevHash = job.prevHash;
+    if (!prevHashValid) {
+      int prevFd = _real_open(job.prevPath.c_str(), O_RDONLY, 0);
+      if (prevFd != -1) {
+        prevHashValid =
+          dmtcp::Util::hashFileData(prevFd, job.size, &prevHash) == 0;
+        _real_close(prevFd);
+      }
+    }
+    uint64_t hash;
+    if (prevHashValid &&
+        dmtcp::Util::hashFileData(srcFd, job.size, &hash) == 0 &&
+        hash == prevHash) {
+      if (job.prevPath == job.destPath) {
+        result->reused = true;
+      } else {
+        unlink(job.destPath.c_str());
+        result->reused = link(job.prevPath.c_str(), job.destPath.c_str()) == 0;
+      }
+      if (result->reused) {
+        result->hashValid = true;
+        result->hash = hash;
+      }
+    }
+  }
+
+  if (!result->reused) {
+    // destPath may be a hard link to the copy kept for an older checkpoint
+    // (see above); writing through it would truncate that copy as well.
+    unlink(job.destPath.c_str());
+    int destFd = _real_open(job.destPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+                            job.mode);
+    if (destFd == -1 ||
+        dmtcp::Util::copyFileData(srcFd, destFd, job.size) == -1) {
+      result->status = errno;
+    }
+    if (destFd != -1) {
+      _real_close(destFd);
+    }
+  }
+
+  if (!job.srcPath.empty()) {
+    _real_close(srcFd);
+  }
+}
+
+static void finishSavedFileCopyJob(SavedFileCopyJob& job)
+{
+  if (job.helper > 0) {
+    int status;
+    pid_t rc;
+    do {
+      rc = _real_syscall(SYS_wait4, job.helper, &status, __WCLONE, NULL);
+    } while (rc == -1 && errno == EINTR);
+    JASSERT(rc == job.helper) (job.helper) (JASSERT_ERRNO);
+  }
+  errno = job.result->status;
+  JASSERT(job.result->status == 0) (job.srcPath) (job.destPath) (JASSERT_ERRNO)
+    .Text("Failed to save the checkpointed copy of the file");
+  JTRACE("Saved checkpointed copy of the file")
+    (job.destPath) (job.size) (job.result->reused);
+
+  job.con->savedFileCopyDone(job.destPath, job.result->hashValid,
+                             job.result->hash);
+  _real_munmap(job.result, sizeof(SavedFileCopyResult));
+  job.result = NULL;
+}
+
+static void startSavedFileCopyJob(SavedFileCopyJob& job)
+{
+  dmtcp::vector<SavedFileCopyJob>& jobs = savedFileCopyJobs();
+  size_t maxJobs = savedFileCopyMaxJobs();
+
+  job.helper = -1;
+  job.result = (SavedFileCopyResult*) _real_mmap(NULL,
+                                                 sizeof(SavedFileCopyResult),
+                                                 PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_ANONYMOUS,
+                                                 -1, 0);
+  JASSERT(job.result != MAP_FAILED) (JASSERT_ERRNO);
+
+  if (maxJobs == 0) {
+    runSavedFileCopyJob(job, job.result);
+    finishSavedFileCopyJob(job);
+    return;
+  }
+
+  // Throttle: wait for the oldest outstanding helper.
+  if (jobs.size() >= maxJobs) {
+    finishSavedFileCopyJob(jobs.front());
+    jobs.erase(jobs.begin());
+  }
+
+  job.helper = _real_syscall(SYS_clone, 0, NULL, NULL, NULL, NULL);
+  if (job.helper == 0) {
+    runSavedFileCopyJob(job, job.result);
+    _real_syscall(SYS_exit, 0);
+  } else if (job.helper == -1) {
+    JTRACE("Unable to start helper process; copying file inline")
+      (job.destPath) (JASSERT_ERRNO);
+    runSavedFileCopyJob(job, job.result);
+    finishSavedFileCopyJob(job);
+    return;
+  }
+  jobs.push_back(job);
+}
+
+void dmtcp::FileConnection::waitForSavedFileCopies()
+{
+  dmtcp::vector<SavedFileCopyJob>& jobs = savedFileCopyJobs();
+  for (size_t i = 0; i < jobs.size(); i++) {
+    finishSavedFileCopyJob(jobs[i]);
+  }
+  jobs.clear();
+}
+
+void dmtcp::FileConnection::savedFileCopyDone(const dmtcp::string& savedFilePath,
+                                              bool hashValid, uint64_t hash)
+{
+  _savedFilePath = savedFilePath;
+  _savedFileSize = _stat.st_size;
+  _savedFileMtime = _stat.st_mtime;
+  _savedFileHashValid = hashValid;
+  _savedFileHash = hash;
 }
 
 static void CatFile(const dmtcp::string& src, const dmtcp::string& dest)
@@ -1470,36 +1688,34 @@ void dmtcp::FileConnection::saveFile(int fd)
   CreateDirectoryStructure(savedFilePath);
   JTRACE("Saving checkpointed copy of the file") (_path) (savedFilePath);
 
+  SavedFileCopyJob job;
+  job.con = this;
+  job.srcFd = fd;
+  job.size = _stat.st_size;
+  job.mode = (_stat.st_mode & 07777) | S_IRUSR | S_IWUSR;
+  job.destPath = savedFilePath;
+  job.prevHashValid = _savedFileHashValid;
+  job.prevHash = _savedFileHash;
+
   if (_type == FILE_REGULAR ||
     jalib::Filesystem::FileExists(_path)) {
-    CopyFile(_path, savedFilePath);
-    return;
-  } else if (_type == FileConnection::FILE_DELETED) {
-    long page_size = sysconf(_SC_PAGESIZE);
-    const size_t bufSize = 2 * page_size;
-    char *buf = (char*)JALLOC_HELPER_MALLOC(bufSize);
-
-    int destFd = open(savedFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
-                                             S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    JASSERT(destFd != -1) (_path) (savedFilePath) .Text("Read Failed");
-
-    lseek(fd, 0, SEEK_SET);
-
-    int readBytes, writtenBytes;
-    while(1) {
-      readBytes = Util::readAll(fd, buf, bufSize);
-      JASSERT(readBytes != -1)
-        (_path) (JASSERT_ERRNO) .Text("Read Failed");
-      if (readBytes == 0) break;
-      writtenBytes = Util::writeAll(destFd, buf, readBytes);
-      JASSERT(writtenBytes != -1)
-        (savedFilePath) (JASSERT_ERRNO) .Text("Write failed.");
-    }
+    // The fd may have been opened write-only; read through the path instead.
+    job.srcPath = _path;
+  } else {
+    JASSERT(_type == FileConnection::FILE_DELETED) (_path) (_type);
+  }
 
-    close(destFd);
-    JALLOC_HELPER_FREE(buf);
+  // Skip the copy if the file looks unchanged since the previous checkpoint;
+  // the helper confirms it by comparing the content hash.
+  if (!_savedFilePath.empty() &&
+      _savedFileSize == _stat.st_size &&
+      _savedFileMtime == _stat.st_mtime &&
+      jalib::Filesystem::FileExists(_savedFilePath)) {
+    job.prevPath = _savedFilePath;
   }
 
+  startSavedFileCopyJob(job);
+
   JASSERT( lseek(fd, _offset, SEEK_SET) != -1 ) (_path);
 }
 
@@ -1798,6 +2014,8 @@ void dmtcp::FileConnection::serializeSubClass ( jalib::JBinarySerializer& o )
   JSERIALIZE_ASSERT_POINT ( "dmtcp::FileConnection" );
   o & _path & _rel_path & _ckptFilesDir;
   o & _offset & _stat & _checkpointed & _rmtype;
+  o & _savedFilePath & _savedFileSize & _savedFileMtime;
+  o & _savedFileHashValid & _savedFileHash;
   JTRACE("Serializing FileConn.") (_path) (_rel_path) (_ckptFilesDir)
     (_checkpointed) (_fcntlFlags) (_restoreInSecondIteration);
 }
@@ -29,6 +29,7 @@
 #include "dmtcpalloc.h"
 #include "connectionidentifier.h"
 #include <vector>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <signal.h>
@@ -431,6 +432,10 @@ namespace dmtcp
           : Connection ( FILE )
           , _path ( path )
           , _offset ( offset )
+          , _savedFileSize ( -1 )
+          , _savedFileMtime ( 0 )
+          , _savedFileHashValid ( false )
+          , _savedFileHash ( 0 )
       {
         _type = type;
         if( _type == FILE_RESMGR )
@@ -464,6 +469,10 @@ namespace dmtcp
 
       int fileType() { return _type; }
 
+      void savedFileCopyDone(const dmtcp::string& savedFilePath,
+                             bool hashValid, uint64_t hash);
+      static void waitForSavedFileCopies();
+
     private:
       void saveFile (int fd);
       int  openFile ();
@@ -482,6 +491,13 @@ namespace dmtcp
       off_t       _offset;
       struct stat _stat;
       ResMgrFileType _rmtype;
+      // Copy written by saveFile() at the last checkpoint; reused (hard
+      // linked) if the file is unchanged at the next checkpoint.
+      dmtcp::string _savedFilePath;
+      off_t       _savedFileSize;
+      time_t      _savedFileMtime;
+      bool        _savedFileHashValid;
+      uint64_t    _savedFileHash;
   };
 
   class FifoConnection : public Connection
@@ -103,6 +103,7 @@ void dmtcp::ConnectionToFds::erase ( const ConnectionIdentifier& conId )
 
 dmtcp::Connection *dmtcp::KernelDeviceToConnection::retrieveP ( int fd )
 {
+  ConnectionList::instance().scanForPreExisting();
   JTRACE ( "BAB: retrieveP fd value:" ) ( fd );
   dmtcp::string device = fdToDevice ( fd );
   if ( device.length() <= 0 ) return NULL;
@@ -123,6 +124,7 @@ dmtcp::Connection *dmtcp::KernelDeviceToConnection::retrieveP ( int fd )
 
 dmtcp::Connection& dmtcp::KernelDeviceToConnection::retrieve ( int fd )
 {
+  ConnectionList::instance().scanForPreExisting();
   JTRACE ( "BAB: KernelDeviceToConnection::create fd value:" ) ( fd );
   dmtcp::string device = fdToDevice ( fd );
   JASSERT ( device.length() > 0 ) ( fd ).Text ( "invalid fd" );
@@ -729,16 +731,51 @@ void dmtcp::ConnectionList::serialize ( jalib::JBinarySerializer& o )
   JSERIALIZE_ASSERT_POINT ( "EndConnectionList" );
 }
 
-//examine /proc/self/fd for unknown connections
-void dmtcp::ConnectionList::scanForPreExisting()
+// Held by scanForPreExisting() until every pre-existing connection has been
+// created; a lookup on another thread must not see a partial table.
+static pthread_mutex_t preExistingLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool preExistingScanned = true;
+
+/* Examining each fd in /proc/self/fd is the expensive part of startup, and
+ * most processes never checkpoint, fork or exec.  So only the fd numbers are
+ * recorded here.
+ */
+void dmtcp::ConnectionList::notePreExisting()
 {
   dmtcp::vector<int> fds = jalib::Filesystem::ListOpenFds();
   for ( size_t i=0; i<fds.size(); ++i )
   {
-    if ( _isBadFd ( fds[i] ) ) continue;
     if ( ProtectedFDs::isProtected ( fds[i] ) ) continue;
-    KernelDeviceToConnection::instance().handlePreExistingFd ( fds[i] );
+    _preExistingFds.push_back ( fds[i] );
+  }
+  preExistingScanned = _preExistingFds.empty();
+}
+
+/* Called before any lookup by fd, and before the table is checkpointed or
+ * handed to a child or an exec()'d program; so from any thread.  An fd that
+ * was closed since startup is skipped; one that was reopened through our
+ * wrappers is already in the table and handlePreExistingFd() leaves it alone.
+ */
+void dmtcp::ConnectionList::scanForPreExisting()
+{
+  if ( preExistingScanned ) return;
+
+  JASSERT(_real_pthread_mutex_lock(&preExistingLock) == 0) (JASSERT_ERRNO);
+  if ( !preExistingScanned ) {
+    JTRACE ( "Checking for pre-existing sockets" ) ( _preExistingFds.size() );
+    for ( size_t i=0; i<_preExistingFds.size(); ++i )
+    {
+      int fd = _preExistingFds[i];
+      if ( fcntl ( fd, F_GETFD ) == -1 ) continue;
+      if ( _isBadFd ( fd ) ) continue;
+      KernelDeviceToConnection::instance().handlePreExistingFd ( fd );
+    }
+    _preExistingFds.clear();
+    // The table must be complete before another thread skips the lock.
+    __sync_synchronize();
+    preExistingScanned = true;
   }
+  JASSERT(_real_pthread_mutex_unlock(&preExistingLock) == 0) (JASSERT_ERRNO);
 }
 
 void dmtcp::KernelDeviceToConnection::handlePreExistingFd ( int fd )
@@ -821,6 +858,7 @@ void dmtcp::KernelDeviceToConnection::handlePreExistingFd ( int fd )
 
 void dmtcp::KernelDeviceToConnection::prepareForFork ( )
 {
+  ConnectionList::instance().scanForPreExisting();
   dmtcp::vector<int> fds = jalib::Filesystem::ListOpenFds();
   JTRACE("Scanning /proc/self/fd for new connections. New connections will be created");
   for ( size_t i=0; i<fds.size(); ++i )
@@ -845,6 +883,9 @@ void dmtcp::ConnectionToFds::serialize ( jalib::JBinarySerializer& o )
 
 void dmtcp::KernelDeviceToConnection::serialize ( jalib::JBinarySerializer& o )
 {
+  if ( o.isWriter() ) {
+    ConnectionList::instance().scanForPreExisting();
+  }
   JSERIALIZE_ASSERT_POINT ( "dmtcp-serialized-exec-lifeboat!v0.07" );
   ConnectionIdentifier::serialize(o);
   ConnectionList::instance().serialize ( o );
@@ -58,13 +58,17 @@ namespace dmtcp
 
       void serialize ( jalib::JBinarySerializer& o );
 
-      //examine /proc/self/fd for unknown connections
+      //remember the fds open at startup; connections for them are created
+      //by scanForPreExisting(), the first time the table is needed
+      void notePreExisting();
+      //create connections for the fds given to notePreExisting()
       void scanForPreExisting();
     protected:
       void add ( Connection* c );
     private:
       typedef  dmtcp::map<ConnectionIdentifier, Connection*> ConnectionMapT;
       ConnectionMapT _connections;
+      dmtcp::vector<int> _preExistingFds;
   };
 
 
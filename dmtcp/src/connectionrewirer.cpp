@@ -19,18 +19,82 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <fcntl.h>
 #include "connectionrewirer.h"
 #include "dmtcpmessagetypes.h"
 #include "syscallwrappers.h"
 
-
+/* The reconnections of a restart proceed in parallel:  outgoing connections
+ * use non-blocking connect()s, up to MAX_CONNECTS_IN_FLIGHT at a time so as
+ * not to overflow the accept queue of the peer's restore listener, and the
+ * sockets accepted on the restore listener are read by the same event loop as
+ * the coordinator socket.  Incoming connections are announced to the
+ * coordinator in a single DMT_RESTORE_WAITING message, with the list of their
+ * ids in extraBytes.
+ */
+static const size_t MAX_CONNECTS_IN_FLIGHT = 128;
+
+namespace
+{
+  // Sends DMT_RESTORE_RECONNECTED on an outgoing connection once its
+  // non-blocking connect() has completed, and then gives the socket back the
+  // file status flags that it had before.
+  class ReconnectWriter : public jalib::JChunkWriter
+  {
+    public:
+      ReconnectWriter ( dmtcp::ConnectionRewirer& rewirer,
+                        jalib::JSocket sock, const char* buf, int len,
+                        int flags, const dmtcp::ConnectionIdentifier& id )
+        : jalib::JChunkWriter ( sock, buf, len )
+        , _rewirer ( rewirer )
+        , _flags ( flags )
+        , _id ( id )
+        , _connected ( false ) {}
+
+      bool writeOnce()
+      {
+        int fd = _sock.sockfd();
+        if ( !_connected )
+        {
+          int err = 0;
+          socklen_t errlen = sizeof ( err );
+          JASSERT ( getsockopt ( fd, SOL_SOCKET, SO_ERROR, &err, &errlen ) == 0 )
+            ( _id ) ( fd ) ( JASSERT_ERRNO );
+          JASSERT ( err == 0 ) ( _id ) ( fd ) ( strerror ( err ) )
+            .Text ( "failed to restore connection" );
+          _connected = true;
+        }
+        bool done = jalib::JChunkWriter::writeOnce();
+        if ( done )
+        {
+          JASSERT ( fcntl ( fd, F_SETFL, _flags ) == 0 ) ( _id ) ( fd )
+            ( JASSERT_ERRNO );
+          _rewirer.onConnectDone();
+        }
+        return done;
+      }
+
+    private:
+      dmtcp::ConnectionRewirer& _rewirer;
+      int _flags;
+      dmtcp::ConnectionIdentifier _id;
+      bool _connected;
+  };
+}
 
 void dmtcp::ConnectionRewirer::onData ( jalib::JReaderInterface* sock )
 {
-  JASSERT ( sock->bytesRead() == sizeof ( DmtcpMessage ) ) ( sock->bytesRead() ) ( sizeof ( DmtcpMessage ) );
-  DmtcpMessage& msg = * ( DmtcpMessage* ) sock->buffer();
+  JASSERT ( sock->bytesRead() == sizeof ( DmtcpMessageHeader ) ) ( sock->bytesRead() ) ( sizeof ( DmtcpMessageHeader ) );
+  DmtcpMessage msg;
+  msg.decode ( * ( const DmtcpMessageHeader* ) sock->buffer(), sock->socket() );
   msg.assertValid();
 
+  if ( msg.type == DMT_RESTORE_RECONNECTED )
+  {
+    onReconnected ( sock, msg );
+    return;
+  }
+
   if ( msg.type == DMT_FORCE_RESTART )
   {
     JTRACE ( "got DMT_FORCE_RESTART, exiting ConnectionRewirer" ) ( _pendingOutgoing.size() ) ( _pendingIncoming.size() );
@@ -41,62 +105,95 @@ void dmtcp::ConnectionRewirer::onData ( jalib::JReaderInterface* sock )
   }
 
   JASSERT ( msg.type==DMT_RESTORE_WAITING ) ( msg.type ).Text ( "unexpected message" );
+  size_t count = msg.params[0];
+  JASSERT ( count > 0 && msg.extraBytes == count * sizeof ( ConnectionIdentifier ) )
+    ( count ) ( msg.extraBytes );
+  dmtcp::vector<ConnectionIdentifier> ids ( count );
+  JASSERT ( sock->socket().readAll ( ( char* ) &ids[0], msg.extraBytes )
+            == ( ssize_t ) msg.extraBytes ) ( msg.extraBytes );
 
-  // Find returns iterator 'i' w/ 0 or more elts, with first elt matching key.
-  iterator i = _pendingOutgoing.find ( msg.restorePid );
+  JTRACE ( "got RESTORE_WAITING MESSAGE" )
+    ( count ) ( msg.restorePort ) ( _pendingOutgoing.size() ) ( _pendingIncoming.size() );
 
-  if ( i == _pendingOutgoing.end() )
+  for ( size_t n = 0; n < count; ++n )
   {
-    // 'i' is an iterator over 0 elements.
-    JTRACE ( "got RESTORE_WAITING MESSAGE [not used]" ) ( msg.restorePid ) ( _pendingOutgoing.size() ) ( _pendingIncoming.size() );
+    iterator i = _pendingOutgoing.find ( ids[n] );
+    if ( i == _pendingOutgoing.end() ) continue;
+
+    JASSERT ( i->second.size() > 0 );
+    OutgoingConnect c;
+    c.id = ids[n];
+    c.fds = i->second;
+    c.addr = msg.restoreAddr;
+    c.addrlen = msg.restoreAddrlen;
+    c.port = msg.restorePort;
+    _connectQueue.push_back ( c );
+    _pendingOutgoing.erase ( i );
   }
-  else
+  startConnects();
+
+  if ( pendingCount() ==0 ) finishup();
+#ifdef DEBUG
+  else debugPrint();
+#endif
+}
+
+void dmtcp::ConnectionRewirer::startConnects()
+{
+  for ( ; _nextConnect < _connectQueue.size()
+          && _connectsInFlight < MAX_CONNECTS_IN_FLIGHT; ++_nextConnect )
   {
-    // 'i' is an iterator over 1 element.
-    JTRACE ( "got RESTORE_WAITING MESSAGE, reconnecting..." )
-    ( msg.restorePid ) ( msg.restorePort ) ( msg.restoreAddrlen ) ( _pendingOutgoing.size() ) ( _pendingIncoming.size() );
-    const dmtcp::vector<int>& fds = i->second;
-    JASSERT ( fds.size() > 0 );
-    int fd0 = fds[0];
+    const OutgoingConnect& c = _connectQueue[_nextConnect];
+    int fd0 = c.fds[0];
+    JTRACE ( "reconnecting..." ) ( c.id ) ( c.port ) ( fd0 );
 
     jalib::JSocket remote = jalib::JSocket::Create();
     remote.changeFd ( fd0 );
+    int flags = fcntl ( fd0, F_GETFL );
+    JASSERT ( flags != -1 && fcntl ( fd0, F_SETFL, flags | O_NONBLOCK ) == 0 )
+      ( fd0 ) ( JASSERT_ERRNO );
     errno = 0;
-    JASSERT ( remote.connect ( ( sockaddr* ) &msg.restoreAddr,msg.restoreAddrlen,msg.restorePort ) )
-    ( msg.restorePid ) ( msg.restorePort ) ( JASSERT_ERRNO )
+    JASSERT ( remote.connect ( ( sockaddr* ) &c.addr, c.addrlen, c.port )
+              || errno == EINPROGRESS )
+    ( c.id ) ( c.port ) ( JASSERT_ERRNO )
     .Text ( "failed to restore connection" );
 
     {
       DmtcpMessage peerMsg;
       peerMsg.type = DMT_RESTORE_RECONNECTED;
-      peerMsg.restorePid = msg.restorePid;
-      addWrite ( new jalib::JChunkWriter ( remote, ( char* ) &peerMsg,sizeof ( peerMsg ) ) );
+      peerMsg.restorePid = c.id;
+      char buf[DMTCPMESSAGE_MAX_WIRE_SIZE];
+      addWrite ( new ReconnectWriter ( *this, remote, buf,
+                                       peerMsg.encode ( buf ), flags, c.id ) );
     }
+    _connectsInFlight++;
 
-    for ( size_t n = 1; n<fds.size(); ++n )
+    for ( size_t x = 1; x<c.fds.size(); ++x )
     {
-      JTRACE ( "restoring extra fd" ) ( fd0 ) ( fds[n] );
-      JASSERT ( _real_dup2 ( fd0,fds[n] ) == fds[n] ) ( fd0 ) ( fds[n] ) ( msg.restorePid )
+      JTRACE ( "restoring extra fd" ) ( fd0 ) ( c.fds[x] );
+      JASSERT ( _real_dup2 ( fd0,c.fds[x] ) == c.fds[x] ) ( fd0 ) ( c.fds[x] ) ( c.id )
       .Text ( "dup2() failed" );
     }
-    _pendingOutgoing.erase ( i );
   }
+}
 
-  if ( pendingCount() ==0 ) finishup();
-#ifdef DEBUG
-  else debugPrint();
-#endif
+void dmtcp::ConnectionRewirer::onConnectDone()
+{
+  JASSERT ( _connectsInFlight > 0 );
+  _connectsInFlight--;
+  startConnects();
 }
 
 void dmtcp::ConnectionRewirer::onConnect ( const jalib::JSocket& sock,  const struct sockaddr* /*remoteAddr*/,socklen_t /*remoteLen*/ )
 {
-  jalib::JSocket remote = sock;
-  DmtcpMessage msg;
-  msg.poison();
-  remote >> msg;
-  msg.assertValid();
-  JASSERT ( msg.type == DMT_RESTORE_RECONNECTED ) ( msg.type ).Text ( "unexpected message" );
+  // The peer identifies the connection with DMT_RESTORE_RECONNECTED; see
+  // onReconnected().
+  addDataSocket ( new jalib::JChunkReader ( sock, sizeof ( DmtcpMessageHeader ) ) );
+}
 
+void dmtcp::ConnectionRewirer::onReconnected ( jalib::JReaderInterface* sock,
+                                               const DmtcpMessage& msg )
+{
   iterator i = _pendingIncoming.find ( msg.restorePid );
 
   JASSERT ( i != _pendingIncoming.end() ) ( msg.restorePid )
@@ -106,7 +203,10 @@ void dmtcp::ConnectionRewirer::onConnect ( const jalib::JSocket& sock,  const st
   JASSERT ( fds.size() > 0 );
   int fd0 = fds[0];
 
+  jalib::JSocket remote = sock->socket();
   remote.changeFd ( fd0 );
+  // The connection now lives on fd0; stop monitoring it.
+  sock->socket() = -1;
 
   JTRACE ( "restoring incoming connection" ) ( msg.restorePid ) ( fd0 ) ( fds.size() );
 
@@ -129,7 +229,6 @@ void dmtcp::ConnectionRewirer::onConnect ( const jalib::JSocket& sock,  const st
 void dmtcp::ConnectionRewirer::finishup()
 {
   JTRACE ( "finishup begin" ) ( _listenSockets.size() ) ( _dataSockets.size() );
-  //i expect both sizes above to be 1
   //close the restoreSocket
   for ( size_t i=0; i<_listenSockets.size(); ++i )
     _listenSockets[i].close();
@@ -139,7 +238,6 @@ void dmtcp::ConnectionRewirer::finishup()
 
 //     JTRACE("finishup end");
 }
-
 void dmtcp::ConnectionRewirer::onDisconnect ( jalib::JReaderInterface* sock )
 {
   JASSERT ( sock->socket().sockfd() < 0 )
@@ -159,21 +257,35 @@ void dmtcp::ConnectionRewirer::setCoordinatorFd ( const int& theValue )
 
 void dmtcp::ConnectionRewirer::doReconnect()
 {
+  if ( _pendingIncoming.size() > 0 ) announceIncoming();
   if ( pendingCount() > 0 ) monitorSockets();
 }
 
 void dmtcp::ConnectionRewirer::registerIncoming ( const ConnectionIdentifier& local
         , const dmtcp::vector<int>& fds )
 {
+  JTRACE ( "pending incoming" ) ( local );
   _pendingIncoming[local] = fds;
+}
 
-  JTRACE ( "announcing pending incoming" ) ( local );
+void dmtcp::ConnectionRewirer::announceIncoming()
+{
   DmtcpMessage msg;
   msg.type = DMT_RESTORE_WAITING;
-  msg.restorePid = local;
+  msg.params[0] = _pendingIncoming.size();
+  msg.extraBytes = _pendingIncoming.size() * sizeof ( ConnectionIdentifier );
+  JTRACE ( "announcing pending incoming" ) ( msg.params[0] );
+
+  dmtcp::vector<char> buf ( DMTCPMESSAGE_MAX_WIRE_SIZE + msg.extraBytes );
+  size_t len = msg.encode ( &buf[0] );
+  for ( const_iterator i = _pendingIncoming.begin(); i!=_pendingIncoming.end(); ++i )
+  {
+    memcpy ( &buf[len], &i->first, sizeof ( ConnectionIdentifier ) );
+    len += sizeof ( ConnectionIdentifier );
+  }
 
   JASSERT ( _coordinatorFd > 0 );
-  addWrite ( new jalib::JChunkWriter ( _coordinatorFd , ( char* ) &msg, sizeof ( DmtcpMessage ) ) );
+  addWrite ( new jalib::JChunkWriter ( _coordinatorFd , &buf[0], len ) );
 }
 
 void dmtcp::ConnectionRewirer::registerOutgoing ( const ConnectionIdentifier& remote
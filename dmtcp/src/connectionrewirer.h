@@ -25,6 +25,7 @@
 #include "dmtcpalloc.h"
 #include  "../jalib/jsocket.h"
 #include "connectionidentifier.h"
+#include "dmtcpmessagetypes.h"
 #include <map>
 #include <set>
 #include <vector>
@@ -35,7 +36,8 @@ namespace dmtcp
   class ConnectionRewirer : public jalib::JMultiSocketProgram
   {
     public:
-      ConnectionRewirer() : _coordinatorFd ( -1 ) {}
+      ConnectionRewirer() : _coordinatorFd ( -1 ), _nextConnect ( 0 ),
+                            _connectsInFlight ( 0 ) {}
 
       void setCoordinatorFd ( const int& theValue );
       int coordinatorFd() const;
@@ -48,6 +50,9 @@ namespace dmtcp
       void registerOutgoing ( const ConnectionIdentifier& remote
                               , const dmtcp::vector<int>& fds );
 
+      // An outgoing connection has been restored; start the next one.
+      void onConnectDone();
+
 
     protected:
 
@@ -57,6 +62,13 @@ namespace dmtcp
 
       virtual void onDisconnect ( jalib::JReaderInterface* sock );
 
+      void onReconnected ( jalib::JReaderInterface* sock,
+                           const DmtcpMessage& msg );
+
+      void announceIncoming();
+
+      void startConnects();
+
       void finishup();
 
       size_t pendingCount() const { return _pendingIncoming.size() + _pendingOutgoing.size(); }
@@ -64,7 +76,19 @@ namespace dmtcp
       void debugPrint() const;
 
     private:
+      struct OutgoingConnect
+      {
+        ConnectionIdentifier id;
+        dmtcp::vector<int> fds;
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+        int port;
+      };
+
       int _coordinatorFd;
+      dmtcp::vector<OutgoingConnect> _connectQueue;
+      size_t _nextConnect;
+      size_t _connectsInFlight;
       dmtcp::map<ConnectionIdentifier, dmtcp::vector<int> > _pendingIncoming;
       dmtcp::map<ConnectionIdentifier, dmtcp::vector<int> > _pendingOutgoing;
       typedef dmtcp::map<ConnectionIdentifier, dmtcp::vector<int> >::iterator iterator;
@@ -183,6 +183,9 @@ void dmtcp::ConnectionState::preCheckpointDrain()
   //this will block until draining is complete
   _drain.monitorSockets ( DRAINER_CHECK_FREQ );
 
+  //saved copies of open files are written in the background while draining
+  FileConnection::waitForSavedFileCopies();
+
   //handle disconnected sockets
   const dmtcp::vector<ConnectionIdentifier>& discn = _drain.getDisconnectedSockets();
   for(size_t i=0; i<discn.size(); ++i){
@@ -303,7 +306,7 @@ void dmtcp::ConnectionState::postRestart()
 
 void dmtcp::ConnectionState::doReconnect ( jalib::JSocket& coordinator, jalib::JSocket& restoreListen )
 {
-  _rewirer.addDataSocket ( new jalib::JChunkReader ( coordinator,sizeof ( DmtcpMessage ) ) );
+  _rewirer.addDataSocket ( new jalib::JChunkReader ( coordinator,sizeof ( DmtcpMessageHeader ) ) );
   _rewirer.addListenSocket ( restoreListen );
   _rewirer.setCoordinatorFd ( coordinator.sockfd() );
 
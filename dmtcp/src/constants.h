@@ -58,6 +58,8 @@
 #define CKPT_FILE_SUFFIX ".dmtcp"
 #define CKPT_FILES_SUBDIR_PREFIX "ckpt_"
 #define CKPT_FILES_SUBDIR_SUFFIX "_files"
+// Number of helper processes copying open files in parallel at checkpoint
+#define DEFAULT_CKPT_OPEN_FILES_JOBS 4
 #define DELETED_FILE_SUFFIX " (deleted)"
 /* dmtcp_checkpoint, dmtcp_restart return a unique rc (default: 99) */
 #define DMTCP_FAIL_RC \
@@ -71,9 +73,6 @@
 #define DEFAULT_HOST "127.0.0.1"
 #define DEFAULT_PORT 7779
 
-#define RESTORE_PORT_START 9777
-#define RESTORE_PORT_STOP 9977
-
 // Matchup this definition with the one in plugins/ptrace/ptracewrappers.h
 #define DMTCP_FAKE_SYSCALL 1023
 
@@ -93,8 +92,11 @@
 #define ENV_VAR_CHECKPOINT_DIR "DMTCP_CHECKPOINT_DIR"
 #define ENV_VAR_TMPDIR "DMTCP_TMPDIR"
 #define ENV_VAR_CKPT_OPEN_FILES "DMTCP_CKPT_OPEN_FILES"
+#define ENV_VAR_CKPT_OPEN_FILES_JOBS "DMTCP_CKPT_OPEN_FILES_JOBS"
 #define ENV_VAR_PLUGIN "DMTCP_PLUGIN"
 #define ENV_VAR_QUIET "DMTCP_QUIET"
+#define ENV_VAR_BINARY_LOG "DMTCP_BINARY_LOG"
+#define ENV_VAR_STARTUP_TRACE "DMTCP_STARTUP_TRACE"
 #define ENV_VAR_ROOT_PROCESS "DMTCP_ROOT_PROCESS"
 #define ENV_VAR_PREFIX_ID "DMTCP_PREFIX_ID"
 #define ENV_VAR_PREFIX_PATH "DMTCP_PREFIX_PATH"
@@ -106,6 +108,12 @@
 #define ENV_VAR_UTILITY_DIR "JALIB_UTILITY_DIR"
 #define ENV_VAR_STDERR_PATH "JALIB_STDERR_PATH"
 #define ENV_VAR_COMPRESSION "DMTCP_GZIP"
+#define ENV_VAR_TRIM_HEAP "DMTCP_TRIM_HEAP"
+#define ENV_VAR_TRIM_STACKS "DMTCP_TRIM_STACKS"
+#define ENV_VAR_REMAP_CPUS "DMTCP_REMAP_CPUS"
+#define ENV_VAR_NUMA_PAGES "DMTCP_NUMA_PAGES"
+#define ENV_VAR_SKIP_FILE_PAGES "DMTCP_SKIP_FILE_PAGES"
+#define ENV_VAR_DEDUP "DMTCP_DEDUP"
 #ifdef HBICT_DELTACOMP
   #define ENV_VAR_DELTACOMPRESSION "DMTCP_HBICT"
   #define ENV_DELTACOMPRESSION ENV_VAR_DELTACOMPRESSION
@@ -138,10 +146,19 @@
     ENV_VAR_CHECKPOINT_DIR,\
     ENV_VAR_TMPDIR,\
     ENV_VAR_CKPT_OPEN_FILES,\
+    ENV_VAR_CKPT_OPEN_FILES_JOBS,\
     ENV_VAR_QUIET,\
+    ENV_VAR_BINARY_LOG,\
+    ENV_VAR_STARTUP_TRACE,\
     ENV_VAR_UTILITY_DIR,\
     ENV_VAR_STDERR_PATH,\
     ENV_VAR_COMPRESSION,\
+    ENV_VAR_TRIM_HEAP,\
+    ENV_VAR_TRIM_STACKS,\
+    ENV_VAR_REMAP_CPUS,\
+    ENV_VAR_NUMA_PAGES,\
+    ENV_VAR_SKIP_FILE_PAGES,\
+    ENV_VAR_DEDUP,\
     ENV_VAR_SIGCKPT,\
     ENV_VAR_ROOT_PROCESS,\
     ENV_VAR_PREFIX_ID,\
@@ -71,6 +71,25 @@ static const char* theUsage =
   "  --hbict, --no-hbict, (environment variable DMTCP_HBICT=[01]):\n"
   "      Enable/disable compression of checkpoint images (default: 1)\n"
 #endif
+  "  --trim-heap, (environment variable DMTCP_TRIM_HEAP=[01]):\n"
+  "      Before each checkpoint, return free heap memory to the system and\n"
+  "        save free malloc chunks as zero pages (default: 0)\n"
+  "  --trim-stacks, (environment variable DMTCP_TRIM_STACKS=[01]):\n"
+  "      Save thread stacks only above the stack pointer; not safe if the\n"
+  "        application keeps other data in a thread stack's mapping, e.g.\n"
+  "        coroutine stacks (default: 0)\n"
+  "  --numa-pages, (environment variable DMTCP_NUMA_PAGES=[01]):\n"
+  "      Record on which NUMA nodes the pages of each memory area are, so\n"
+  "        that restart puts them back there (default: 0)\n"
+  "  --skip-file-pages, (environment variable DMTCP_SKIP_FILE_PAGES=[01]):\n"
+  "      Save only the modified pages of private file mappings (libraries,\n"
+  "        mapped data files); restart maps the rest from the files, which\n"
+  "        must be unchanged by then (default: 0)\n"
+  "  --dedup, (environment variable DMTCP_DEDUP=[01]):\n"
+  "      Store each 64 KB chunk of memory once in dmtcp_dedup_store in the\n"
+  "        checkpoint directory, shared by all processes checkpointed there;\n"
+  "        images refer to it, and restart needs it at the same path\n"
+  "        (default: 0)\n"
   "  --prefix <arg>:\n"
   "      Prefix where DMTCP is installed on remote nodes.\n"
   "  --ckptdir, -c, (environment variable DMTCP_CHECKPOINT_DIR):\n"
@@ -97,6 +116,8 @@ static const char* theUsage =
   "      Skip check for valid coordinator and never start one automatically\n"
   "  --checkpoint-open-files:\n"
   "      Checkpoint open files and restore old working dir. (Default: do neither)\n"
+  "      Unchanged files are not copied again; up to DMTCP_CKPT_OPEN_FILES_JOBS\n"
+  "      (default: 4) files are copied in parallel.\n"
   "  --mtcp-checkpoint-signal:\n"
   "      Signal number used internally by MTCP for checkpointing (default: 12)\n"
   "  --with-plugin (environment variable DMTCP_PLUGIN):\n"
@@ -104,6 +125,13 @@ static const char* theUsage =
   "      (Absolute pathnames are required.)\n"
   "  --quiet, -q, (or set environment variable DMTCP_QUIET = 0, 1, or 2):\n"
   "      Skip banner and NOTE messages; if given twice, also skip WARNINGs\n"
+  "  (environment variable DMTCP_BINARY_LOG):\n"
+  "      If set, write TRACE and NOTE messages in binary form, without\n"
+  "      locking, to $DMTCP_TMPDIR/jassertlog.*.bin; view them with\n"
+  "      utils/jassert_decode.py\n"
+  "  (environment variable DMTCP_STARTUP_TRACE):\n"
+  "      If set, print to stderr the time each process spends in DMTCP\n"
+  "      initialization before main(), broken down by step\n"
   "  --help:\n"
   "      Print this message and exit.\n"
   "  --version:\n"
@@ -169,6 +197,21 @@ static void processArgs(int *orig_argc, char ***orig_argv)
     } else if (s == "--no-gzip") {
       setenv(ENV_VAR_COMPRESSION, "0", 1);
       shift;
+    } else if (s == "--trim-heap") {
+      setenv(ENV_VAR_TRIM_HEAP, "1", 1);
+      shift;
+    } else if (s == "--trim-stacks") {
+      setenv(ENV_VAR_TRIM_STACKS, "1", 1);
+      shift;
+    } else if (s == "--numa-pages") {
+      setenv(ENV_VAR_NUMA_PAGES, "1", 1);
+      shift;
+    } else if (s == "--skip-file-pages") {
+      setenv(ENV_VAR_SKIP_FILE_PAGES, "1", 1);
+      shift;
+    } else if (s == "--dedup") {
+      setenv(ENV_VAR_DEDUP, "1", 1);
+      shift;
     }
 #ifdef HBICT_DELTACOMP
     else if (s == "--hbict") {
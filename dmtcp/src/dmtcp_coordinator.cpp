@@ -350,6 +350,19 @@ static bool workersRunningAndSuspendMsgSent = false;
 
 static bool killInProgress = false;
 
+/* Checkpoints that need no barrier between suspending the workers and
+ * resuming them:  on DMT_OK from a suspended worker, params[0] is the number
+ * of its connections that might be shared with another process, and
+ * params[1] is set if a plugin might use the name service.  If there is one
+ * worker, or none has such connections, and no plugin uses the name service,
+ * DMT_DO_FD_LEADER_ELECTION goes out with params[1] set, and the workers go on
+ * to checkpoint and refill without waiting for DMT_DO_DRAIN,
+ * DMT_DO_CHECKPOINT, the name service rounds or DMT_DO_REFILL.  The next
+ * barrier is DMT_DO_RESUME, once all of them are REFILLED.
+ */
+static int numWorkersNeedingBarriers = 0;
+static bool barriersSkipped = false;
+
 /* If dmtcp_checkpoint/dmtcp_restart specifies '-i', theCheckpointInterval
  * will be reset accordingly (valid for current computation).  If dmtcp_command
  * specifies '-i' (or if user interactively invokes 'i' in coordinator),
@@ -378,6 +391,15 @@ static dmtcp::string remotePrefix;
 #define MAX_VIRTUAL_PID   4000000
 static pid_t _nextVirtualPid = INITIAL_VIRTUAL_PID;
 
+// Queue msg, in its wire format, for a non-blocking write to sock.
+static jalib::JChunkWriter *newMessageWriter ( const jalib::JSocket& sock,
+                                               const dmtcp::DmtcpMessage& msg )
+{
+  char buf[DMTCPMESSAGE_MAX_WIRE_SIZE];
+  size_t len = msg.encode ( buf );
+  return new jalib::JChunkWriter ( sock, buf, len );
+}
+
 namespace
 {
   static int theNextClientNumber = 1;
@@ -389,13 +411,14 @@ namespace
                          ,const struct sockaddr * remote
                          ,socklen_t len
                          ,dmtcp::DmtcpMessage &hello_remote)
-          : jalib::JChunkReader ( sock, sizeof ( dmtcp::DmtcpMessage ) )
+          : jalib::JChunkReader ( sock, sizeof ( dmtcp::DmtcpMessageHeader ) )
           , _clientNumber ( theNextClientNumber++ )
           , _addrlen ( len )
       {
         _identity = hello_remote.from.pid();
         _state = hello_remote.state;
         _restorePort = hello_remote.restorePort;
+        _isRestartProcess = hello_remote.type == dmtcp::DMT_RESTART_PROCESS;
         memset ( &_addr, 0, sizeof _addr );
         memcpy ( &_addr, remote, len );
       }
@@ -406,6 +429,9 @@ namespace
       const struct sockaddr_storage* addr() const { return &_addr; }
       socklen_t addrlen() const { return _addrlen; }
       int restorePort() const { return _restorePort; }
+      // dmtcp_restart itself, which rewires the sockets, rather than one of
+      // the processes that it restores.
+      bool isRestartProcess() const { return _isRestartProcess; }
       void setState ( dmtcp::WorkerState value ) { _state = value; }
       void progname(dmtcp::string pname){ _progname = pname; }
       dmtcp::string progname(void) const { return _progname; }
@@ -436,6 +462,7 @@ namespace
       struct sockaddr_storage _addr;
       socklen_t               _addrlen;
       int _restorePort;
+      bool _isRestartProcess;
       dmtcp::string _hostname;
       dmtcp::string _progname;
       dmtcp::string _prefixDir;
@@ -670,7 +697,9 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
   else
   {
     NamedChunkReader * client= ( NamedChunkReader* ) sock;
-    DmtcpMessage& msg = * ( DmtcpMessage* ) sock->buffer();
+    DmtcpMessage msg;
+    msg.decode ( * ( const DmtcpMessageHeader* ) sock->buffer(),
+                 sock->socket() );
     msg.assertValid();
     char * extraData = 0;
 
@@ -689,16 +718,35 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
         WorkerState newState = minimumState();
 
         JTRACE ("got DMT_OK message")
-          ( msg.from )( msg.state )( oldState )( newState );
+          ( client->identity() )( msg.state )( oldState )( newState );
+
+        if ( oldState == WorkerState::RUNNING
+                && msg.state == WorkerState::SUSPENDED
+                && ( msg.params[0] != 0 || msg.params[1] != 0 ) )
+        {
+          numWorkersNeedingBarriers++;
+        }
 
         if ( oldState == WorkerState::RUNNING
                 && newState == WorkerState::SUSPENDED )
         {
           JTRACE ("BAB oldState == WorkerState::RUNNING && newState == WorkerState::SUSPENDED");
-          JNOTE ( "locking all nodes" );
-          broadcastMessage(DMT_DO_FD_LEADER_ELECTION,
-                           UniquePid::ComputationId(),
-                           getStatus().numPeers );
+          DmtcpMessage lockMsg ( DMT_DO_FD_LEADER_ELECTION );
+          lockMsg.compGroup = UniquePid::ComputationId();
+          lockMsg.params[0] = getStatus().numPeers;
+#ifndef EXTERNAL_SOCKET_HANDLING
+          barriersSkipped = numWorkersNeedingBarriers == 0 ||
+                            (lockMsg.params[0] == 1 && !msg.params[1]);
+#endif
+          numWorkersNeedingBarriers = 0;
+          lockMsg.params[1] = barriersSkipped;
+          if ( barriersSkipped ) {
+            JNOTE ( "locking all nodes; nothing to drain, "
+                    "checkpointing without further barriers" );
+          } else {
+            JNOTE ( "locking all nodes" );
+          }
+          broadcastMessage ( lockMsg );
         }
 #ifdef EXTERNAL_SOCKET_HANDLING
         if ( oldState == WorkerState::SUSPENDED
@@ -741,6 +789,13 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
         }
 #endif
 
+        bool skippedToRefilled = barriersSkipped
+                                 && oldState == WorkerState::SUSPENDED
+                                 && newState == WorkerState::REFILLED;
+        if ( skippedToRefilled ) {
+          writeRestartScript();
+        }
+
 #ifdef COORD_NAMESERVICE
         if ( oldState == WorkerState::DRAINED
                 && newState == WorkerState::CHECKPOINTED )
@@ -773,8 +828,8 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
           JNOTE ( "refilling all nodes" );
           broadcastMessage ( DMT_DO_REFILL );
         }
-        if ( oldState == WorkerState::DONE_QUERYING
-                && newState == WorkerState::REFILLED )
+        if ( ( oldState == WorkerState::DONE_QUERYING
+                && newState == WorkerState::REFILLED ) || skippedToRefilled )
 #else
         if ( oldState == WorkerState::DRAINED
                 && newState == WorkerState::CHECKPOINTED )
@@ -795,16 +850,22 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
           JNOTE ( "refilling all nodes (after checkpoint)" );
           broadcastMessage ( DMT_DO_REFILL );
         }
-        if ( oldState == WorkerState::CHECKPOINTED
-                && newState == WorkerState::REFILLED )
+        if ( ( oldState == WorkerState::CHECKPOINTED
+                && newState == WorkerState::REFILLED ) || skippedToRefilled )
 #endif
         {
           JNOTE ( "restarting all nodes" );
           broadcastMessage ( DMT_DO_RESUME );
+          barriersSkipped = false;
 
           JTIMER_STOP ( checkpoint );
           isRestarting = false;
 
+          size_t msgs, bytes, fixedBytes;
+          DmtcpMessage::wireStats ( &msgs, &bytes, &fixedBytes );
+          JNOTE ( "coordinator message traffic for this checkpoint/restart" )
+            ( msgs ) ( bytes ) ( fixedBytes );
+
           setTimeoutInterval( theCheckpointInterval );
 
           if (blockUntilDone) {
@@ -821,6 +882,8 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
       }
       case DMT_RESTORE_WAITING:
       {
+        // One message per dmtcp_restart, listing all of its incoming
+        // connections.  Only the other dmtcp_restart's need it.
         DmtcpMessage restMsg = msg;
         restMsg.type = DMT_RESTORE_WAITING;
         memcpy ( &restMsg.restoreAddr,client->addr(),client->addrlen() );
@@ -830,12 +893,23 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
           ( restMsg.restorePort ) ( client->identity() );
         JASSERT ( restMsg.restoreAddrlen > 0 )
           ( restMsg.restoreAddrlen ) ( client->identity() );
-        JASSERT ( restMsg.restorePid != ConnectionIdentifier::Null() )
-          ( client->identity() );
+        JASSERT ( restMsg.params[0] > 0 && restMsg.extraBytes ==
+                  restMsg.params[0] * sizeof ( ConnectionIdentifier ) )
+          ( restMsg.params[0] ) ( restMsg.extraBytes ) ( client->identity() );
         JTRACE ( "broadcasting RESTORE_WAITING" )
-          (restMsg.restorePid) (restMsg.restoreAddrlen) (restMsg.restorePort);
-        _restoreWaitingMessages.push_back ( restMsg );
-        broadcastMessage ( restMsg );
+          (restMsg.params[0]) (restMsg.restoreAddrlen) (restMsg.restorePort);
+
+        char buf[DMTCPMESSAGE_MAX_WIRE_SIZE];
+        dmtcp::string data ( buf, restMsg.encode ( buf ) );
+        data.append ( extraData, restMsg.extraBytes );
+        _restoreWaitingMessages.push_back ( data );
+        for ( iterator i = _dataSockets.begin(); i != _dataSockets.end(); ++i )
+        {
+          if ( ( *i )->socket().sockfd() != STDIN_FD &&
+               ( ( NamedChunkReader* ) *i )->isRestartProcess() )
+            addWrite ( new jalib::JChunkWriter ( ( *i )->socket(),
+                                                 data.data(), data.length() ) );
+        }
         break;
       }
       case DMT_CKPT_FILENAME:
@@ -943,14 +1017,27 @@ void dmtcp::DmtcpCoordinator::onData ( jalib::JReaderInterface* sock )
       break;
 #endif
       case DMT_UPDATE_PROCESS_INFO_AFTER_FORK:
+      case DMT_UPDATE_PROCESS_INFO_AFTER_EXEC:
       {
           dmtcp::string hostname = extraData;
           dmtcp::string progname = extraData + hostname.length() + 1;
-          JNOTE("Updating process Information after fork()")
+          JNOTE("Updating process Information after fork()/exec()")
             (hostname) (progname) (msg.from.pid()) (client->identity());
           client->progname(progname);
           client->hostname(hostname);
           client->identity(msg.from.pid());
+
+          if (msg.type == DMT_UPDATE_PROCESS_INFO_AFTER_EXEC) {
+            /* The exec()'d program took over the connection of the old one.
+             * If a DMT_DO_SUSPEND was sent on it, the checkpoint thread of
+             * the old program may have read it before dying in exec(); tell
+             * the new one (see DmtcpWorker::waitForCoordinatorMsg).  Queue
+             * the reply behind any broadcast still pending on this socket.
+             */
+            DmtcpMessage ack(DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK);
+            ack.params[0] = workersRunningAndSuspendMsgSent;
+            addWrite(newMessageWriter(sock->socket(), ack));
+          }
       }
           break;
       default:
@@ -1094,6 +1181,9 @@ void dmtcp::DmtcpCoordinator::onConnect ( const jalib::JSocket& sock,
   if ( hello_remote.type == DMT_RESTART_PROCESS ) {
     if ( validateDmtRestartProcess ( hello_remote, remote ) == false )
       return;
+    if ( !isRestarting ) {
+      DmtcpMessage::resetWireStats();
+    }
     isRestarting = true;
   } else if ( hello_remote.type == DMT_HELLO_COORDINATOR &&
               hello_remote.state == WorkerState::RESTARTING) {
@@ -1123,10 +1213,10 @@ void dmtcp::DmtcpCoordinator::onConnect ( const jalib::JSocket& sock,
   }
 
   //add this client as a chunk reader
-  // in this case a 'chunk' is sizeof(DmtcpMessage)
+  // in this case a 'chunk' is sizeof(DmtcpMessageHeader)
   addDataSocket ( ds );
 
-  if ( hello_remote.state == WorkerState::RESTARTING
+  if ( hello_remote.type == DMT_RESTART_PROCESS
           &&  _restoreWaitingMessages.size() > 0 )
   {
     JTRACE ( "updating missing broadcasts for new connection" )
@@ -1134,11 +1224,9 @@ void dmtcp::DmtcpCoordinator::onConnect ( const jalib::JSocket& sock,
     ( _restoreWaitingMessages.size() );
     for ( size_t i=0; i<_restoreWaitingMessages.size(); ++i )
     {
-      addWrite (
-          new jalib::JChunkWriter ( sock
-                                    , ( char* ) &_restoreWaitingMessages[i]
-                                    , sizeof ( DmtcpMessage ) )
-      );
+      addWrite ( new jalib::JChunkWriter ( sock,
+                                           _restoreWaitingMessages[i].data(),
+                                           _restoreWaitingMessages[i].length() ) );
     }
   }
 
@@ -1392,6 +1480,8 @@ bool dmtcp::DmtcpCoordinator::startCheckpoint()
     JNOTE ( "starting checkpoint, suspending all nodes" )( s.numPeers );
     UniquePid::ComputationId().incrementGeneration();
     JNOTE("Incremented Generation") (UniquePid::ComputationId().generation());
+    numWorkersNeedingBarriers = 0;
+    DmtcpMessage::resetWireStats();
     // Pass number of connected peers to all clients
     broadcastMessage(DMT_DO_SUSPEND);
 
@@ -1437,9 +1527,7 @@ void dmtcp::DmtcpCoordinator::broadcastMessage ( const DmtcpMessage& msg )
 	= _dataSockets.begin() ; i!= _dataSockets.end() ; i++ )
   {
     if ( ( *i )->socket().sockfd() != STDIN_FD )
-      addWrite ( new jalib::JChunkWriter ( ( *i )->socket(),
-					   ( char* ) &msg,
-					   sizeof ( DmtcpMessage ) ) );
+      addWrite ( newMessageWriter ( ( *i )->socket(), msg ) );
   }
 }
 
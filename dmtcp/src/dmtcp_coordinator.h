@@ -77,7 +77,9 @@ namespace dmtcp
       typedef dmtcp::vector<jalib::JReaderInterface*>::iterator iterator;
       typedef dmtcp::vector<jalib::JReaderInterface*>::const_iterator const_iterator;
 //     NodeTable _table;
-      dmtcp::vector< DmtcpMessage > _restoreWaitingMessages;
+      // DMT_RESTORE_WAITING messages (with their extra data) as sent to the
+      // dmtcp_restart processes, to replay to the ones that connect later.
+      dmtcp::vector< dmtcp::string > _restoreWaitingMessages;
 
 #ifdef EXTERNAL_SOCKET_HANDLING
       dmtcp::vector< DmtcpMessage > _socketPeerLookupMessages;
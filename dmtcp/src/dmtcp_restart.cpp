@@ -26,6 +26,8 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <vector>
@@ -42,6 +44,7 @@
 #include "syscallwrappers.h"
 #include "protectedfds.h"
 #include "restoretarget.h"
+#include "ckptserializer.h"
 #include "util.h"
 
 #define BINARY_NAME "dmtcp_restart"
@@ -98,8 +101,15 @@ static const char* theUsage =
   "      --batch implies -i 3600, unless otherwise specified.\n"
   "  --no-check:\n"
   "      Skip check for valid coordinator and never start one automatically\n"
+  "  --remap-cpus, (environment variable DMTCP_REMAP_CPUS=1):\n"
+  "      Map the saved CPU affinity of each thread onto the CPUs of this host\n"
+  "      (CPU n becomes the (n mod N)-th of N available CPUs), instead of\n"
+  "      dropping CPUs that are not available here\n"
   "  --quiet, -q, (or set environment variable DMTCP_QUIET = 0, 1, or 2):\n"
   "      Skip banner and NOTE messages; if given twice, also skip WARNINGs\n"
+  "  (environment variable DMTCP_STARTUP_TRACE):\n"
+  "      If set, each restarted process prints to stderr the time spent in\n"
+  "      each phase of dmtcp_restart, just before starting mtcp_restart\n"
   "  --help:\n"
   "      Print this message and exit.\n"
   "  --version:\n"
@@ -113,6 +123,56 @@ static const char* theUsage =
 
 dmtcp::vector<RestoreTarget> targets;
 
+/* Reading the header of an image means decompressing the start of it (one
+ * gzip per image) and deserializing the connection table, so with many
+ * images it is worth doing in parallel.  The deserialized tables go into
+ * globals (ConnectionList), so rather than threads, forked children read
+ * the images, up to one per CPU at a time, and each writes a copy of the raw
+ * header to an anonymous file.  The RestoreTargets are then built from those
+ * copies in the original order, which only costs a memcpy and the parsing.
+ */
+static void loadTargets(const dmtcp::vector<dmtcp::string>& paths)
+{
+  long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (paths.size() < 2 || maxJobs < 2) {
+    for (size_t i = 0; i < paths.size(); i++) {
+      targets.push_back(RestoreTarget(paths[i]));
+    }
+    return;
+  }
+
+  dmtcp::vector<int> headerFds(paths.size(), -1);
+  dmtcp::map<pid_t, size_t> jobs;
+  size_t next = 0;
+  while (next < paths.size() || !jobs.empty()) {
+    if (next < paths.size() && (long) jobs.size() < maxJobs) {
+      headerFds[next] = Util::createAnonymousFile("dmtcpCkptHeader");
+      JASSERT(headerFds[next] != -1) (JASSERT_ERRNO);
+      pid_t pid = fork();
+      if (pid == 0) {
+        CkptSerializer::copyHeader(paths[next], headerFds[next]);
+        _exit(0);
+      }
+      JASSERT(pid > 0) (JASSERT_ERRNO);
+      jobs[pid] = next++;
+      continue;
+    }
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1 && errno == EINTR) continue;
+    JASSERT(pid != -1) (JASSERT_ERRNO);
+    if (jobs.find(pid) == jobs.end()) continue;
+    JASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+      (paths[jobs[pid]]) (status) .Text("Failed to read checkpoint image");
+    jobs.erase(pid);
+  }
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    targets.push_back(RestoreTarget(paths[i], headerFds[i]));
+    close(headerFds[i]);
+  }
+}
+
 static void restoreSockets(dmtcp::DmtcpCoordinatorAPI& coordinatorAPI,
                            dmtcp::ConnectionState& ckptCoord)
 {
@@ -140,6 +200,7 @@ int main(int argc, char** argv)
   bool isRestart = true;
   int allowedModes = dmtcp::DmtcpCoordinatorAPI::COORD_ANY;
 
+  dmtcp::Util::startupTraceBegin();
   initializeJalib();
 
   if (!getenv(ENV_VAR_QUIET)) {
@@ -196,6 +257,9 @@ int main(int argc, char** argv)
     } else if (argc > 1 && (s == "-t" || s == "--tmpdir")) {
       setenv(ENV_VAR_TMPDIR, argv[1], 1);
       shift; shift;
+    } else if (s == "--remap-cpus") {
+      setenv(ENV_VAR_REMAP_CPUS, "1", 1);
+      shift;
     } else if (s == "-q" || s == "--quiet") {
       *getenv(ENV_VAR_QUIET) = *getenv(ENV_VAR_QUIET) + 1;
       // Just in case a non-standard version of setenv is being used:
@@ -228,9 +292,11 @@ int main(int argc, char** argv)
   if (autoStartCoordinator)
     dmtcp::DmtcpCoordinatorAPI::startCoordinatorIfNeeded(allowedModes,
                                                          isRestart);
+  dmtcp::Util::startupTraceStep("coordinator");
 
   JTRACE("New dmtcp_restart process; _argc_ ckpt images") (argc);
 
+  dmtcp::vector<dmtcp::string> restorenames;
   bool doAbort = false;
   for (; argc > 0; shift) {
     dmtcp::string restorename(argv[0]);
@@ -263,8 +329,10 @@ int main(int argc, char** argv)
     }
 
     JTRACE("Will restart ckpt image _argv[0]_") (argv[0]);
-    targets.push_back (RestoreTarget (argv[0]));
+    restorenames.push_back(restorename);
   }
+  loadTargets(restorenames);
+  dmtcp::Util::startupTraceStep("headers");
 
   if (targets.size() <= 0) {
     JNOTE("ERROR: No DMTCP checkpoint image(s) found. Check Usage.");
@@ -303,12 +371,14 @@ int main(int argc, char** argv)
         << " -> " << (it->second)->str() << "\n";
   }
   JTRACE ("Allocating fds for Connections") (out.str());
+  dmtcp::Util::startupTraceStep("fds");
 
   //------------------------
   WorkerState::setCurrentState(WorkerState::RESTARTING);
   ConnectionState ckptCoord(conToFd);
   DmtcpCoordinatorAPI coordinatorAPI;
   restoreSockets(coordinatorAPI, ckptCoord);
+  dmtcp::Util::startupTraceStep("sockets");
 
   /* Create the file to hold the pid/tid maps. */
   openOriginalToCurrentMappingFiles();
@@ -323,6 +393,7 @@ int main(int argc, char** argv)
     else JASSERT(cid > 0);
   }
   RestoreTarget& targ = targets[i];
+  dmtcp::Util::startupTraceStep("fork");
 
   JTRACE("forked, restoring process")
     (i) (targets.size()) (targ.upid()) (getpid());
@@ -339,9 +410,11 @@ int main(int argc, char** argv)
   coordinatorAPI.sendCoordinatorHandshake(targ.procname(), targ.compGroup());
   coordinatorAPI.recvCoordinatorHandshake();
   close(tmpCoordFd);
+  dmtcp::Util::startupTraceStep("reconnect");
 
   //restart targets[i]
   targets[i].dupAllSockets (slidingFd);
+  dmtcp::Util::startupTraceStep("dupfds");
   targets[i].mtcpRestart();
 
   JASSERT(false).Text("unreachable");
@@ -360,6 +433,7 @@ int main(int argc, char** argv)
   // Node contains info about all sessions which exists at lower levels.
   // Also node is aware of session leader existence at lower levels.
   SetupSessions();
+  dmtcp::Util::startupTraceStep("tree");
 
   int pgrp_index=-1;
   JTRACE("Creating ROOT Processes") (roots.size());
@@ -406,17 +480,17 @@ int main(int argc, char** argv)
     }
   }
   // Use j set to 0 (if at least one root non-init-child process exists),
-  // or else j set to some value if no such process found.
+  // or else j set just past flat_index.  Every other flat-like process is
+  // forked: CreateProcess() does not return.
   for(; j < targets.size(); ++j) {
     if (!targets[j].isMarkedUsed()) {
-      if (pgrp_index < 0) {
-        // Save first flat-like process to be restored after all others
-        pgrp_index = j;
-        continue;
-      } else {
+      JTRACE("Need in flat-like restore for process") (targets[j].upid());
+      pid_t cid = fork();
+      if (cid == 0) {
         targets[j].CreateProcess(coordinatorAPI, slidingFd);
-        JTRACE("Need in flat-like restore for process") (targets[j].upid());
+        JASSERT (false) .Text("Unreachable");
       }
+      JASSERT (cid > 0);
     }
   }
 
@@ -428,7 +502,7 @@ int main(int argc, char** argv)
     targets[flat_index].CreateProcess(coordinatorAPI, slidingFd);
   } else {
     // FIXME: Under what conditions will this path be exercised?
-    JNOTE ("unknown type of target?") (targets[flat_index].path());
+    JNOTE ("unknown type of target?") (targets.size());
   }
 // #endif
 }
@@ -681,7 +755,15 @@ void SetupSessions()
   }
 }
 
-int openSharedFile(dmtcp::string name, int flags)
+/* The pid and shmid maps are shared by all processes of the computation
+ * restarted on this host.  When this dmtcp_restart restarts all of them (they
+ * are forked below and inherit the fds), the maps are anonymous,
+ * memory-backed files, so nothing hits the (possibly NFS) tmp directory and
+ * nothing is left behind if the restart fails.  Otherwise, other
+ * dmtcp_restart's may restart some of its processes here, and the maps must
+ * be files in $DMTCP_TMPDIR that all of them can find.
+ */
+static int openSharedFile(const dmtcp::string& name, int flags)
 {
   int fd;
   // try to create, truncate & open file
@@ -698,47 +780,37 @@ int openSharedFile(dmtcp::string name, int flags)
   return -1;
 }
 
-static void openOriginalToCurrentMappingFiles()
+static void openMappingFile(const char *name, int protectedFd, bool append)
 {
   int fd;
+  if (targets.size() < (size_t) numPeers) {
+    dmtcp::ostringstream path;
+    path << dmtcpTmpDir << "/" << name << "."
+         << compGroup << "." << std::hex << coordTstamp;
+    JTRACE("Computation split across dmtcp_restart's; using shared file")
+      (path.str()) (targets.size()) (numPeers);
+    fd = openSharedFile(path.str(), O_RDWR | (append ? O_APPEND : 0));
+  } else {
+    fd = dmtcp::Util::createAnonymousFile(name);
+    JASSERT (fd != -1) (name) (JASSERT_ERRNO);
+    if (append) {
+      JASSERT (fcntl(fd, F_SETFL, O_APPEND) == 0) (name) (JASSERT_ERRNO);
+    }
+  }
+  JASSERT (dup2 (fd, protectedFd) == protectedFd) (name) (JASSERT_ERRNO);
+  close (fd);
+}
 
+static void openOriginalToCurrentMappingFiles()
+{
 #ifdef PID_VIRTUALIZATION
-  dmtcp::ostringstream pidMapFile;
-  pidMapFile << dmtcpTmpDir << "/dmtcpPidMap."
-             << compGroup << "." << std::hex << coordTstamp;
-  // Open and create pidMapFile if it doesn't exist.
-  JTRACE("Open dmtcpPidMapFile")(pidMapFile.str());
-  fd = openSharedFile(pidMapFile.str(), O_RDWR);
-  JASSERT (fd != -1);
-  JASSERT (dup2 (fd, PROTECTED_PIDMAP_FD) == PROTECTED_PIDMAP_FD)
-	  (pidMapFile.str());
-  close (fd);
+  JTRACE("Open dmtcpPidMap");
+  openMappingFile("dmtcpPidMap", PROTECTED_PIDMAP_FD, false);
 #endif
 
-  dmtcp::ostringstream shmidListFile, shmidMapFile;
-
-  shmidMapFile << dmtcpTmpDir << "/dmtcpShmidMap."
-               << compGroup << "." << std::hex << coordTstamp;
-
-  shmidListFile << dmtcpTmpDir << "/dmtcpShmidList."
-                << compGroup << "." << std::hex << coordTstamp;
-
-  // Open and create shmidListFile if it doesn't exist.
-  JTRACE("Open dmtcpShmidListFile") (shmidListFile.str());
-  fd = openSharedFile(shmidListFile.str(), (O_WRONLY|O_APPEND));
-  JASSERT (fd != -1);
-  JASSERT (dup2 (fd, PROTECTED_SHMIDLIST_FD) == PROTECTED_SHMIDLIST_FD)
-	  (shmidListFile.str());
-  close (fd);
-
-  // Open and create shmidMapFile if it doesn't exist.
-  JTRACE("Open dmtcpShmidMapFile") (shmidMapFile.str());
-  fd = openSharedFile(shmidMapFile.str(), (O_WRONLY|O_APPEND));
-  JASSERT (fd != -1);
-  JASSERT (dup2 (fd, PROTECTED_SHMIDMAP_FD) == PROTECTED_SHMIDMAP_FD)
-	  (shmidMapFile.str());
-  close (fd);
-
+  JTRACE("Open dmtcpShmidList and dmtcpShmidMap");
+  openMappingFile("dmtcpShmidList", PROTECTED_SHMIDLIST_FD, true);
+  openMappingFile("dmtcpShmidMap", PROTECTED_SHMIDMAP_FD, true);
 }
 
 void runMtcpRestore(const char* path, int offset, size_t argvSize,
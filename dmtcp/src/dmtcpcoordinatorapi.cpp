@@ -136,6 +136,32 @@ void dmtcp::DmtcpCoordinatorAPI::informCoordinatorOfNewProcessOnFork
                            DMT_UPDATE_PROCESS_INFO_AFTER_FORK);
 }
 
+/* Fast path for exec(): the new program keeps the coordinator connection of
+ * the old one (PROTECTED_COORD_FD is inherited) and tells the coordinator its
+ * new name without waiting for a reply.  The coordinator's
+ * DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK is read later by the checkpoint
+ * thread, so a short-lived program never waits for the coordinator.
+ */
+void dmtcp::DmtcpCoordinatorAPI::informCoordinatorOfExec()
+{
+  JASSERT(_coordinatorSocket.isValid());
+  JTRACE("Informing coordinator of exec") (UniquePid::ThisProcess());
+  sendCoordinatorHandshake(jalib::Filesystem::GetProgramName(),
+                           UniquePid::ComputationId(),
+                           -1,
+                           DMT_UPDATE_PROCESS_INFO_AFTER_EXEC);
+}
+
+// Carries the handshake results across exec(), for informCoordinatorOfExec().
+void dmtcp::DmtcpCoordinatorAPI::serialize(jalib::JBinarySerializer& o)
+{
+  JSERIALIZE_ASSERT_POINT("DmtcpCoordinatorAPI:");
+  o & _coordinatorId & _virtualPid;
+  if (o.isReader()) {
+    DmtcpMessage::setDefaultCoordinator(_coordinatorId);
+  }
+}
+
 void dmtcp::DmtcpCoordinatorAPI::connectToCoordinatorWithHandshake()
 {
   connectToCoordinator ( );
@@ -149,8 +175,9 @@ void dmtcp::DmtcpCoordinatorAPI::connectToCoordinatorWithoutHandshake()
   connectToCoordinator ( );
 }
 
-// FIXME:
-static int theRestorePort = RESTORE_PORT_START;
+// Port of the restore listener (openRestoreSocket()), sent to the coordinator
+// in the DMT_RESTART_PROCESS handshake.
+static int theRestorePort = -1;
 void dmtcp::DmtcpCoordinatorAPI::sendCoordinatorHandshake (
   const dmtcp::string& progname,
   UniquePid compGroup /*= UniquePid()*/,
@@ -473,16 +500,19 @@ jalib::JSocket& dmtcp::DmtcpCoordinatorAPI::openRestoreSocket()
 {
   JTRACE ("restoreSockets begin");
 
-  theRestorePort = RESTORE_PORT_START;
-
-  jalib::JSocket restoreSocket (-1);
-  while (!restoreSocket.isValid() && theRestorePort < RESTORE_PORT_STOP) {
-    restoreSocket = jalib::JServerSocket(jalib::JSockAddr::ANY,
-                                         ++theRestorePort);
-    JTRACE ("open listen socket attempt") (theRestorePort);
-  }
-  JASSERT (restoreSocket.isValid()) (RESTORE_PORT_START)
+  // Let the kernel pick the port, rather than probing a fixed range, so that
+  // any number of dmtcp_restart's can run on a host.  All of the incoming
+  // reconnections of this restart arrive on this one socket.
+  jalib::JSocket restoreSocket = jalib::JServerSocket(jalib::JSockAddr::ANY,
+                                                      0, SOMAXCONN);
+  JASSERT (restoreSocket.isValid()) (JASSERT_ERRNO)
     .Text("failed to open listen socket");
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  JASSERT (getsockname(restoreSocket.sockfd(), (struct sockaddr*) &addr,
+                       &addrlen) == 0) (JASSERT_ERRNO);
+  theRestorePort = ntohs(addr.sin_port);
+  JTRACE ("opened restore listen socket") (theRestorePort);
   restoreSocket.changeFd(_restoreSocket.sockfd());
   JTRACE ("opening listen sockets")
     (_restoreSocket.sockfd()) (restoreSocket.sockfd());
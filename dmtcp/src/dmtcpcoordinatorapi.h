@@ -74,6 +74,8 @@ namespace dmtcp
       jalib::JSocket createNewConnectionToCoordinator(bool dieOnError = true);
       void createNewConnectionBeforeFork(dmtcp::string& progName);
       void informCoordinatorOfNewProcessOnFork(jalib::JSocket& coordSock);
+      void informCoordinatorOfExec();
+      void serialize(jalib::JBinarySerializer& o);
 
       // np > -1  means it is restarting a process that have np processes in its
       //           computation group
@@ -48,8 +48,6 @@ dmtcp::DmtcpMessage::DmtcpMessage ( DmtcpMessageType t /*= DMT_NULL*/ )
     ,restorePid ( ConnectionIdentifier::Null() )
     ,restoreAddrlen ( 0 )
     ,restorePort ( -1 )
-    ,keyLen ( 0 )
-    ,valLen ( 0 )
     ,theCheckpointInterval ( DMTCPMESSAGE_SAME_CKPT_INTERVAL )
     ,extraBytes ( 0 )
 {
@@ -86,6 +84,238 @@ bool dmtcp::DmtcpMessage::isValid() const
 
 void dmtcp::DmtcpMessage::poison() { memset ( _magicBits,0,sizeof ( _magicBits ) ); }
 
+/* Fields each message type may use; see "Wire format" in the header.  Types
+ * not listed here are handshakes and rare messages that keep every field.
+ */
+static uint32_t wireFields ( dmtcp::DmtcpMessageType type )
+{
+  using namespace dmtcp;
+  switch ( type )
+  {
+    case DMT_OK:
+      return DMT_FIELD_STATE | DMT_FIELD_PARAMS;
+    case DMT_DO_SUSPEND:
+    case DMT_DO_FD_LEADER_ELECTION:
+    case DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK:
+      return DMT_FIELD_COMPGROUP | DMT_FIELD_PARAMS;
+    case DMT_DO_RESUME:
+    case DMT_DO_DRAIN:
+    case DMT_DO_CHECKPOINT:
+#ifdef COORD_NAMESERVICE
+    case DMT_DO_REGISTER_NAME_SERVICE_DATA:
+    case DMT_DO_SEND_QUERIES:
+#endif
+    case DMT_DO_REFILL:
+    case DMT_PEER_ECHO:
+      return DMT_FIELD_PARAMS;
+    case DMT_KILL_PEER:
+    case DMT_SYNCHRONIZE:
+    case DMT_FORCE_RESTART:
+    case DMT_GET_VIRTUAL_PID:
+      return 0;
+    case DMT_GET_VIRTUAL_PID_RESULT:
+      return DMT_FIELD_VIRTUALPID;
+    case DMT_REGISTER_NAME_SERVICE_DATA:
+    case DMT_NAME_SERVICE_QUERY:
+    case DMT_NAME_SERVICE_QUERY_RESPONSE:
+      return DMT_FIELD_PARAMS | DMT_FIELD_EXTRABYTES;
+    case DMT_CKPT_FILENAME:
+      return DMT_FIELD_EXTRABYTES;
+    case DMT_RESTORE_WAITING:
+      return DMT_FIELD_PARAMS | DMT_FIELD_EXTRABYTES | DMT_FIELD_RESTOREADDR
+             | DMT_FIELD_RESTOREPORT;
+    case DMT_RESTORE_RECONNECTED:
+      return DMT_FIELD_RESTOREPID;
+    default:
+      return DMT_FIELD_ALL;
+  }
+}
+
+// What a receiver assumes for a field that was not sent.
+static const dmtcp::DmtcpMessage& wireDefault()
+{
+  static dmtcp::DmtcpMessage *msg = NULL;
+  if ( msg == NULL ) {
+    msg = new dmtcp::DmtcpMessage();
+    msg->from = dmtcp::ConnectionIdentifier::Null();
+    msg->coordinator = dmtcp::UniquePid();
+    msg->state = dmtcp::WorkerState::UNKNOWN;
+    msg->compGroup = dmtcp::UniquePid();
+  }
+  return *msg;
+}
+
+static size_t wireMsgs = 0;
+static size_t wireBytes = 0;
+static size_t wireFixedBytes = 0;
+
+static void countWireMsg ( size_t bytes, size_t extraBytes )
+{
+  wireMsgs++;
+  wireBytes += bytes + extraBytes;
+  wireFixedBytes += sizeof ( dmtcp::DmtcpMessage ) + extraBytes;
+}
+
+void dmtcp::DmtcpMessage::wireStats ( size_t *msgs, size_t *bytes,
+                                      size_t *fixedBytes )
+{
+  *msgs = wireMsgs;
+  *bytes = wireBytes;
+  *fixedBytes = wireFixedBytes;
+}
+
+void dmtcp::DmtcpMessage::resetWireStats()
+{
+  wireMsgs = wireBytes = wireFixedBytes = 0;
+}
+
+#define WIRE_FIELD(bit, field)                                              \
+  if ( ( mask & (bit) ) != 0                                                \
+       && memcmp ( &field, &def.field, sizeof ( field ) ) != 0 ) {          \
+    memcpy ( p, &field, sizeof ( field ) );                                 \
+    p += sizeof ( field );                                                  \
+    hdr.fields |= (bit);                                                    \
+  }
+
+size_t dmtcp::DmtcpMessage::encode ( char *buf ) const
+{
+  const DmtcpMessage& def = wireDefault();
+  uint32_t mask = wireFields ( type );
+  DmtcpMessageHeader hdr;
+  char *p = buf + sizeof ( hdr );
+
+  memcpy ( hdr.magic, DMTCP_WIRE_MAGIC, sizeof ( hdr.magic ) );
+  hdr.version = DMTCP_WIRE_VERSION;
+  hdr.type = type;
+  hdr.fields = 0;
+
+  WIRE_FIELD ( DMT_FIELD_FROM, from );
+  WIRE_FIELD ( DMT_FIELD_COORDINATOR, coordinator );
+  WIRE_FIELD ( DMT_FIELD_STATE, state );
+  WIRE_FIELD ( DMT_FIELD_COMPGROUP, compGroup );
+  WIRE_FIELD ( DMT_FIELD_VIRTUALPID, virtualPid );
+  WIRE_FIELD ( DMT_FIELD_RESTOREPID, restorePid );
+  if ( ( mask & DMT_FIELD_RESTOREADDR ) != 0 && restoreAddrlen > 0 ) {
+    JASSERT ( restoreAddrlen <= sizeof ( restoreAddr ) ) ( restoreAddrlen );
+    memcpy ( p, &restoreAddrlen, sizeof ( restoreAddrlen ) );
+    p += sizeof ( restoreAddrlen );
+    memcpy ( p, &restoreAddr, restoreAddrlen );
+    p += restoreAddrlen;
+    hdr.fields |= DMT_FIELD_RESTOREADDR;
+  }
+  WIRE_FIELD ( DMT_FIELD_RESTOREPORT, restorePort );
+  WIRE_FIELD ( DMT_FIELD_CKPT_INTERVAL, theCheckpointInterval );
+  WIRE_FIELD ( DMT_FIELD_PARAMS, params );
+  WIRE_FIELD ( DMT_FIELD_EXTRABYTES, extraBytes );
+#ifdef EXTERNAL_SOCKET_HANDLING
+  if ( ( mask & DMT_FIELD_EXTERNAL ) != 0 ) {
+    memcpy ( p, &conId, sizeof ( conId ) );
+    p += sizeof ( conId );
+    memcpy ( p, &localAddr, sizeof ( localAddr ) );
+    p += sizeof ( localAddr );
+    memcpy ( p, &localAddrlen, sizeof ( localAddrlen ) );
+    p += sizeof ( localAddrlen );
+    memcpy ( p, &remoteAddr, sizeof ( remoteAddr ) );
+    p += sizeof ( remoteAddr );
+    hdr.fields |= DMT_FIELD_EXTERNAL;
+  }
+#endif
+
+  hdr.bodyLen = p - buf - sizeof ( hdr );
+  memcpy ( buf, &hdr, sizeof ( hdr ) );
+  countWireMsg ( p - buf, extraBytes );
+  return p - buf;
+}
+
+#undef WIRE_FIELD
+#define WIRE_FIELD(bit, field)                                              \
+  if ( ( hdr.fields & (bit) ) != 0 ) {                                      \
+    JASSERT ( p + sizeof ( field ) <= end ) ( hdr.fields ) ( hdr.bodyLen ); \
+    memcpy ( &field, p, sizeof ( field ) );                                 \
+    p += sizeof ( field );                                                  \
+  }
+
+/* hdr has already been read from sock; read the body and fill in *this.  On
+ * a short read or a bad header, *this is left poisoned, so that the caller's
+ * assertValid() fails as it would have for a corrupt fixed-size message.
+ */
+void dmtcp::DmtcpMessage::decode ( const DmtcpMessageHeader& hdr,
+                                   jalib::JSocket& sock )
+{
+  char body[DMTCPMESSAGE_MAX_WIRE_SIZE];
+
+  poison();
+  if ( memcmp ( hdr.magic, DMTCP_WIRE_MAGIC, sizeof ( hdr.magic ) ) != 0 ) {
+    return;
+  }
+  JASSERT ( hdr.version == DMTCP_WIRE_VERSION )
+    ( hdr.version ) ( DMTCP_WIRE_VERSION )
+    .Text ( "coordinator protocol version mismatch;"
+            " are all processes running the same DMTCP?" );
+  if ( hdr.bodyLen > sizeof ( body ) ||
+       ( hdr.bodyLen > 0 &&
+         sock.readAll ( body, hdr.bodyLen ) != (ssize_t) hdr.bodyLen ) ) {
+    return;
+  }
+
+  const char *p = body;
+  const char *end = body + hdr.bodyLen;
+  *this = wireDefault();
+  type = (DmtcpMessageType) hdr.type;
+  WIRE_FIELD ( DMT_FIELD_FROM, from );
+  WIRE_FIELD ( DMT_FIELD_COORDINATOR, coordinator );
+  WIRE_FIELD ( DMT_FIELD_STATE, state );
+  WIRE_FIELD ( DMT_FIELD_COMPGROUP, compGroup );
+  WIRE_FIELD ( DMT_FIELD_VIRTUALPID, virtualPid );
+  WIRE_FIELD ( DMT_FIELD_RESTOREPID, restorePid );
+  if ( ( hdr.fields & DMT_FIELD_RESTOREADDR ) != 0 ) {
+    JASSERT ( p + sizeof ( restoreAddrlen ) <= end ) ( hdr.bodyLen );
+    memcpy ( &restoreAddrlen, p, sizeof ( restoreAddrlen ) );
+    p += sizeof ( restoreAddrlen );
+    JASSERT ( restoreAddrlen <= sizeof ( restoreAddr )
+              && p + restoreAddrlen <= end ) ( restoreAddrlen );
+    memcpy ( &restoreAddr, p, restoreAddrlen );
+    p += restoreAddrlen;
+  }
+  WIRE_FIELD ( DMT_FIELD_RESTOREPORT, restorePort );
+  WIRE_FIELD ( DMT_FIELD_CKPT_INTERVAL, theCheckpointInterval );
+  WIRE_FIELD ( DMT_FIELD_PARAMS, params );
+  WIRE_FIELD ( DMT_FIELD_EXTRABYTES, extraBytes );
+#ifdef EXTERNAL_SOCKET_HANDLING
+  WIRE_FIELD ( DMT_FIELD_EXTERNAL, conId );
+  WIRE_FIELD ( DMT_FIELD_EXTERNAL, localAddr );
+  WIRE_FIELD ( DMT_FIELD_EXTERNAL, localAddrlen );
+  WIRE_FIELD ( DMT_FIELD_EXTERNAL, remoteAddr );
+#endif
+  JASSERT ( p == end ) ( hdr.fields ) ( hdr.bodyLen )
+    .Text ( "read invalid message, unknown fields." );
+  countWireMsg ( sizeof ( hdr ) + hdr.bodyLen, extraBytes );
+}
+
+#undef WIRE_FIELD
+
+template <>
+jalib::JSocket& jalib::JSocket::operator<< <dmtcp::DmtcpMessage>
+  ( const dmtcp::DmtcpMessage& msg )
+{
+  char buf[DMTCPMESSAGE_MAX_WIRE_SIZE];
+  writeAll ( buf, msg.encode ( buf ) );
+  return *this;
+}
+
+template <>
+jalib::JSocket& jalib::JSocket::operator>> <dmtcp::DmtcpMessage>
+  ( dmtcp::DmtcpMessage& msg )
+{
+  dmtcp::DmtcpMessageHeader hdr;
+  if ( readAll ( ( char* ) &hdr, sizeof ( hdr ) ) != sizeof ( hdr ) ) {
+    msg.poison();
+    return *this;
+  }
+  msg.decode ( hdr, *this );
+  return *this;
+}
+
 
 dmtcp::WorkerState::eWorkerState dmtcp::WorkerState::value() const
 {
@@ -155,6 +385,8 @@ dmtcp::ostream& dmtcp::operator << ( dmtcp::ostream& o, const dmtcp::DmtcpMessag
       OSHIFTPRINTF ( DMT_HELLO_COORDINATOR )
       OSHIFTPRINTF ( DMT_HELLO_WORKER )
       OSHIFTPRINTF ( DMT_UPDATE_PROCESS_INFO_AFTER_FORK )
+      OSHIFTPRINTF ( DMT_UPDATE_PROCESS_INFO_AFTER_EXEC )
+      OSHIFTPRINTF ( DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK )
       OSHIFTPRINTF ( DMT_GET_VIRTUAL_PID )
       OSHIFTPRINTF ( DMT_GET_VIRTUAL_PID_RESULT )
 
@@ -27,7 +27,9 @@
 #include "../jalib/jassert.h"
 #include "../jalib/jalloc.h"
 #include "constants.h"
+#include "../jalib/jsocket.h"
 #include <string.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include "connectionidentifier.h"
@@ -42,6 +44,8 @@ namespace dmtcp
     DMT_HELLO_COORDINATOR,   // on connect established worker-coordinator
     DMT_HELLO_WORKER,        // on connect established coordinator-worker
     DMT_UPDATE_PROCESS_INFO_AFTER_FORK,
+    DMT_UPDATE_PROCESS_INFO_AFTER_EXEC, // reuses the pre-exec connection
+    DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK,
 
     DMT_GET_VIRTUAL_PID,
     DMT_GET_VIRTUAL_PID_RESULT,
@@ -155,6 +159,15 @@ namespace dmtcp
     }
   };
 
+  struct DmtcpMessageHeader
+  {
+    char     magic[4];
+    uint16_t version;
+    uint16_t type;
+    uint32_t fields;
+    uint32_t bodyLen;
+  };
+
 #define DMTCPMESSAGE_NUM_PARAMS 2
 #define DMTCPMESSAGE_SAME_CKPT_INTERVAL (-1) /* default value */
 
@@ -183,18 +196,15 @@ namespace dmtcp
     struct sockaddr_storage remoteAddr;
 #endif
 
-//#ifdef COORD_NAMESERVICE
-    size_t                  keyLen;
-    size_t                  valLen;
-//#endif
-
     int theCheckpointInterval;
 
     //message type specific parameters
     int params[DMTCPMESSAGE_NUM_PARAMS];
 
     //extraBytes are used for passing checkpoint filename to coordinator it
-    //must be zero in all messages except for in DMT_CKPT_FILENAME
+    //must be zero in all messages except for in DMT_CKPT_FILENAME,
+    //DMT_RESTORE_WAITING (params[0] ConnectionIdentifiers) and the name
+    //service messages
     size_t extraBytes;
 
     static void setDefaultCoordinator ( const UniquePid& id );
@@ -202,6 +212,54 @@ namespace dmtcp
     void assertValid() const;
     bool isValid() const;
     void poison();
+
+    size_t encode ( char *buf ) const;
+    void decode ( const DmtcpMessageHeader& hdr, jalib::JSocket& sock );
+
+    static void wireStats ( size_t *msgs, size_t *bytes, size_t *fixedBytes );
+    static void resetWireStats();
+  };
+
+  /* Wire format:  a DmtcpMessage is sent as a DmtcpMessageHeader followed by
+   * hdr.bodyLen bytes holding the fields named in hdr.fields, in the order of
+   * the DMT_FIELD_* bits.  A field is sent only if the message type uses it
+   * and it differs from its default; the receiver sees the default for any
+   * other field.  extraBytes of payload, if any, follow the message as before.
+   * JSocket::operator<< and operator>> below encode and decode a DmtcpMessage;
+   * readers that see the header first (JChunkReader) call decode() directly.
+   */
+#define DMTCP_WIRE_MAGIC   "DMTw"
+#define DMTCP_WIRE_VERSION 2
+#define DMTCPMESSAGE_MAX_WIRE_SIZE                                           \
+  ( sizeof ( dmtcp::DmtcpMessageHeader ) + sizeof ( dmtcp::DmtcpMessage )    \
+    + 16 )
+
+  enum DmtcpMessageField
+  {
+    DMT_FIELD_FROM          = 0x0001,
+    DMT_FIELD_COORDINATOR   = 0x0002,
+    DMT_FIELD_STATE         = 0x0004,
+    DMT_FIELD_COMPGROUP     = 0x0008,
+    DMT_FIELD_VIRTUALPID    = 0x0010,
+    DMT_FIELD_RESTOREPID    = 0x0020,
+    DMT_FIELD_RESTOREADDR   = 0x0040,
+    DMT_FIELD_RESTOREPORT   = 0x0080,
+    DMT_FIELD_CKPT_INTERVAL = 0x0100,
+    DMT_FIELD_PARAMS        = 0x0200,
+    DMT_FIELD_EXTRABYTES    = 0x0400,
+    DMT_FIELD_EXTERNAL      = 0x0800,
+    DMT_FIELD_ALL           = 0x0fff
+  };
+
+  /* Name service messages (DMT_REGISTER_NAME_SERVICE_DATA,
+   * DMT_NAME_SERVICE_QUERY and DMT_NAME_SERVICE_QUERY_RESPONSE) carry
+   * params[0] entries in their extraBytes, each one a DmtcpNameServiceEntry
+   * followed by the key and then the value (no value in a query).
+   */
+  struct DmtcpNameServiceEntry
+  {
+    uint32_t keyLen;
+    uint32_t valLen;
   };
 
 
@@ -211,6 +269,16 @@ namespace dmtcp
 
 }//namespace dmtcp
 
+namespace jalib
+{
+  template <>
+  JSocket& JSocket::operator<< <dmtcp::DmtcpMessage>
+    ( const dmtcp::DmtcpMessage& msg );
+  template <>
+  JSocket& JSocket::operator>> <dmtcp::DmtcpMessage>
+    ( dmtcp::DmtcpMessage& msg );
+}
+
 
 
 #endif
@@ -4,14 +4,175 @@
 #include "protectedfds.h"
 #include "dmtcpworker.h"
 #include "dmtcpmessagetypes.h"
+#include "../jalib/jtimer.h"
 
 using namespace dmtcp;
 
+/* Handlers registered with dmtcp_register_event_handler(), and for each
+ * event, the handlers subscribed to it.  Plugins register from their
+ * constructors, possibly before dmtcphijack.so is initialized, so these are
+ * plain static arrays.
+ */
+#define MAX_EVENT_HANDLERS 32
+static struct {
+  const char *name;
+  DmtcpEventHandler_t handler;
+  double ckptTime; // seconds spent in this checkpoint or restart
+} eventHandlers[MAX_EVENT_HANDLERS];
+static int numEventHandlers = 0;
+static unsigned char eventSubscribers[nDmtcpEvents][MAX_EVENT_HANDLERS];
+static int numEventSubscribers[nDmtcpEvents];
+
+/* Set once DMTCP_EVENT_INIT has been dispatched.  Preloaded libraries run
+ * their constructors in reverse LD_PRELOAD order, so plugins that come
+ * before dmtcphijack.so (ptracehijack.so, DMTCP_PLUGIN libraries) register
+ * after the DmtcpWorker constructor raised DMTCP_EVENT_INIT; it is replayed
+ * for them when they register.
+ */
+static bool initDispatched = false;
+
+/* Whether some plugin defines dmtcp_process_event() itself (-1: not looked
+ * up yet).  Looked up at DMTCP_EVENT_INIT, as dlsym() is not safe once user
+ * threads are suspended; all preloaded libraries are loaded by then.
+ */
+static int pluginsDefineProcessEvent = -1;
+
+/* Subscribers to DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG when it was last raised.
+ * The checkpoint thread may raise it before the plugins registered above
+ * have; dmtcp_replay_wait_for_suspend_msg() raises it for them.
+ */
+static int waitForSuspendMsgSubscribers = 0;
+
+/* Handlers may register while another thread dispatches events (the
+ * checkpoint thread, see above).  A new entry is filled in before the count
+ * that makes it visible is raised, with a barrier in between; the
+ * dispatchers read the count, then a barrier, then the entries.
+ */
+EXTERNC void dmtcp_register_event_handler(const char *name,
+                                          DmtcpEventHandler_t handler,
+                                          DmtcpEventMask_t events)
+{
+  JASSERT(numEventHandlers < MAX_EVENT_HANDLERS) (name) (numEventHandlers);
+  int h = numEventHandlers;
+  eventHandlers[h].name = name;
+  eventHandlers[h].handler = handler;
+  eventHandlers[h].ckptTime = 0;
+  __sync_synchronize();
+  numEventHandlers = h + 1;
+  for (int e = 0; e < nDmtcpEvents; e++) {
+    if (events & DMTCP_EVENT_MASK(e)) {
+      int n = numEventSubscribers[e];
+      eventSubscribers[e][n] = h;
+      __sync_synchronize();
+      numEventSubscribers[e] = n + 1;
+    }
+  }
+  if (initDispatched && (events & DMTCP_EVENT_MASK(DMTCP_EVENT_INIT))) {
+    handler(DMTCP_EVENT_INIT, NULL);
+  }
+}
+
+static bool lookupPluginsDefineProcessEvent()
+{
+  if (pluginsDefineProcessEvent == -1) {
+    void *first = dlsym(RTLD_DEFAULT, "dmtcp_process_event");
+    pluginsDefineProcessEvent =
+      (first != NULL && first != (void*) &dmtcp_process_event) ||
+      NEXT_FNC(dmtcp_process_event) != NULL;
+  }
+  return pluginsDefineProcessEvent;
+}
+
+/* True if some plugin may act on this event: a handler subscribed to it, or
+ * a plugin that defines dmtcp_process_event() itself, before or after
+ * dmtcphijack.so in LD_PRELOAD, and so sees every event.
+ */
+LIB_PRIVATE bool dmtcp_event_has_handlers(DmtcpEvent_t id)
+{
+  return numEventSubscribers[id] > 0 || lookupPluginsDefineProcessEvent();
+}
+
+// Events raised once per thread; these are not timed.
+static bool isPerThreadEvent(DmtcpEvent_t id)
+{
+  switch (id) {
+    case DMTCP_EVENT_THREAD_START:
+    case DMTCP_EVENT_THREAD_CREATED:
+    case DMTCP_EVENT_PTHREAD_START:
+    case DMTCP_EVENT_PTHREAD_EXIT:
+    case DMTCP_EVENT_PTHREAD_RETURN:
+    case DMTCP_EVENT_PRE_SUSPEND_USER_THREAD:
+    case DMTCP_EVENT_PRE_RESUME_USER_THREAD:
+    case DMTCP_EVENT_RESUME_USER_THREAD:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void reportEventHandlerTimes(DmtcpEvent_t id)
+{
+  int n = numEventHandlers;
+  __sync_synchronize();
+  for (int h = 0; h < n; h++) {
+    JTRACE("Time spent in plugin event handler") (eventHandlers[h].name)
+      (eventHandlers[h].ckptTime)
+      (id == DMTCP_EVENT_POST_RESTART_RESUME ? "restart" : "checkpoint");
+    eventHandlers[h].ckptTime = 0;
+  }
+}
+
 EXTERNC void dmtcp_process_event(DmtcpEvent_t id, void* data)
 {
+  if (id == DMTCP_EVENT_INIT) {
+    lookupPluginsDefineProcessEvent();
+    // Handlers registered from here on get DMTCP_EVENT_INIT when they
+    // register; n below doesn't count them.
+    initDispatched = true;
+  }
+  int n = numEventSubscribers[id];
+  __sync_synchronize();
+  if (id == DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG) {
+    waitForSuspendMsgSubscribers = n;
+  }
+  if (n > 0) {
+    if (isPerThreadEvent(id)) {
+      for (int i = 0; i < n; i++) {
+        eventHandlers[eventSubscribers[id][i]].handler(id, data);
+      }
+    } else {
+      for (int i = 0; i < n; i++) {
+        int h = eventSubscribers[id][i];
+        jalib::JTime start;
+        eventHandlers[h].handler(id, data);
+        eventHandlers[h].ckptTime += jalib::JTime::Now() - start;
+      }
+    }
+  }
+
+  if (id == DMTCP_EVENT_POST_CKPT_RESUME ||
+      id == DMTCP_EVENT_POST_RESTART_RESUME) {
+    reportEventHandlerTimes(id);
+  }
+
   NEXT_DMTCP_PROCESS_EVENT(id, data);
 }
 
+/* Called by the checkpoint thread once the suspend message arrived: raises
+ * DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG for handlers that registered while it
+ * was waiting, on the thread that the event is meant for.
+ */
+LIB_PRIVATE void dmtcp_replay_wait_for_suspend_msg()
+{
+  int n = numEventSubscribers[DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG];
+  __sync_synchronize();
+  for (int i = waitForSuspendMsgSubscribers; i < n; i++) {
+    int h = eventSubscribers[DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG][i];
+    eventHandlers[h].handler(DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG, NULL);
+  }
+  waitForSuspendMsgSubscribers = n;
+}
+
 EXTERNC int  dmtcp_get_ckpt_signal()
 {
   const int ckpt_signal = dmtcp::DmtcpWorker::determineMtcpSignal();
@@ -126,72 +287,111 @@ EXTERNC void dmtcp_unblock_ckpt_signal()
   JASSERT(_real_pthread_sigmask (SIG_UNBLOCK, &signals_set, NULL) == 0);
 }
 
-EXTERNC int dmtcp_send_key_val_pair_to_coordinator(const void *key,
-                                                   size_t key_len,
-                                                   const void *val,
-                                                   size_t val_len)
+/* Name service registrations are batched: they are sent in one
+ * DMT_REGISTER_NAME_SERVICE_DATA message when the worker next talks to the
+ * coordinator (see dmtcp_flush_name_service_data()).  Only the checkpoint
+ * thread uses the name service.
+ */
+static dmtcp::vector<char> *pendingNameServiceData = NULL;
+static int numPendingNameServiceEntries = 0;
+
+static void appendNameServiceEntry(dmtcp::vector<char>& buf,
+                                   const void *key, size_t key_len,
+                                   const void *val, size_t val_len)
 {
-  char *extraData = new char[key_len + val_len];
-  memcpy(extraData, key, key_len);
-  memcpy(extraData + key_len, val, val_len);
+  DmtcpNameServiceEntry e;
+  e.keyLen = key_len;
+  e.valLen = val_len;
+  buf.insert(buf.end(), (const char*) &e, (const char*) (&e + 1));
+  buf.insert(buf.end(), (const char*) key, (const char*) key + key_len);
+  buf.insert(buf.end(), (const char*) val, (const char*) val + val_len);
+}
 
+LIB_PRIVATE void dmtcp_flush_name_service_data()
+{
+  if (numPendingNameServiceEntries == 0) {
+    return;
+  }
   DmtcpMessage msg (DMT_REGISTER_NAME_SERVICE_DATA);
-  msg.keyLen = key_len;
-  msg.valLen = val_len;
-  msg.extraBytes = key_len + val_len;
+  msg.params[0] = numPendingNameServiceEntries;
+  msg.extraBytes = pendingNameServiceData->size();
 
   DmtcpWorker::instance().coordinatorSocket() << msg;
-  DmtcpWorker::instance().coordinatorSocket().writeAll(extraData,
-                                                       msg.extraBytes);
-  delete [] extraData;
+  DmtcpWorker::instance().coordinatorSocket().writeAll(
+    &(*pendingNameServiceData)[0], msg.extraBytes);
+  pendingNameServiceData->clear();
+  numPendingNameServiceEntries = 0;
+}
+
+EXTERNC int dmtcp_send_key_val_pair_to_coordinator(const void *key,
+                                                   size_t key_len,
+                                                   const void *val,
+                                                   size_t val_len)
+{
+  if (pendingNameServiceData == NULL) {
+    pendingNameServiceData = new dmtcp::vector<char>();
+  }
+  appendNameServiceEntry(*pendingNameServiceData, key, key_len, val, val_len);
+  numPendingNameServiceEntries++;
   return 1;
 }
 
-// On input, val points to a buffer in user memory and *val_len is the maximum
-//   size of that buffer (the memory allocated by user).
-// On output, we copy data to val, and set *val_len to the actual buffer size
-//   (to the size of the data that we copied to the user buffer).
-EXTERNC int dmtcp_send_query_to_coordinator(const void *key, size_t key_len,
-                                            void *val, size_t *val_len)
+/* Sends n queries to the coordinator in one DMT_NAME_SERVICE_QUERY message
+ * and reads all of the answers from the one reply.  On input, vals[i] points
+ * to a buffer of val_lens[i] bytes; on output, val_lens[i] is the size of the
+ * value copied there.
+ */
+EXTERNC int dmtcp_send_queries_batch(size_t n, const void **keys,
+                                     const size_t *key_lens, void **vals,
+                                     size_t *val_lens)
 {
-  /* THE USER JUST GAVE US A BUFFER, val.  WHY ARE WE ALLOCATING
-   * EXTRA MEMORY HERE?  ALLOCATING MEMORY IS DANGEROUS.  WE ARE A GUEST
-   * IN THE USER'S PROCESS.  IF WE NEED TO, CREATE A message CONSTRUCTOR
-   * AROUND THE USER'S 'key' INPUT.
-   *   ALSO, SINCE THE USER GAVE US *val_len * CHARS OF MEMORY, SHOULDN'T
-   * WE BE SETTING msg.extraBytes TO *val_len AND NOT key_len?
-   * ANYWAY, WHY DO WE USE THE SAME msg OBJECT FOR THE "send key"
-   * AND FOR THE "return val"?  IT'S NOT TO SAVE MEMORY.  :-)
-   * THANKS, - Gene
-   */
-  char *extraData = new char[key_len];
-  memcpy(extraData, key, key_len);
+  if (n == 0) {
+    return 1;
+  }
+  dmtcp::vector<char> buf;
+  for (size_t i = 0; i < n; i++) {
+    appendNameServiceEntry(buf, keys[i], key_lens[i], NULL, 0);
+  }
 
-  DmtcpMessage msg (DMT_NAME_SERVICE_QUERY);
-  msg.keyLen = key_len;
-  msg.valLen = 0;
-  msg.extraBytes = key_len;
+  dmtcp_flush_name_service_data();
 
+  DmtcpMessage msg (DMT_NAME_SERVICE_QUERY);
+  msg.params[0] = n;
+  msg.extraBytes = buf.size();
   DmtcpWorker::instance().coordinatorSocket() << msg;
-  DmtcpWorker::instance().coordinatorSocket().writeAll(extraData,
-                                                       msg.extraBytes);
-  delete [] extraData;
+  DmtcpWorker::instance().coordinatorSocket().writeAll(&buf[0], buf.size());
 
   msg.poison();
-
   DmtcpWorker::instance().coordinatorSocket() >> msg;
   msg.assertValid();
-
   JASSERT(msg.type == DMT_NAME_SERVICE_QUERY_RESPONSE &&
-          msg.extraBytes > 0 && (msg.valLen + msg.keyLen) == msg.extraBytes);
-
-  extraData = new char[msg.extraBytes];
-  DmtcpWorker::instance().coordinatorSocket().readAll(extraData,
-                                                      msg.extraBytes);
-  //TODO: FIXME --> enforce the JASSERT
-  JASSERT(msg.extraBytes <= *val_len + key_len);
-  memcpy(val, extraData + key_len, msg.extraBytes-key_len);
-  *val_len = msg.valLen;
-  delete [] extraData;
+          msg.params[0] == (int) n && msg.extraBytes > 0)
+    (msg.type) (msg.params[0]) (n) (msg.extraBytes);
+
+  buf.resize(msg.extraBytes);
+  DmtcpWorker::instance().coordinatorSocket().readAll(&buf[0], buf.size());
+
+  const char *p = &buf[0];
+  for (size_t i = 0; i < n; i++) {
+    DmtcpNameServiceEntry e;
+    memcpy(&e, p, sizeof(e));
+    p += sizeof(e);
+    JASSERT(e.keyLen == key_lens[i] && e.valLen <= val_lens[i])
+      (e.keyLen) (key_lens[i]) (e.valLen) (val_lens[i]);
+    memcpy(vals[i], p + e.keyLen, e.valLen);
+    val_lens[i] = e.valLen;
+    p += e.keyLen + e.valLen;
+  }
+  JASSERT(p == &buf[0] + buf.size());
   return 1;
 }
+
+// On input, val points to a buffer in user memory and *val_len is the maximum
+//   size of that buffer (the memory allocated by user).
+// On output, we copy data to val, and set *val_len to the actual buffer size
+//   (to the size of the data that we copied to the user buffer).
+EXTERNC int dmtcp_send_query_to_coordinator(const void *key, size_t key_len,
+                                            void *val, size_t *val_len)
+{
+  return dmtcp_send_queries_batch(1, &key, &key_len, &val, val_len);
+}
@@ -81,6 +81,37 @@ typedef struct DmtcpResumeUserThreadInfo {
   int is_restart;
 } DmtcpResumeUserThreadInfo;
 
+/* Instead of defining dmtcp_process_event() and forwarding every event with
+ * NEXT_DMTCP_PROCESS_EVENT, a plugin may register a handler for just the
+ * events it cares about, usually from a constructor function:
+ *
+ *   static void myEventHandler(DmtcpEvent_t event, void *data) { ... }
+ *   static void __attribute__ ((constructor)) myInit()
+ *   {
+ *     dmtcp_register_event_handler("myplugin", myEventHandler,
+ *                                  DMTCP_EVENT_MASK(DMTCP_EVENT_PRE_CKPT) |
+ *                                  DMTCP_EVENT_MASK(DMTCP_EVENT_POST_RESTART));
+ *   }
+ *
+ * The handler is called only for those events, after any plugin that still
+ * defines dmtcp_process_event() and comes before dmtcphijack.so in
+ * LD_PRELOAD.  Handlers are called in the order they were registered.  A
+ * handler registered after DMTCP_EVENT_INIT was raised (as it is for
+ * libraries that come before dmtcphijack.so in LD_PRELOAD, whose
+ * constructors run later) gets DMTCP_EVENT_INIT from within
+ * dmtcp_register_event_handler(), if it subscribed to it.  Events
+ * that happen once per thread (thread creation and exit, user thread suspend
+ * and resume) then cost nothing for the plugins that ignore them.
+ */
+typedef unsigned long long DmtcpEventMask_t;
+#define DMTCP_EVENT_MASK(event) (1ULL << (event))
+#define DMTCP_EVENT_MASK_ALL (~0ULL)
+typedef void (*DmtcpEventHandler_t)(DmtcpEvent_t event, void *data);
+
+EXTERNC void dmtcp_register_event_handler(const char *name,
+                                          DmtcpEventHandler_t handler,
+                                          DmtcpEventMask_t events);
+
 EXTERNC int dmtcp_plugin_disable_ckpt(void);
 EXTERNC void dmtcp_plugin_enable_ckpt(void);
 EXTERNC void dmtcp_process_event(DmtcpEvent_t event, void* data);
@@ -90,6 +121,13 @@ EXTERNC int dmtcp_send_key_val_pair_to_coordinator(const void *key,
                                                    size_t val_len);
 EXTERNC int dmtcp_send_query_to_coordinator(const void *key, size_t key_len,
                                             void *val, size_t *val_len);
+/* Like n calls to dmtcp_send_query_to_coordinator(), in one round trip.
+ * val_lens[i] is the size of the buffer vals[i] on input, and the size of
+ * the value on output.
+ */
+EXTERNC int dmtcp_send_queries_batch(size_t n, const void **keys,
+                                     const size_t *key_lens, void **vals,
+                                     size_t *val_lens);
 
 EXTERNC const char* dmtcp_get_tmpdir();
 EXTERNC void dmtcp_set_tmpdir(const char *);
@@ -54,6 +54,7 @@
 #ifndef ANDROID
 #include "sysvipc.h"
 #endif
+#include "sharedfileareas.h"
 #include  "../jalib/jsocket.h"
 #include  "../jalib/jfilesystem.h"
 #include  "../jalib/jconvert.h"
@@ -75,11 +76,27 @@ static bool _waitingForExternalSocketsToClose = false;
 LIB_PRIVATE void pthread_atfork_prepare();
 LIB_PRIVATE void pthread_atfork_parent();
 LIB_PRIVATE void pthread_atfork_child();
+LIB_PRIVATE bool dmtcp_event_has_handlers(DmtcpEvent_t id);
+LIB_PRIVATE void dmtcp_flush_name_service_data();
 
 static pthread_mutex_t syncLock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t syncCond = PTHREAD_COND_INITIALIZER;
 
 bool dmtcp::DmtcpWorker::_exitInProgress = false;
+// Set while the coordinator has not yet acknowledged our exec() (see
+// informCoordinatorOfExec); cleared by the checkpoint thread.
+volatile bool dmtcp::DmtcpWorker::_execAckPending = false;
+// Set when the coordinator tells us (with DMT_DO_FD_LEADER_ELECTION) that
+// this checkpoint needs no barriers before DMT_DO_RESUME.
+bool dmtcp::DmtcpWorker::_skipBarriers = false;
+
+// Checked at every checkpoint: plugins that come before dmtcphijack.so in
+// LD_PRELOAD register their handlers after DMTCP_EVENT_INIT.
+static bool pluginsUseNameService()
+{
+  return dmtcp_event_has_handlers(DMTCP_EVENT_REGISTER_NAME_SERVICE_DATA) ||
+         dmtcp_event_has_handlers(DMTCP_EVENT_SEND_QUERIES);
+}
 
 static void processDmtcpCommands(dmtcp::string programName,
                                  dmtcp::vector<dmtcp::string>& args);
@@ -244,8 +261,13 @@ static void writeCurrentLogFileNameToPrevLogFile(dmtcp::string& path)
 #endif
 }
 
-static void prepareLogAndProcessdDataFromSerialFile()
+/* Returns true if this process exec()'d and may keep using the coordinator
+ * connection of the previous program.
+ */
+static bool prepareLogAndProcessdDataFromSerialFile(
+                                       dmtcp::DmtcpCoordinatorAPI& coordinatorAPI)
 {
+  bool reuseCoordinatorConnection = false;
   const char* serialFile = getenv( ENV_VAR_SERIALFILE_INITIAL );
   //dmtcp::VirtualPidTable::instance().updateMapping(getpid(), _real_getpid());
   if ( serialFile != NULL ) {
@@ -254,20 +276,30 @@ static void prepareLogAndProcessdDataFromSerialFile()
     // of the new log file into that one.
     dmtcp::string prevLogFilePath = getLogFilePath();
 
-    jalib::JBinarySerializeReader rd ( serialFile );
-    UniquePid::serialize ( rd );
-    Util::initializeLogFile("", prevLogFilePath);
+    int fd = jalib::StringToInt(serialFile);
+    {
+      // rd buffers its reads; it must be gone before fd is closed.
+      jalib::JBinarySerializeReaderRaw rd ( "dmtcpConTable", fd );
+      rd.rewind();
+      UniquePid::serialize ( rd );
+      Util::initializeLogFile("", prevLogFilePath);
 
-    writeCurrentLogFileNameToPrevLogFile(prevLogFilePath);
+      writeCurrentLogFileNameToPrevLogFile(prevLogFilePath);
 
-    JTRACE ( "loading initial socket table from file..." ) ( serialFile );
-    KernelDeviceToConnection::instance().serialize ( rd );
+      JTRACE ( "loading initial socket table from fd..." ) ( fd );
+      KernelDeviceToConnection::instance().serialize ( rd );
 
-    ProcessInfo::instance().serialize ( rd );
-    ProcessInfo::instance().postExec();
+      ProcessInfo::instance().serialize ( rd );
+      ProcessInfo::instance().postExec();
 #ifndef ANDROID
-    SysVIPC::instance().serialize ( rd );
+      SysVIPC::instance().serialize ( rd );
 #endif
+      rd & reuseCoordinatorConnection;
+      if (reuseCoordinatorConnection) {
+        coordinatorAPI.serialize ( rd );
+      }
+    }
+    _real_close(fd);
     _dmtcp_unsetenv(ENV_VAR_SERIALFILE_INITIAL);
   } else {
     //dmtcp::VirtualPidTable::instance().updateMapping(getppid(), _real_getppid());
@@ -281,12 +313,12 @@ static void prepareLogAndProcessdDataFromSerialFile()
       _dmtcp_unsetenv(ENV_VAR_ROOT_PROCESS);
     }
 
-    JTRACE("Checking for pre-existing sockets");
-    ConnectionList::instance().scanForPreExisting();
+    ConnectionList::instance().notePreExisting();
   }
 
   JTRACE ("Initial socket table:");
   KernelDeviceToConnection::instance().dbgSpamFds();
+  return reuseCoordinatorConnection;
 }
 
 static void processRlimit()
@@ -319,12 +351,17 @@ static void processRlimit()
 //workerhijack.cpp initializes a static variable theInstance to DmtcpWorker obj
 dmtcp::DmtcpWorker::DmtcpWorker ( bool enableCheckpointing )
 {
+  bool reuseCoordinatorConnection;
   if ( !enableCheckpointing ) return;
   else {
+    dmtcp::Util::startupTraceBegin();
     WorkerState::setCurrentState( WorkerState::UNKNOWN);
     initializeJalib();
+    dmtcp::Util::startupTraceStep("jalib");
     prepareDmtcpWrappers();
-    prepareLogAndProcessdDataFromSerialFile();
+    dmtcp::Util::startupTraceStep("wrappers");
+    reuseCoordinatorConnection = prepareLogAndProcessdDataFromSerialFile(*this);
+    dmtcp::Util::startupTraceStep("log+fdtable");
   }
 
   JTRACE ( "dmtcphijack.so:  Running " )
@@ -356,13 +393,21 @@ dmtcp::DmtcpWorker::DmtcpWorker ( bool enableCheckpointing )
     processSshCommand(programName, args);
   }
   calculateArgvAndEnvSize();
+  dmtcp::Util::startupTraceStep("rlimit+args");
 
   WorkerState::setCurrentState ( WorkerState::RUNNING );
 
-  connectToCoordinatorWithHandshake();
+  if (reuseCoordinatorConnection) {
+    informCoordinatorOfExec();
+    _execAckPending = true;
+  } else {
+    connectToCoordinatorWithHandshake();
+  }
+  dmtcp::Util::startupTraceStep("coordinator");
 
   // define "Weak Symbols for each library plugin in dmtcphijack.so
   dmtcp_process_event(DMTCP_EVENT_INIT, NULL);
+  dmtcp::Util::startupTraceStep("plugins");
 
   /* Acquire the lock here, so that the checkpoint-thread won't be able to
    * process CHECKPOINT request until we are done with initializeMtcpEngine()
@@ -374,15 +419,16 @@ dmtcp::DmtcpWorker::DmtcpWorker ( bool enableCheckpointing )
   } else { // else trying to call weak symbol, which is undefined
     JASSERT(false).Text("initializeMtcpEngine should not be called");
   }
+  dmtcp::Util::startupTraceStep("mtcp");
 
   /* Now wait for Checkpoint Thread to finish initialization
    * NOTE: This should be the last thing in this constructor
    */
   ThreadSync::initMotherOfAll();
-  while (!ThreadSync::isCheckpointThreadInitialized()) {
-    struct timespec sleepTime = {0, 10*1000*1000};
-    nanosleep(&sleepTime, NULL);
-  }
+  ThreadSync::waitForCheckpointThreadInitialized();
+  dmtcp::Util::startupTraceStep("ckpt-thread");
+  dmtcp::Util::startupTraceReport("startup",
+                                   jalib::Filesystem::GetProgramName());
 }
 
 void dmtcp::DmtcpWorker::cleanupWorker()
@@ -487,9 +533,34 @@ const dmtcp::UniquePid& dmtcp::DmtcpWorker::coordinatorId() const
 }
 
 
+/* Connections whose checkpoint may involve other processes: anything but
+ * stdio (which is never drained), and SysV shared memory.  Reported to the
+ * coordinator when suspended; see DmtcpCoordinator::onData().
+ */
+static int numConnectionsNeedingBarriers()
+{
+  int n = 0;
+  dmtcp::ConnectionList& connections = dmtcp::ConnectionList::instance();
+  for (dmtcp::ConnectionList::iterator i = connections.begin();
+       i != connections.end(); ++i) {
+    if (i->second->conType() != dmtcp::Connection::STDIO) {
+      n++;
+    }
+  }
+#ifndef ANDROID
+  n += dmtcp::SysVIPC::instance().getShmids().size();
+#endif
+  return n;
+}
+
 void dmtcp::DmtcpWorker::waitForCoordinatorMsg(dmtcp::string msgStr,
                                                DmtcpMessageType type )
 {
+  if ( _skipBarriers && type != DMT_DO_RESUME ) {
+    JTRACE ( "no barrier needed, not waiting for " + msgStr + " message" );
+    return;
+  }
+
   if ( type == DMT_DO_SUSPEND ) {
     if (ThreadSync::destroyDmtcpWorkerLockTryLock() != 0) {
       JTRACE ( "User thread is performing exit()."
@@ -506,6 +577,12 @@ void dmtcp::DmtcpWorker::waitForCoordinatorMsg(dmtcp::string msgStr,
 
   msg.type = DMT_OK;
   msg.state = WorkerState::currentState();
+  if ( type == DMT_DO_FD_LEADER_ELECTION ) {
+    msg.params[0] = numConnectionsNeedingBarriers();
+    msg.params[1] = pluginsUseNameService();
+  }
+  // Registrations made while handling the last event go out ahead of DMT_OK.
+  dmtcp_flush_name_service_data();
   _coordinatorSocket << msg;
 
   JTRACE ( "waiting for " + msgStr + " message" );
@@ -515,6 +592,52 @@ void dmtcp::DmtcpWorker::waitForCoordinatorMsg(dmtcp::string msgStr,
     // select. If // ptrace is disabled, this call has no significant effect.
     _real_syscall(DMTCP_FAKE_SYSCALL);
   }
+
+  if ( type == DMT_DO_SUSPEND && _execAckPending ) {
+    /* We exec()'d and kept the previous program's coordinator connection.
+     * Its checkpoint thread may have read a DMT_DO_SUSPEND just before
+     * exec(); the coordinator's ack tells us whether one was sent.
+     */
+    bool suspendSeen = false;
+    dmtcp::DmtcpMessage ack;
+    do {
+      ack.poison();
+      _coordinatorSocket >> ack;
+
+      if ( exitInProgress() ) {
+        ThreadSync::destroyDmtcpWorkerLockUnlock();
+        pthread_exit(NULL);
+      }
+
+      ack.assertValid();
+
+      if ( ack.type == DMT_KILL_PEER ) {
+        JTRACE ( "Received KILL message from coordinator, exiting" );
+        _exit ( 0 );
+      }
+      if ( ack.type == DMT_SYNCHRONIZE ) {
+        JTRACE ( "Received SYNCHRONIZE message from coordinator" );
+        pthread_mutex_lock(&syncLock);
+        pthread_cond_broadcast(&syncCond);
+        pthread_mutex_unlock(&syncLock);
+      } else if ( ack.type == DMT_DO_SUSPEND ) {
+        suspendSeen = true;
+      } else {
+        JASSERT ( ack.type == DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK )
+          ( ack.type );
+      }
+    } while ( ack.type != DMT_UPDATE_PROCESS_INFO_AFTER_EXEC_ACK );
+    _execAckPending = false;
+    JTRACE ( "Coordinator acknowledged exec()" ) ( suspendSeen )
+      ( ack.params[0] );
+
+    if ( suspendSeen || ack.params[0] != 0 ) {
+      // Same computation information as in the DMT_DO_SUSPEND message.
+      UniquePid::ComputationId() = ack.compGroup;
+      return;
+    }
+  }
+
   do {
     
     JTRACE("BAB in waitForCoordinatorMsg do-while msg.type: \n") (msg.type);
@@ -569,6 +692,7 @@ void dmtcp::DmtcpWorker::waitForCoordinatorMsg(dmtcp::string msgStr,
     ProcessInfo::instance().numPeers(msg.params[0]);
     JASSERT(UniquePid::ComputationId() == msg.compGroup);
     ProcessInfo::instance().compGroup(msg.compGroup);
+    _skipBarriers = msg.params[1] != 0;
   }
 }
 
@@ -647,6 +771,8 @@ void dmtcp::DmtcpWorker::waitForStage2Checkpoint()
 
   JASSERT(_coordinatorSocket.isValid());
   ThreadSync::releaseLocks();
+  // Deferred from startup; the user threads are suspended now.
+  ConnectionList::instance().scanForPreExisting();
   dmtcp_process_event(DMTCP_EVENT_POST_SUSPEND, NULL);
 
   theCheckpointState->preLockSaveOptions();
@@ -661,6 +787,7 @@ void dmtcp::DmtcpWorker::waitForStage2Checkpoint()
 #ifndef ANDROID
   SysVIPC::instance().leaderElection();
 #endif
+  SharedFileAreas::instance().leaderElection();
 
   WorkerState::setCurrentState ( WorkerState::FD_LEADER_ELECTION );
 
@@ -869,6 +996,9 @@ void dmtcp::DmtcpWorker::postRestart()
   JTRACE("begin postRestart()");
 
   WorkerState::setCurrentState(WorkerState::RESTARTING);
+  // The image was written in the middle of a checkpoint; restart always
+  // goes through all the barriers.
+  _skipBarriers = false;
   recvCoordinatorHandshake();
 
   JASSERT ( theCheckpointState != NULL );
@@ -878,6 +1008,7 @@ void dmtcp::DmtcpWorker::postRestart()
 #ifndef ANDROID
   SysVIPC::instance().postRestart();
 #endif
+  SharedFileAreas::instance().postRestart();
 
 }
 
@@ -921,10 +1052,12 @@ void dmtcp::DmtcpWorker::waitForStage4Resume()
   WorkerState::setCurrentState ( WorkerState::REFILLED );
   waitForCoordinatorMsg ( "RESUME", DMT_DO_RESUME );
   JTRACE ( "got resume message" );
+  _skipBarriers = false;
 
 #ifndef ANDROID
   SysVIPC::instance().preResume();
 #endif
+  SharedFileAreas::instance().preResume();
 }
 
 void dmtcp::DmtcpWorker::restoreVirtualPidTable()
@@ -129,6 +129,7 @@ namespace dmtcp
 
       static void setExitInProgress() { _exitInProgress = true; };
       static bool exitInProgress() { return _exitInProgress; };
+      static bool execAckPending() { return _execAckPending; };
       void interruptCkpthread();
 
       void writeCheckpointPrefix(int fd);
@@ -143,6 +144,8 @@ namespace dmtcp
       static DmtcpWorker theInstance;
     private:
       static bool _exitInProgress;
+      static volatile bool _execAckPending;
+      static bool _skipBarriers;
   };
 }
 
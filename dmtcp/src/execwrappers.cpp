@@ -34,6 +34,7 @@
 #include "syslogwrappers.h"
 #include "dmtcpplugin.h"
 #include "util.h"
+#include "protectedfds.h"
 #ifndef ANDROID
 #include "sysvipc.h"
 #endif
@@ -250,16 +251,34 @@ static void dmtcpPrepareForExec(const char *path, char *const argv[],
     *newArgv = (char**)argv;
   }
 
-  dmtcp::string serialFile = dmtcp::UniquePid::dmtcpTableFilename();
-  jalib::JBinarySerializeWriter wr ( serialFile );
+  // The tables go in an anonymous file, inherited across exec() as
+  // PROTECTED_EXECTABLE_FD; the new program reads it back in
+  // prepareLogAndProcessdDataFromSerialFile().
+  int fd = dmtcp::Util::createAnonymousFile("dmtcpConTable");
+  JASSERT(fd != -1) (JASSERT_ERRNO);
+  JASSERT(_real_dup2(fd, PROTECTED_EXECTABLE_FD) == PROTECTED_EXECTABLE_FD)
+    (fd) (JASSERT_ERRNO);
+  _real_close(fd);
+  jalib::JBinarySerializeWriterRaw wr ("dmtcpConTable",
+                                       PROTECTED_EXECTABLE_FD);
   dmtcp::UniquePid::serialize ( wr );
   dmtcp::KernelDeviceToConnection::instance().serialize ( wr );
   dmtcp::ProcessInfo::instance().serialize ( wr );
 #ifndef ANDROID
   dmtcp::SysVIPC::instance().serialize ( wr );
 #endif
+  // Let the new program keep our coordinator connection instead of
+  // reconnecting, unless the coordinator has not yet answered our own exec().
+  bool reuseCoordinatorConnection =
+    !dmtcp::DmtcpWorker::execAckPending() &&
+    dmtcp::DmtcpWorker::instance().coordinatorSocket().isValid();
+  wr & reuseCoordinatorConnection;
+  if (reuseCoordinatorConnection) {
+    dmtcp::DmtcpWorker::instance().serialize ( wr );
+  }
 
-  setenv ( ENV_VAR_SERIALFILE_INITIAL, serialFile.c_str(), 1 );
+  setenv ( ENV_VAR_SERIALFILE_INITIAL,
+           jalib::XToString(PROTECTED_EXECTABLE_FD).c_str(), 1 );
   JTRACE ( "Will exec filename instead of path" ) ( path ) (*filename);
 
   dmtcp::Util::adjustRlimitStack();
@@ -286,6 +305,9 @@ static void dmtcpProcessFailedExec(const char *path, char *newArgv[])
 
   unsetenv(ENV_VAR_DLSYM_OFFSET);
 
+  unsetenv(ENV_VAR_SERIALFILE_INITIAL);
+  _real_close(PROTECTED_EXECTABLE_FD);
+
   JTRACE ( "Processed failed Exec Attempt" ) (path) ( getenv( "LD_PRELOAD" ) );
   errno = saved_errno;
 }
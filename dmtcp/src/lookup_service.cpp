@@ -1,59 +1,219 @@
-#include <map>
+#include <stdlib.h>
 #include "lookup_service.h"
 #include "../jalib/jassert.h"
 #include "../jalib/jsocket.h"
 
 using namespace dmtcp;
 
+#define INITIAL_CAPACITY 1024
+#define ARENA_CHUNK_SIZE (1024 * 1024)
+
+dmtcp::LookupService::LookupService()
+  : _capacity(INITIAL_CAPACITY)
+  , _numEntries(0)
+  , _curChunk(0)
+  , _chunkUsed(0)
+{
+  _table = (Slot*) calloc(_capacity, sizeof(Slot));
+  JASSERT(_table != NULL) (_capacity);
+}
+
+dmtcp::LookupService::~LookupService()
+{
+  for (size_t i = 0; i < _chunks.size(); i++) {
+    free(_chunks[i].mem);
+  }
+  free(_table);
+}
+
 void dmtcp::LookupService::reset()
 {
-  keyValueMapIterator it;
-  for (it = _keyValueMap.begin(); it != _keyValueMap.end(); it++) {
-    KeyValue *v = it->second;
-    delete v;
+  memset(_table, 0, _capacity * sizeof(Slot));
+  _numEntries = 0;
+  _curChunk = 0;
+  _chunkUsed = 0;
+}
+
+// FNV-1a
+uint64_t dmtcp::LookupService::hash(const void *key, size_t keyLen)
+{
+  const unsigned char *p = (const unsigned char*) key;
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < keyLen; i++) {
+    h = (h ^ p[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+dmtcp::LookupService::Record *
+dmtcp::LookupService::allocRecord(size_t keyLen, size_t valLen)
+{
+  size_t n = (sizeof(Record) + keyLen + valLen + 7) & ~(size_t) 7;
+  while (_curChunk < _chunks.size() &&
+         _chunkUsed + n > _chunks[_curChunk].size) {
+    _curChunk++;
+    _chunkUsed = 0;
+  }
+  if (_curChunk == _chunks.size()) {
+    Chunk c;
+    c.size = n > ARENA_CHUNK_SIZE ? n : ARENA_CHUNK_SIZE;
+    c.mem = (char*) malloc(c.size);
+    JASSERT(c.mem != NULL) (c.size) (JASSERT_ERRNO);
+    _chunks.push_back(c);
+    _chunkUsed = 0;
+  }
+  Record *rec = (Record*) (_chunks[_curChunk].mem + _chunkUsed);
+  _chunkUsed += n;
+  rec->keyLen = keyLen;
+  rec->valLen = valLen;
+  return rec;
+}
+
+/* Returns the slot holding key, or else the empty slot where it would go. */
+dmtcp::LookupService::Slot *
+dmtcp::LookupService::find(uint64_t h, const void *key, size_t keyLen)
+{
+  size_t mask = _capacity - 1;
+  for (size_t i = h & mask; ; i = (i + 1) & mask) {
+    Slot *s = &_table[i];
+    if (s->rec == NULL ||
+        (s->hash == h && s->rec->keyLen == keyLen &&
+         memcmp(s->rec->key(), key, keyLen) == 0)) {
+      return s;
+    }
+  }
+}
+
+void dmtcp::LookupService::insert(uint64_t h, Record *rec)
+{
+  Slot *s = find(h, rec->key(), rec->keyLen);
+  if (s->rec != NULL) {
+    JTRACE("Duplicate key");
+  } else {
+    _numEntries++;
   }
-  _keyValueMap.clear();
+  s->hash = h;
+  s->rec = rec;
+}
+
+void dmtcp::LookupService::grow()
+{
+  Slot *old = _table;
+  size_t oldCapacity = _capacity;
+
+  _capacity *= 2;
+  _table = (Slot*) calloc(_capacity, sizeof(Slot));
+  JASSERT(_table != NULL) (_capacity);
+
+  size_t mask = _capacity - 1;
+  for (size_t j = 0; j < oldCapacity; j++) {
+    if (old[j].rec != NULL) {
+      size_t i = old[j].hash & mask;
+      while (_table[i].rec != NULL) {
+        i = (i + 1) & mask;
+      }
+      _table[i] = old[j];
+    }
+  }
+  free(old);
 }
 
 void dmtcp::LookupService::addKeyValue(const void *key, size_t keyLen,
                                        const void *val, size_t valLen)
 {
-  KeyValue k(key, keyLen);
-  KeyValue *v = new KeyValue(val, valLen);
-  if (_keyValueMap.find(k) != _keyValueMap.end()) {
-    JTRACE("Duplicate key");
+  // Keep the load factor at or below 1/2.
+  if ((_numEntries + 1) * 2 > _capacity) {
+    grow();
   }
-  _keyValueMap[k] = v;
+  Record *rec = allocRecord(keyLen, valLen);
+  memcpy(rec->key(), key, keyLen);
+  memcpy(rec->val(), val, valLen);
+  insert(hash(key, keyLen), rec);
 }
 
 const void* dmtcp::LookupService::query(const void *key, size_t keyLen,
                                         void **val, size_t *valLen)
 {
-  KeyValue k(key, keyLen);
-  if (_keyValueMap.find(k) == _keyValueMap.end()) {
+  Slot *s = find(hash(key, keyLen), key, keyLen);
+  if (s->rec == NULL) {
     JTRACE("Lookup Failed, Key not found.");
     return NULL;
   }
 
-  KeyValue *v = _keyValueMap[k];
-  *val = v->data();
-  *valLen = v->len();
-  
+  *val = s->rec->val();
+  *valLen = s->rec->valLen;
   return *val;
 }
 
+void dmtcp::LookupService::addEntries(const char *data, size_t len, int count)
+{
+  const char *p = data;
+  const char *end = data + len;
+
+  // count comes from the peer: each entry takes at least a header and a
+  // one-byte key and value, so don't size the table for more than that.
+  JASSERT (count >= 0 &&
+           (size_t) count <= len / (sizeof(DmtcpNameServiceEntry) + 2))
+    (count) (len);
+  while ((_numEntries + count) * 2 > _capacity) {
+    grow();
+  }
+  for (int i = 0; i < count; i++) {
+    DmtcpNameServiceEntry e;
+    JASSERT (p + sizeof(e) <= end) (i) (count);
+    memcpy(&e, p, sizeof(e));
+    p += sizeof(e);
+    JASSERT (e.keyLen > 0 && e.valLen > 0 &&
+             e.keyLen <= (size_t) (end - p) &&
+             e.valLen <= (size_t) (end - p) - e.keyLen)
+      (e.keyLen) (e.valLen) (len);
+
+    Record *rec = allocRecord(e.keyLen, e.valLen);
+    memcpy(rec->key(), p, e.keyLen + e.valLen);
+    insert(hash(p, e.keyLen), rec);
+    p += e.keyLen + e.valLen;
+  }
+  JASSERT (p == end) (count) (len);
+}
+
+void dmtcp::LookupService::queryEntries(const char *data, size_t len,
+                                        int count, dmtcp::vector<char>& reply)
+{
+  const char *p = data;
+  const char *end = data + len;
+
+  JASSERT (count >= 0 &&
+           (size_t) count <= len / (sizeof(DmtcpNameServiceEntry) + 1))
+    (count) (len);
+  // Each entry comes back with its value; guess values as big as keys.
+  reply.reserve(reply.size() + 2 * len);
+  for (int i = 0; i < count; i++) {
+    DmtcpNameServiceEntry e;
+    JASSERT (p + sizeof(e) <= end) (i) (count);
+    memcpy(&e, p, sizeof(e));
+    p += sizeof(e);
+    JASSERT (e.keyLen > 0 && e.keyLen <= (size_t) (end - p))
+      (e.keyLen) (len);
+
+    Slot *s = find(hash(p, e.keyLen), p, e.keyLen);
+    JASSERT(s->rec != NULL) (e.keyLen) .Text("Lookup Failed, Key not found.");
+
+    e.valLen = s->rec->valLen;
+    size_t off = reply.size();
+    reply.resize(off + sizeof(e) + e.keyLen + e.valLen);
+    memcpy(&reply[off], &e, sizeof(e));
+    memcpy(&reply[off + sizeof(e)], s->rec->key(), e.keyLen + e.valLen);
+    p += e.keyLen;
+  }
+  JASSERT (p == end) (count) (len);
+}
+
 void dmtcp::LookupService::registerData(const dmtcp::UniquePid& upid,
                                         const DmtcpMessage& msg,
                                         const char *data)
 {
-  JASSERT (msg.keyLen > 0 && msg.valLen > 0 &&
-           msg.keyLen + msg.valLen == msg.extraBytes)
-    (msg.keyLen) (msg.valLen) (msg.extraBytes) (upid);
-  const void *key = data;
-  const void *val = (char *)key + msg.keyLen;
-  size_t keyLen = msg.keyLen;
-  size_t valLen = msg.valLen;
-  addKeyValue(key, keyLen, val, valLen);
+  JTRACE("registering name service data") (upid) (msg.params[0]);
+  addEntries(data, msg.extraBytes, msg.params[0]);
 }
 
 void dmtcp::LookupService::respondToQuery(const dmtcp::UniquePid& upid,
@@ -61,26 +221,16 @@ void dmtcp::LookupService::respondToQuery(const dmtcp::UniquePid& upid,
                                           const DmtcpMessage& msg,
                                           const char *data)
 {
-  JASSERT (msg.keyLen > 0 && msg.keyLen == msg.extraBytes)
-    (msg.keyLen) (msg.extraBytes) (upid);
-  const void *key = data;
-  size_t keyLen = msg.keyLen;
-  void *val = NULL;
-  size_t valLen = 0;
-  JASSERT(query(key, msg.keyLen, &val, &valLen) != NULL)(key)(msg.keyLen);
-
-  char *extraData = NULL;
-  extraData = new char[msg.keyLen + valLen];
-  memcpy(extraData, key, keyLen);
-  memcpy(extraData + keyLen, val, valLen);
-
-  DmtcpMessage reply (DMT_NAME_SERVICE_QUERY_RESPONSE);
-  reply.keyLen = msg.keyLen;
-  reply.valLen = valLen;
-  reply.extraBytes = reply.keyLen + reply.valLen;
-
-  remote << reply;
-  remote.writeAll(extraData, reply.extraBytes);
-
-  delete [] extraData;
+  dmtcp::vector<char> reply;
+  JTRACE("answering name service queries") (upid) (msg.params[0]);
+  queryEntries(data, msg.extraBytes, msg.params[0], reply);
+
+  DmtcpMessage replyMsg (DMT_NAME_SERVICE_QUERY_RESPONSE);
+  replyMsg.params[0] = msg.params[0];
+  replyMsg.extraBytes = reply.size();
+
+  remote << replyMsg;
+  if (reply.size() > 0) {
+    remote.writeAll(&reply[0], reply.size());
+  }
 }
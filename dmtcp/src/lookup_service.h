@@ -22,52 +22,28 @@
 #ifndef LOOKUP_SERVICE_H
 #define LOOKUP_SERVICE_H
 
-#include <map>
 #include <string.h>
+#include <stdint.h>
+#include "dmtcpalloc.h"
 #include "dmtcpmessagetypes.h"
 #include "uniquepid.h"
 #include "../jalib/jsocket.h"
 
 namespace dmtcp
 {
-  class KeyValue {
-    public:
-      KeyValue(const void *data, const size_t len) {
-        _data = malloc(len);
-        _len = len;
-        memcpy(_data, data, len);
-      }
-      ~KeyValue() {}
-
-      void *data() {return _data;}
-      size_t len() {return _len;}
-
-      bool operator< ( const KeyValue& that ) const {
-        if (_len == that._len) {
-          return memcmp(_data, that._data, _len) < 0;
-        }
-        return _len < that._len;
-      }
-      bool operator== ( const KeyValue& that ) const {
-        return _len == that._len && memcmp(_data, that._data, _len) == 0;
-      }
-      bool operator!= ( const KeyValue& that ) const {
-        return ! operator== ( that );
-      }
-
-    private:
-      void *_data;
-      size_t _len;
-  };
-
+  /* The coordinator's name service database.  Keys and values are copied
+   * into large arena chunks, one record per key, and indexed by an
+   * open-addressing hash table (linear probing) that keeps each key's hash
+   * next to the record pointer, so that a probe compares key bytes only on a
+   * hash match.  reset() keeps the arena and the table for the next
+   * checkpoint.
+   */
   class LookupService {
     public:
-      LookupService(){}
-      ~LookupService() { reset(); }
+      LookupService();
+      ~LookupService();
       void reset();
 
-      typedef map<KeyValue, KeyValue*>::iterator keyValueMapIterator;
-
       void registerData(const UniquePid& upid, const DmtcpMessage& msg,
                         const char *data);
       void respondToQuery(const UniquePid& upid, jalib::JSocket& remote,
@@ -78,8 +54,42 @@ namespace dmtcp
       const void *query(const void *key, size_t keyLen,
                         void **val, size_t *valLen);
 
+      // Bulk forms: count DmtcpNameServiceEntry records, as sent by workers.
+      void addEntries(const char *data, size_t len, int count);
+      void queryEntries(const char *data, size_t len, int count,
+                        dmtcp::vector<char>& reply);
+
+      size_t size() const { return _numEntries; }
+
     private:
-      map<KeyValue, KeyValue*> _keyValueMap;
+      struct Record {
+        uint32_t keyLen;
+        uint32_t valLen;
+        char *key() { return (char*) (this + 1); }
+        char *val() { return key() + keyLen; }
+      };
+      struct Slot {
+        uint64_t hash;
+        Record  *rec;
+      };
+
+      static uint64_t hash(const void *key, size_t keyLen);
+      Slot *find(uint64_t h, const void *key, size_t keyLen);
+      void insert(uint64_t h, Record *rec);
+      void grow();
+      Record *allocRecord(size_t keyLen, size_t valLen);
+
+      Slot   *_table;
+      size_t  _capacity;    // power of two
+      size_t  _numEntries;
+
+      struct Chunk {
+        char   *mem;
+        size_t  size;
+      };
+      dmtcp::vector<Chunk> _chunks;
+      size_t  _curChunk;
+      size_t  _chunkUsed;   // bytes used in _chunks[_curChunk]
   };
 }
 #endif
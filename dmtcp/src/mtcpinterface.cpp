@@ -40,6 +40,7 @@
 #include "sockettable.h"
 #include "dmtcpplugin.h"
 #include "util.h"
+#include "sharedfileareas.h"
 
 #include "../jalib/jfilesystem.h"
 #include "../jalib/jconvert.h"
@@ -84,8 +85,10 @@ static void callbackRestoreVirtualPidTable();
 void callbackHoldsAnyLocks(int *retval);
 void callbackPreSuspendUserThread();
 void callbackPreResumeUserThread(int is_ckpt, int is_restart);
+static int callbackCkptSharedArea(void *addr);
 
 LIB_PRIVATE MtcpFuncPtrs_t mtcpFuncPtrs;
+LIB_PRIVATE void dmtcp_replay_wait_for_suspend_msg();
 
 #ifdef EXTERNAL_SOCKET_HANDLING
 static bool delayedCheckpoint = false;
@@ -217,7 +220,8 @@ void dmtcp::initializeMtcpEngine()
   (*mtcpFuncPtrs.set_dmtcp_callbacks)(&callbackRestoreVirtualPidTable,
                                       &callbackHoldsAnyLocks,
                                       &callbackPreSuspendUserThread,
-                                      &callbackPreResumeUserThread);
+                                      &callbackPreResumeUserThread,
+                                      &callbackCkptSharedArea);
 
   JTRACE ("Calling mtcp_init");
   mtcpFuncPtrs.init(UniquePid::getCkptFilename(), 0xBadF00d, 1);
@@ -231,6 +235,7 @@ static void callbackSleepBetweenCheckpoint ( int sec )
   dmtcp::ThreadSync::waitForUserThreadsToFinishPreResumeCB();
   dmtcp_process_event(DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG, NULL);
   dmtcp::DmtcpWorker::instance().waitForStage1Suspend();
+  dmtcp_replay_wait_for_suspend_msg();
 
   prctlGetProcessName();
   unmapRestoreArgv();
@@ -249,6 +254,7 @@ static void callbackPreCheckpoint( char ** ckptFilename )
   // serves the purpose without having a callback.
   // TODO: Check for correctness.
   JALIB_CKPT_UNLOCK();
+  JASSERT_FLUSH_BINARY_LOG();
 
   dmtcp_process_event(DMTCP_EVENT_START_PRE_CKPT_CB, NULL);
 
@@ -276,6 +282,7 @@ static void callbackPostCheckpoint ( int isRestart,
   {
     restoreArgvAfterRestart(mtcpRestoreArgvStartAddr);
     prctlRestoreProcessName();
+    JASSERT_RESTART_BINARY_LOG();
 
     dmtcp_process_event(DMTCP_EVENT_POST_RESTART, NULL);
 
@@ -335,6 +342,12 @@ static int callbackShouldCkptFD ( int /*fd*/ )
   return 0;
 }
 
+static int callbackCkptSharedArea ( void *addr )
+{
+  // Only the elected process saves the contents of a shared file area.
+  return dmtcp::SharedFileAreas::instance().isCkptLeader(addr);
+}
+
 static void callbackWriteCkptPrefix ( int fd )
 {
   dmtcp::DmtcpWorker::instance().writeCheckpointPrefix(fd);
@@ -54,7 +54,8 @@ extern "C"
     (void (*restore_virtual_pid_table) (),
      void (*holds_any_locks)(int *retval),
      void (*pre_suspend_user_thread)(),
-     void (*pre_resume_user_thread)(int is_ckpt, int is_restart));
+     void (*pre_resume_user_thread)(int is_ckpt, int is_restart),
+     int  (*ckpt_shared_area)(void *addr));
 
   typedef int  (*mtcp_init_dmtcp_info_t)(int pid_virtualization_enabled,
                                          int stderr_fd,
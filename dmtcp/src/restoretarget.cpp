@@ -46,13 +46,18 @@ using namespace dmtcp;
 void runMtcpRestore(const char* path, int offset, size_t argvSize,
                     size_t envSize);
 
-RestoreTarget::RestoreTarget (const dmtcp::string& path)
+RestoreTarget::RestoreTarget (const dmtcp::string& path, int headerFd)
   : _path (path)
 {
   JASSERT (jalib::Filesystem::FileExists (_path)) (_path)
     .Text ("checkpoint file missing");
 
-  _offset = CkptSerializer::loadFromFile(_path, &_conToFd, &_processInfo);
+  if (headerFd != -1) {
+    _offset = CkptSerializer::loadFromHeaderCopy(_path, headerFd,
+                                                 &_conToFd, &_processInfo);
+  } else {
+    _offset = CkptSerializer::loadFromFile(_path, &_conToFd, &_processInfo);
+  }
 
   _roots.clear();
   _children.clear();
@@ -125,6 +130,7 @@ int RestoreTarget::find_stdin(SlidingFdTable& slidingFd)
 
 void RestoreTarget::mtcpRestart()
 {
+  dmtcp::Util::startupTraceReport("restart", procname());
   runMtcpRestore(_path.c_str(), _offset,
                  _processInfo.argvSize(), _processInfo.envSize());
 }
@@ -430,6 +436,7 @@ void RestoreTarget::CreateProcess(DmtcpCoordinatorAPI& coordinatorAPI,
     }
   }
 
+  dmtcp::Util::startupTraceStep("fork");
   bool isTheGroupLeader = isGroupLeader(); // Calls JTRACE;avoid recursion
   JTRACE("Child and dependent root processes forked, restoring process")
     (upid())(getpid())(isTheGroupLeader);
@@ -443,9 +450,11 @@ void RestoreTarget::CreateProcess(DmtcpCoordinatorAPI& coordinatorAPI,
   coordinatorAPI.sendCoordinatorHandshake(procname(), _processInfo.compGroup());
   coordinatorAPI.recvCoordinatorHandshake();
   close(tmpCoordFd);
+  dmtcp::Util::startupTraceStep("reconnect");
 
   //restart targets[i]
   dupAllSockets (slidingFd);
+  dmtcp::Util::startupTraceStep("dupfds");
 
   mtcpRestart();
 
@@ -40,7 +40,9 @@ namespace dmtcp
   class RestoreTarget
   {
   public:
-    RestoreTarget(const dmtcp::string& path);
+    // headerFd, if not -1, holds a copy of the image's header made by
+    // CkptSerializer::copyHeader(), to parse instead of the image itself.
+    RestoreTarget(const dmtcp::string& path, int headerFd = -1);
 
     typedef map<pid_t,bool> sidMapping;
     typedef sidMapping::iterator s_iterator;
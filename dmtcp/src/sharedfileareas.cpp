@@ -0,0 +1,140 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2010 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *   This file is part of the dmtcp/src module of DMTCP (DMTCP:dmtcp/src).  *
+ *                                                                          *
+ *  DMTCP:dmtcp/src is free software: you can redistribute it and/or        *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP:dmtcp/src is distributed in the hope that it will be useful,      *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include  "../jalib/jassert.h"
+#include  "../jalib/jconvert.h"
+#include "syscallwrappers.h"
+#include "uniquepid.h"
+#include "util.h"
+#include "sharedfileareas.h"
+
+/*
+ * Checkpointing writable MAP_SHARED file areas once per computation, instead
+ * of once per process that maps them (SysV shared memory is handled the same
+ * way in sysvipc.cpp).
+ *  1. BARRIER -- SUSPENDED
+ *  2. For each such area, try to create a marker file named after the
+ *     computation and checkpoint generation, the file (device and inode),
+ *     and the offset and size of the mapping, in the DMTCP tmpdir, with
+ *     O_CREAT|O_EXCL.  The process that creates it is elected as the
+ *     ckptLeader of the area.  The marker is closed at once: an fd that is
+ *     not in the connection table must not be open during the drain.
+ *  3. MTCP asks isCkptLeader() for each MAP_SHARED area that it writes.  The
+ *     ckptLeader writes the contents; the other processes only write the
+ *     area descriptor (MTCP_PROT_LEADER_SAVED).
+ *  4. BARRIER -- REFILLED
+ *  5. BARRIER -- RESUME
+ *  6. The ckptLeader removes the marker file.
+ *
+ * Every process tries to create the marker after all of them are
+ * suspended, and it is only removed after all of them are refilled; so
+ * there is exactly one ckptLeader per area, even if the barriers in between
+ * are skipped.  A marker left behind by a failed checkpoint has an older
+ * generation in its name, and doesn't get in the way.  If the marker can
+ * not be created for another reason than that it exists, the process saves
+ * the contents itself.  Processes that share the tmpdir share the election;
+ * the tmpdir is per host, unless DMTCP_TMPDIR is shared.
+ *
+ * On restart, mtcp_restart of the ckptLeader writes the contents into the
+ * file through its mapping, and the others map the file, creating it first
+ * if needed.  No user thread runs before all processes are restored.
+ */
+
+static dmtcp::SharedFileAreas *sharedFileAreasInst = NULL;
+dmtcp::SharedFileAreas& dmtcp::SharedFileAreas::instance()
+{
+  if (sharedFileAreasInst == NULL) {
+    sharedFileAreasInst = new SharedFileAreas();
+  }
+  return *sharedFileAreasInst;
+}
+
+void dmtcp::SharedFileAreas::leaderElection()
+{
+  Util::ProcMapsArea area;
+  struct stat st;
+
+  _isCkptLeader.clear();
+  int mapsfd = _real_open("/proc/self/maps", O_RDONLY);
+  JASSERT(mapsfd != -1) (JASSERT_ERRNO);
+  while (Util::readProcMapsLine(mapsfd, &area)) {
+    // Deleted files fail stat() and are saved by every process, as before.
+    if (!(area.flags & MAP_SHARED) || !(area.prot & PROT_WRITE) ||
+        area.name[0] != '/' || stat(area.name, &st) == -1 ||
+        !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    _isCkptLeader[area.addr] = createMarker(st, area.offset, area.size);
+    JTRACE("Shared file area") (area.name) ((void*) area.addr) (area.size)
+      (_isCkptLeader[area.addr]);
+  }
+  _real_close(mapsfd);
+}
+
+bool dmtcp::SharedFileAreas::createMarker(const struct stat& st,
+                                          off_t offset, size_t size)
+{
+  dmtcp::ostringstream o;
+  o << UniquePid::getTmpDir() << "/dmtcpSharedArea."
+    << UniquePid::ComputationId() << '.'
+    << UniquePid::ComputationId().generation() << '.'
+    << st.st_dev << '.' << st.st_ino << '.' << offset << '.' << size;
+  dmtcp::string path = o.str();
+
+  // The same window mapped twice in this process is saved once, too: the
+  // second attempt finds the marker.
+  int fd = _real_open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY,
+                      S_IRUSR | S_IWUSR);
+  if (fd != -1) {
+    _real_close(fd);
+    _markers.push_back(path);
+    return true;
+  }
+  int createErrno = errno;
+  JWARNING(createErrno == EEXIST) (path) (createErrno)
+    .Text("Can't create marker file; saving shared area in this process");
+  return createErrno != EEXIST;
+}
+
+bool dmtcp::SharedFileAreas::isCkptLeader(void *addr)
+{
+  AreaIter i = _isCkptLeader.find(addr);
+  return i == _isCkptLeader.end() || i->second;
+}
+
+void dmtcp::SharedFileAreas::preResume()
+{
+  for (size_t i = 0; i < _markers.size(); i++) {
+    unlink(_markers[i].c_str());
+  }
+  _markers.clear();
+  _isCkptLeader.clear();
+}
+
+void dmtcp::SharedFileAreas::postRestart()
+{
+  // Remove any marker file that the checkpointed process left behind.
+  preResume();
+}
@@ -1,6 +1,6 @@
 /****************************************************************************
- *   Copyright (C) 2006-2012 by Kito Cheng                                  *
- *   kito@0xlab.org                                                         *
+ *   Copyright (C) 2006-2010 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
  *                                                                          *
  *   This file is part of the dmtcp/src module of DMTCP (DMTCP:dmtcp/src).  *
  *                                                                          *
@@ -19,31 +19,42 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
-#ifndef TLS_H
-#define TLS_H
+#ifndef SHAREDFILEAREAS_H
+#define SHAREDFILEAREAS_H
 
-#include <pthread.h>
+#include "dmtcpalloc.h"
+#include "../jalib/jalloc.h"
+#include <sys/types.h>
+#include <sys/stat.h>
 
 namespace dmtcp
 {
-  template <class T>
-  class TLS
+  /* Writable MAP_SHARED file areas, and whether this process was elected
+   * to save their contents in its checkpoint image (see sharedfileareas.cpp).
+   */
+  class SharedFileAreas
   {
     public:
-      TLS();
-      TLS(const T &val);
-      ~TLS();
-      operator T&();
-      T &operator=(const T &val);
-      operator const T&() const;
-      const T &operator=(const T &val) const;
+#ifdef JALIB_ALLOCATOR
+      static void* operator new(size_t nbytes, void* p) { return p; }
+      static void* operator new(size_t nbytes) { JALLOC_HELPER_NEW(nbytes); }
+      static void  operator delete(void* p) { JALLOC_HELPER_DELETE(p); }
+#endif
+
+      static SharedFileAreas& instance();
+
+      void leaderElection();
+      void preResume();
+      void postRestart();
+
+      bool isCkptLeader(void *addr);
+
     private:
-      T *get();
-      const T *get() const;
-      pthread_key_t _tlsKey;
-      T _default;
-      static T *malloc();
+      bool createMarker(const struct stat& st, off_t offset, size_t size);
+
+      typedef dmtcp::map<void*, bool>::iterator AreaIter;
+      dmtcp::map<void*, bool> _isCkptLeader;
+      dmtcp::vector<dmtcp::string> _markers;
   };
 }
-
 #endif
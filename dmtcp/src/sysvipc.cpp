@@ -327,22 +327,21 @@ void dmtcp::SysVIPC::on_shmdt(const void *shmaddr)
 
 void dmtcp::SysVIPC::writeShmidMapsToFile(int fd)
 {
-  dmtcp::string file = "/proc/self/fd/" + jalib::XToString ( fd );
-  file = jalib::Filesystem::ResolveSymlink ( file );
-  JASSERT ( file.length() > 0 ) ( file ) ( fd );
-
-  jalib::JBinarySerializeWriterRaw wr (file, fd);
+  // Serialize before taking the lock, and append with a single write.
+  jalib::JBinarySerializeWriterMem wr ("dmtcpShmidMap");
+  wr.serializeMap(_originalToCurrentShmids);
 
   Util::lockFile(fd);
-  wr.serializeMap(_originalToCurrentShmids);
+  JASSERT(Util::writeAll(fd, wr.data(), wr.size()) == (ssize_t) wr.size())
+    (fd) (wr.size()) (JASSERT_ERRNO);
   Util::unlockFile(fd);
 }
 
 void dmtcp::SysVIPC::readShmidMapsFromFile(int fd)
 {
+  // The map file is anonymous (see dmtcp_restart.cpp); reopen it through
+  // /proc to get a private file offset.
   dmtcp::string file = "/proc/self/fd/" + jalib::XToString ( fd );
-  file = jalib::Filesystem::ResolveSymlink ( file );
-  JASSERT ( file.length() > 0 ) ( file );
 
   jalib::JBinarySerializeReader rd(file);
 
@@ -50,12 +50,24 @@
  *   that no user-thread is executing any DMTCP wrapper code when it receives
  *   the checkpoint signal.
  * Working:
- *   On entering the wrapper in DMTCP, the user-thread acquires the read lock,
- *     and releases it before leaving the wrapper.
+ *   Every wrapper (malloc, free, mmap, open, ...) takes this lock in shared
+ *     mode, so it is not a pthread rwlock: a global rwlock's cache line would
+ *     bounce between all the cores.  Instead, each thread owns a
+ *     WrapperExecutionRecord (its own cache line, kept in a global list) with
+ *     an "in-wrapper" counter.  On entering the wrapper, the user-thread
+ *     increments its own counter, issues a memory barrier and checks
+ *     _wrapperExecutionBarrier.  If it is not raised, the thread proceeds;
+ *     no shared cache line is written.  The counter is decremented before
+ *     leaving the wrapper.
  *   When the Checkpoint-thread wants to send the SUSPEND signal to user
- *     threads, it must acquire the write lock. It is blocked until all the
- *     existing read-locks by user threads have been released. NOTE that this
- *     is a WRITER-PREFERRED lock.
+ *     threads, it must acquire the exclusive lock: it takes
+ *     _wrapperExecutionWriterLock, raises _wrapperExecutionBarrier and waits
+ *     for the counters of all the threads to drain to zero (RCU/epoch
+ *     style).  Threads that are not yet inside a wrapper back off while the
+ *     barrier is raised, so NOTE that this is still a WRITER-PREFERRED lock.
+ *   The fork() and exec() wrappers take the exclusive lock the same way,
+ *     except that they give up and retry if the counters do not drain
+ *     quickly (e.g. a thread is blocked inside a wrapper).
  *
  * There is a corner case too -- the newly created thread that has not been
  *   initialized yet; we need to take some extra efforts for that.
@@ -72,9 +84,21 @@
  * XXX: Currently this security is provided only for the clone wrapper; this
  * should be extended to other calls as well.           -- KAPIL
  */
+#define CACHE_LINE_SIZE 64
+
+struct WrapperExecutionRecord {
+  volatile int count;   // Nesting depth of wrappers entered by the owner
+  volatile int inUse;   // Owned by a live thread
+  WrapperExecutionRecord *next;
+  char padding[CACHE_LINE_SIZE - 2 * sizeof(int) - sizeof(void*)];
+};
+
+static WrapperExecutionRecord * volatile _wrapperExecutionRecords = NULL;
+static volatile int _wrapperExecutionBarrier = 0;
+static WrapperExecutionRecord * volatile _wrapperExecutionExclOwner = NULL;
+static pthread_mutex_t _wrapperExecutionWriterLock = PTHREAD_MUTEX_INITIALIZER;
+
 // NOTE: PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP is not POSIX.
-static pthread_rwlock_t
-  _wrapperExecutionLock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
 static pthread_rwlock_t
   _threadCreationLock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
 static bool _wrapperExecutionLockAcquiredByCkptThread = false;
@@ -86,42 +110,123 @@ static pthread_mutex_t theCkptCanStart = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 static pthread_mutex_t uninitializedThreadCountLock = PTHREAD_MUTEX_INITIALIZER;
 static int _uninitializedThreadCount = 0;
 static bool _checkpointThreadInitialized = false;
+static pthread_mutex_t checkpointThreadInitializedLock =
+  PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpointThreadInitializedCond =
+  PTHREAD_COND_INITIALIZER;
 
 #define INVALID_USER_THREAD_COUNT 0
 static int preResumeThreadCount = INVALID_USER_THREAD_COUNT;
 static pthread_mutex_t preResumeThreadCountLock = PTHREAD_MUTEX_INITIALIZER;
 
-#ifndef ANDROID
-static __thread int _wrapperExecutionLockLockCount = 0;
-static __thread int _threadCreationLockLockCount = 0;
-static __thread bool _threadPerformingDlopenDlsym = false;
-static __thread bool _sendCkptSignalOnFinalUnlock = false;
-static __thread bool _isOkToGrabWrapperExecutionLock = true;
-static __thread bool _hasThreadFinishedInitialization = false;
-#else
-/* Pack as a struct since the TLS data slot is poor in Android */
+/* Pack as a struct, since the TLS data slots are scarce on Android, and so
+ * that the wrapper fast paths look the TLS block up only once per call.
+ */
 struct TLSData{
-  int _wrapperExecutionLockLockCount;
-  int _threadCreationLockLockCount;
-  bool _threadPerformingDlopenDlsym;
-  bool _sendCkptSignalOnFinalUnlock;
-  bool _isOkToGrabWrapperExecutionLock;
-  bool _hasThreadFinishedInitialization;
+  WrapperExecutionRecord *wrapperExecutionRecord;
+  int wrapperExecutionLockLockCount;
+  int threadCreationLockLockCount;
+  bool threadPerformingDlopenDlsym;
+  bool sendCkptSignalOnFinalUnlock;
+  bool isOkToGrabWrapperExecutionLock;
+  bool hasThreadFinishedInitialization;
 };
-static const TLSData defaultTLSData = {0, 0, false, false, true, false};
-static TLSData &getTLSData() {
+#ifndef ANDROID
+static __thread TLSData _tlsData = {NULL, 0, 0, false, false, true, false};
+static inline TLSData &getTLSData() {
+  return _tlsData;
+}
+#else
+static const TLSData defaultTLSData = {NULL, 0, 0, false, false, true, false};
+static inline TLSData &getTLSData() {
   static dmtcp::TLS<TLSData> tlsData = defaultTLSData;
   return tlsData;
 }
-#define _wrapperExecutionLockLockCount  getTLSData()._wrapperExecutionLockLockCount
-#define _threadCreationLockLockCount getTLSData()._threadCreationLockLockCount
-#define _threadPerformingDlopenDlsym getTLSData()._threadPerformingDlopenDlsym
-#define _sendCkptSignalOnFinalUnlock getTLSData()._sendCkptSignalOnFinalUnlock
-#define _isOkToGrabWrapperExecutionLock getTLSData()._isOkToGrabWrapperExecutionLock
-#define _hasThreadFinishedInitialization getTLSData()._hasThreadFinishedInitialization
-
 #endif
+#define _wrapperExecutionRecord getTLSData().wrapperExecutionRecord
+#define _wrapperExecutionLockLockCount  getTLSData().wrapperExecutionLockLockCount
+#define _threadCreationLockLockCount getTLSData().threadCreationLockLockCount
+#define _threadPerformingDlopenDlsym getTLSData().threadPerformingDlopenDlsym
+#define _sendCkptSignalOnFinalUnlock getTLSData().sendCkptSignalOnFinalUnlock
+#define _isOkToGrabWrapperExecutionLock getTLSData().isOkToGrabWrapperExecutionLock
+#define _hasThreadFinishedInitialization getTLSData().hasThreadFinishedInitialization
+
+/* Returns this thread's record, reusing the record of an exited thread or
+ * pushing a new one onto the (never shrinking) list.  Lock-free, since it may
+ * be called from inside the malloc wrappers.
+ */
+static WrapperExecutionRecord *getWrapperExecutionRecord(TLSData &tls)
+{
+  WrapperExecutionRecord *rec = tls.wrapperExecutionRecord;
+  if (rec != NULL) {
+    return rec;
+  }
+  for (rec = _wrapperExecutionRecords; rec != NULL; rec = rec->next) {
+    if (rec->inUse == 0 && __sync_bool_compare_and_swap(&rec->inUse, 0, 1)) {
+      break;
+    }
+  }
+  if (rec == NULL) {
+    // Align on a cache line so that no two threads share one.
+    char *buf = (char*) JALLOC_HELPER_MALLOC(sizeof(WrapperExecutionRecord) +
+                                             CACHE_LINE_SIZE);
+    buf += CACHE_LINE_SIZE - ((unsigned long) buf % CACHE_LINE_SIZE);
+    rec = (WrapperExecutionRecord*) buf;
+    rec->count = 0;
+    rec->inUse = 1;
+    do {
+      rec->next = _wrapperExecutionRecords;
+    } while (!__sync_bool_compare_and_swap(&_wrapperExecutionRecords,
+                                           rec->next, rec));
+  }
+  tls.wrapperExecutionRecord = rec;
+  return rec;
+}
+
+/* Raise the barrier and wait until no thread other than 'self' is inside a
+ * wrapper.  With maxTries < 0, wait forever; otherwise lower the barrier
+ * again and return false if the wrappers have not drained in time.
+ */
+static bool drainWrapperExecutionRecords(WrapperExecutionRecord *self,
+                                         int maxTries)
+{
+  _wrapperExecutionBarrier = 1;
+  __sync_synchronize();
+  for (int i = 0; maxTries < 0 || i < maxTries; i++) {
+    WrapperExecutionRecord *rec;
+    for (rec = _wrapperExecutionRecords; rec != NULL; rec = rec->next) {
+      if (rec != self && rec->count > 0) {
+        break;
+      }
+    }
+    if (rec == NULL) {
+      return true;
+    }
+    struct timespec sleepTime = {0, 1000*1000};
+    nanosleep(&sleepTime, NULL);
+  }
+  _wrapperExecutionBarrier = 0;
+  __sync_synchronize();
+  return false;
+}
+
+static void releaseWrapperExecutionBarrier()
+{
+  _wrapperExecutionExclOwner = NULL;
+  _wrapperExecutionBarrier = 0;
+  __sync_synchronize();
+}
 
+void dmtcp::ThreadSync::releaseWrapperExecutionRecord()
+{
+  WrapperExecutionRecord *rec = _wrapperExecutionRecord;
+  if (rec != NULL) {
+    _wrapperExecutionRecord = NULL;
+    rec->count = 0;
+    __sync_synchronize();
+    rec->inUse = 0;
+  }
+}
 
 void dmtcp::ThreadSync::initMotherOfAll()
 {
@@ -145,8 +250,9 @@ void dmtcp::ThreadSync::acquireLocks()
   _threadCreationLockAcquiredByCkptThread = true;
 
   JTRACE("Waiting for other threads to exit DMTCP-Wrappers");
-  JASSERT(_real_pthread_rwlock_wrlock(&_wrapperExecutionLock) == 0)
+  JASSERT(_real_pthread_mutex_lock(&_wrapperExecutionWriterLock) == 0)
     (JASSERT_ERRNO);
+  drainWrapperExecutionRecords(_wrapperExecutionRecord, -1);
   _wrapperExecutionLockAcquiredByCkptThread = true;
 
   JTRACE("Waiting for newly created threads to finish initialization")
@@ -162,7 +268,8 @@ void dmtcp::ThreadSync::releaseLocks()
   JASSERT(WorkerState::currentState() == WorkerState::SUSPENDED);
 
   JTRACE("Releasing ThreadSync locks");
-  JASSERT(_real_pthread_rwlock_unlock(&_wrapperExecutionLock) == 0)
+  releaseWrapperExecutionBarrier();
+  JASSERT(_real_pthread_mutex_unlock(&_wrapperExecutionWriterLock) == 0)
     (JASSERT_ERRNO);
   _wrapperExecutionLockAcquiredByCkptThread = false;
   JASSERT(_real_pthread_rwlock_unlock(&_threadCreationLock) == 0)
@@ -178,9 +285,18 @@ void dmtcp::ThreadSync::releaseLocks()
 void dmtcp::ThreadSync::resetLocks()
 {
   pthread_rwlock_t newLock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
-  _wrapperExecutionLock = newLock;
   _threadCreationLock = newLock;
 
+  // Only the calling thread survived fork(); recycle all other records.
+  pthread_mutex_t newWriterLock = PTHREAD_MUTEX_INITIALIZER;
+  _wrapperExecutionWriterLock = newWriterLock;
+  releaseWrapperExecutionBarrier();
+  for (WrapperExecutionRecord *rec = _wrapperExecutionRecords; rec != NULL;
+       rec = rec->next) {
+    rec->count = 0;
+    rec->inUse = rec == _wrapperExecutionRecord;
+  }
+
   _wrapperExecutionLockLockCount = 0;
   _threadCreationLockLockCount = 0;
   _hasThreadFinishedInitialization = true;
@@ -193,24 +309,33 @@ void dmtcp::ThreadSync::resetLocks()
   pthread_mutex_t newDestroyDmtcpWorker = PTHREAD_MUTEX_INITIALIZER;
   destroyDmtcpWorkerLock = newDestroyDmtcpWorker;
 
+  pthread_mutex_t newCkptThreadInitializedLock = PTHREAD_MUTEX_INITIALIZER;
+  checkpointThreadInitializedLock = newCkptThreadInitializedLock;
+  pthread_cond_t newCkptThreadInitializedCond = PTHREAD_COND_INITIALIZER;
+  checkpointThreadInitializedCond = newCkptThreadInitializedCond;
   _checkpointThreadInitialized = false;
   _wrapperExecutionLockAcquiredByCkptThread = false;
   _threadCreationLockAcquiredByCkptThread = false;
 }
 
-bool dmtcp::ThreadSync::isThisThreadHoldingAnyLocks()
+static bool isThisThreadHoldingAnyLocks(const TLSData &tls)
 {
   // If the wrapperExec lock has been acquired by the ckpt thread, then we are
   // certainly not holding it :). It's possible for the count to be still '1',
   // as it may happen that the thread got suspended after releasing the lock
   // and before decrementing the lock-count.
-  if (_hasThreadFinishedInitialization == false) {
+  if (tls.hasThreadFinishedInitialization == false) {
     return true;
   }
   return (_wrapperExecutionLockAcquiredByCkptThread == false ||
           _threadCreationLockAcquiredByCkptThread == false) &&
-         (_threadCreationLockLockCount > 0 ||
-          _wrapperExecutionLockLockCount > 0);
+         (tls.threadCreationLockLockCount > 0 ||
+          tls.wrapperExecutionLockLockCount > 0);
+}
+
+bool dmtcp::ThreadSync::isThisThreadHoldingAnyLocks()
+{
+  return ::isThisThreadHoldingAnyLocks(getTLSData());
 }
 
 bool dmtcp::ThreadSync::isOkToGrabLock()
@@ -234,15 +359,21 @@ void dmtcp::ThreadSync::setSendCkptSignalOnFinalUnlock()
   _sendCkptSignalOnFinalUnlock = true;
 }
 
-void dmtcp::ThreadSync::sendCkptSignalOnFinalUnlock()
+static void sendCkptSignalOnFinalUnlock(TLSData &tls)
 {
-  if (_sendCkptSignalOnFinalUnlock && isThisThreadHoldingAnyLocks() == false) {
-    _sendCkptSignalOnFinalUnlock = false;
-    JASSERT(raise(DmtcpWorker::determineMtcpSignal()) == 0)
+  if (tls.sendCkptSignalOnFinalUnlock &&
+      isThisThreadHoldingAnyLocks(tls) == false) {
+    tls.sendCkptSignalOnFinalUnlock = false;
+    JASSERT(raise(dmtcp::DmtcpWorker::determineMtcpSignal()) == 0)
       (getpid()) (gettid()) (JASSERT_ERRNO);
   }
 }
 
+void dmtcp::ThreadSync::sendCkptSignalOnFinalUnlock()
+{
+  ::sendCkptSignalOnFinalUnlock(getTLSData());
+}
+
 extern "C" LIB_PRIVATE
 void dmtcp_setThreadPerformingDlopenDlsym()
 {
@@ -278,7 +409,23 @@ bool dmtcp::ThreadSync::isCheckpointThreadInitialized()
 void dmtcp::ThreadSync::setCheckpointThreadInitialized()
 {
   JASSERT(_checkpointThreadInitialized == false);
+  JASSERT(_real_pthread_mutex_lock(&checkpointThreadInitializedLock) == 0);
   _checkpointThreadInitialized = true;
+  _real_pthread_cond_broadcast(&checkpointThreadInitializedCond);
+  JASSERT(_real_pthread_mutex_unlock(&checkpointThreadInitializedLock) == 0);
+}
+
+// Called by the user thread at startup (and in the child after fork()).
+// Blocking here instead of polling matters for short-lived processes: the
+// old 10 ms nanosleep() loop was most of the cost of a fork() or exec().
+void dmtcp::ThreadSync::waitForCheckpointThreadInitialized()
+{
+  JASSERT(_real_pthread_mutex_lock(&checkpointThreadInitializedLock) == 0);
+  while (!_checkpointThreadInitialized) {
+    _real_pthread_cond_wait(&checkpointThreadInitializedCond,
+                            &checkpointThreadInitializedLock);
+  }
+  JASSERT(_real_pthread_mutex_unlock(&checkpointThreadInitializedLock) == 0);
 }
 
 void dmtcp::ThreadSync::destroyDmtcpWorkerLockLock()
@@ -307,62 +454,65 @@ void dmtcp::ThreadSync::delayCheckpointsUnlock(){
   JASSERT(_real_pthread_mutex_unlock(&theCkptCanStart)==0)(JASSERT_ERRNO);
 }
 
-static void incrementWrapperExecutionLockLockCount()
+static void incrementWrapperExecutionLockLockCount(TLSData &tls)
 {
-  _wrapperExecutionLockLockCount++;
+  tls.wrapperExecutionLockLockCount++;
 }
 
-static void decrementWrapperExecutionLockLockCount()
+static void decrementWrapperExecutionLockLockCount(TLSData &tls)
 {
-  if (_wrapperExecutionLockLockCount <= 0) {
-    JASSERT(false) (_wrapperExecutionLockLockCount)
+  if (tls.wrapperExecutionLockLockCount <= 0) {
+    JASSERT(false) (tls.wrapperExecutionLockLockCount)
       .Text("wrapper-execution lock count can't be negative");
   }
-  _wrapperExecutionLockLockCount--;
-  dmtcp::ThreadSync::sendCkptSignalOnFinalUnlock();
+  tls.wrapperExecutionLockLockCount--;
+  sendCkptSignalOnFinalUnlock(tls);
 }
 
-static void incrementThreadCreationLockLockCount()
+static void incrementThreadCreationLockLockCount(TLSData &tls)
 {
-  _threadCreationLockLockCount++;
+  tls.threadCreationLockLockCount++;
 }
 
-static void decrementThreadCreationLockLockCount()
+static void decrementThreadCreationLockLockCount(TLSData &tls)
 {
-  _threadCreationLockLockCount--;
-  dmtcp::ThreadSync::sendCkptSignalOnFinalUnlock();
+  tls.threadCreationLockLockCount--;
+  sendCkptSignalOnFinalUnlock(tls);
 }
 
-// XXX: Handle deadlock error code
 // NOTE: Don't do any fancy stuff in this wrapper which can cause the process
 //       to go into DEADLOCK
 bool dmtcp::ThreadSync::wrapperExecutionLockLock()
 {
   int saved_errno = errno;
   bool lockAcquired = false;
+  TLSData &tls = getTLSData();
   while (1) {
     if (WorkerState::currentState() == WorkerState::RUNNING &&
-        isThreadPerformingDlopenDlsym() == false &&
+        tls.threadPerformingDlopenDlsym == false &&
         isCheckpointThreadInitialized() == true  &&
-        isOkToGrabLock() == true) {
-      incrementWrapperExecutionLockLockCount();
-      int retVal = _real_pthread_rwlock_tryrdlock(&_wrapperExecutionLock);
-      if (retVal != 0 && retVal == EBUSY) {
-        decrementWrapperExecutionLockLockCount();
-        struct timespec sleepTime = {0, 100*1000*1000};
-        nanosleep(&sleepTime, NULL);
-        continue;
-      }
-      if (retVal != 0 && retVal != EDEADLK) {
-        fprintf(stderr, "ERROR %d at %s:%d %s: Failed to acquire lock\n",
-                errno, __FILE__, __LINE__, __PRETTY_FUNCTION__);
-        _exit(1);
+        tls.isOkToGrabWrapperExecutionLock == true) {
+      WrapperExecutionRecord *rec = getWrapperExecutionRecord(tls);
+      if (_wrapperExecutionExclOwner == rec) {
+        // We already hold the lock exclusively (fork/exec wrapper).
+        break;
       }
-      // retVal should always be 0 (success) here.
-      lockAcquired = retVal == 0 ? true : false;
-      if (!lockAcquired) {
-        decrementWrapperExecutionLockLockCount();
+      incrementWrapperExecutionLockLockCount(tls);
+      rec->count++;
+      // A nested wrapper is already accounted for by the outermost one.
+      if (rec->count == 1) {
+        // Pairs with the barrier in drainWrapperExecutionRecords(): either
+        // the writer sees our count, or we see its barrier.
+        __sync_synchronize();
+        if (_wrapperExecutionBarrier) {
+          rec->count--;
+          decrementWrapperExecutionLockLockCount(tls);
+          struct timespec sleepTime = {0, 100*1000*1000};
+          nanosleep(&sleepTime, NULL);
+          continue;
+        }
       }
+      lockAcquired = true;
     }
     break;
   }
@@ -399,13 +549,21 @@ bool dmtcp::ThreadSync::wrapperExecutionLockLockExcl()
 {
   int saved_errno = errno;
   bool lockAcquired = false;
+  TLSData &tls = getTLSData();
   while (1) {
     if (WorkerState::currentState() == WorkerState::RUNNING &&
         isCheckpointThreadInitialized() == true) {
-      incrementWrapperExecutionLockLockCount();
-      int retVal = _real_pthread_rwlock_trywrlock(&_wrapperExecutionLock);
+      incrementWrapperExecutionLockLockCount(tls);
+      WrapperExecutionRecord *rec = getWrapperExecutionRecord(tls);
+      int retVal = _real_pthread_mutex_trylock(&_wrapperExecutionWriterLock);
+      // Give up after ~100ms if some thread stays inside a wrapper (e.g.
+      // blocked in a system call), so as to let the other threads proceed.
+      if (retVal == 0 && !drainWrapperExecutionRecords(rec, 100)) {
+        _real_pthread_mutex_unlock(&_wrapperExecutionWriterLock);
+        retVal = EBUSY;
+      }
       if (retVal != 0 && retVal == EBUSY) {
-        decrementWrapperExecutionLockLockCount();
+        decrementWrapperExecutionLockLockCount(tls);
         struct timespec sleepTime = {0, 100*1000*1000};
         nanosleep(&sleepTime, NULL);
         continue;
@@ -417,11 +575,14 @@ bool dmtcp::ThreadSync::wrapperExecutionLockLockExcl()
       }
       // retVal should always be 0 (success) here.
       lockAcquired = retVal == 0 ? true : false;
+      if (lockAcquired) {
+        _wrapperExecutionExclOwner = rec;
+      }
     }
     break;
   }
   if (!lockAcquired) {
-    decrementWrapperExecutionLockLockCount();
+    decrementWrapperExecutionLockLockCount(tls);
   }
   errno = saved_errno;
   return lockAcquired;
@@ -441,13 +602,23 @@ void dmtcp::ThreadSync::wrapperExecutionLockUnlock()
             __FILE__, __LINE__, __PRETTY_FUNCTION__);
     _exit(1);
   }
-  if (_real_pthread_rwlock_unlock(&_wrapperExecutionLock) != 0) {
+  TLSData &tls = getTLSData();
+  WrapperExecutionRecord *rec = tls.wrapperExecutionRecord;
+  if (rec != NULL && _wrapperExecutionExclOwner == rec) {
+    releaseWrapperExecutionBarrier();
+    if (_real_pthread_mutex_unlock(&_wrapperExecutionWriterLock) != 0) {
+      fprintf(stderr, "ERROR %s:%d %s: Failed to release lock\n",
+              __FILE__, __LINE__, __PRETTY_FUNCTION__);
+      _exit(1);
+    }
+  } else if (rec != NULL && rec->count > 0) {
+    rec->count--;
+  } else {
     fprintf(stderr, "ERROR %s:%d %s: Failed to release lock\n",
             __FILE__, __LINE__, __PRETTY_FUNCTION__);
     _exit(1);
-  } else {
-    decrementWrapperExecutionLockLockCount();
   }
+  decrementWrapperExecutionLockLockCount(tls);
   errno = saved_errno;
 }
 
@@ -455,12 +626,13 @@ bool dmtcp::ThreadSync::threadCreationLockLock()
 {
   int saved_errno = errno;
   bool lockAcquired = false;
+  TLSData &tls = getTLSData();
   while (1) {
     if (WorkerState::currentState() == WorkerState::RUNNING) {
-      incrementThreadCreationLockLockCount();
+      incrementThreadCreationLockLockCount(tls);
       int retVal = _real_pthread_rwlock_tryrdlock(&_threadCreationLock);
       if (retVal != 1 && retVal == EBUSY) {
-        decrementThreadCreationLockLockCount();
+        decrementThreadCreationLockLockCount(tls);
         struct timespec sleepTime = {0, 100*1000*1000};
         nanosleep(&sleepTime, NULL);
         continue;
@@ -476,7 +648,7 @@ bool dmtcp::ThreadSync::threadCreationLockLock()
     break;
   }
   if (!lockAcquired) {
-    decrementThreadCreationLockLockCount();
+    decrementThreadCreationLockLockCount(tls);
   }
   errno = saved_errno;
   return lockAcquired;
@@ -493,12 +665,13 @@ void dmtcp::ThreadSync::threadCreationLockUnlock()
             __FILE__, __LINE__, __PRETTY_FUNCTION__);
     _exit(1);
   }
+  TLSData &tls = getTLSData();
   if (_real_pthread_rwlock_unlock(&_threadCreationLock) != 0) {
     fprintf(stderr, "ERROR %s:%d %s: Failed to release lock\n",
             __FILE__, __LINE__, __PRETTY_FUNCTION__);
     _exit(1);
   } else {
-    decrementThreadCreationLockLockCount();
+    decrementThreadCreationLockLockCount(tls);
   }
   errno = saved_errno;
 }
@@ -74,6 +74,7 @@ namespace dmtcp
     bool wrapperExecutionLockLock();
     void wrapperExecutionLockUnlock();
     bool wrapperExecutionLockLockExcl();
+    void releaseWrapperExecutionRecord();
 
     bool threadCreationLockLock();
     void threadCreationLockUnlock();
@@ -91,6 +92,7 @@ namespace dmtcp
 
     bool isCheckpointThreadInitialized();
     void setCheckpointThreadInitialized();
+    void waitForCheckpointThreadInitialized();
 
     bool isOkToGrabLock();
     void setOkToGrabLock();
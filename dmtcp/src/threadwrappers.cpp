@@ -133,6 +133,9 @@ static void *pthread_start(void *arg)
   dmtcp_process_event(DMTCP_EVENT_PTHREAD_RETURN, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
   dmtcp::ThreadSync::unsetOkToGrabLock();
+  dmtcp::ThreadSync::releaseWrapperExecutionRecord();
+  JALLOC_HELPER_FLUSH_THREAD_CACHE();
+  JASSERT_RELEASE_THREAD_LOG();
   return result;
 }
 
@@ -195,6 +198,9 @@ extern "C" void pthread_exit(void * retval)
   dmtcp_process_event(DMTCP_EVENT_PTHREAD_EXIT, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
   dmtcp::ThreadSync::unsetOkToGrabLock();
+  dmtcp::ThreadSync::releaseWrapperExecutionRecord();
+  JALLOC_HELPER_FLUSH_THREAD_CACHE();
+  JASSERT_RELEASE_THREAD_LOG();
   _real_pthread_exit(retval);
   for(;;); // To hide compiler warning about "noreturn" function
 }
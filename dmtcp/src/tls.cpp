@@ -23,6 +23,8 @@
 #include <constants.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include "syscallwrappers.h"
 
 
 extern "C" {
@@ -34,6 +36,8 @@ extern "C" {
 
 namespace dmtcp {
 
+TLSUtils::pthread_getspecific_t TLSUtils::_getspecific = NULL;
+
 TLSUtils &TLSUtils::instance() {
   static TLSUtils _instance;
   return _instance;
@@ -58,6 +62,8 @@ TLSUtils::TLSUtils() {
   func = _dlsym(handle, "pthread_key_delete");
   _pthread_key_delete
     = (pthread_key_delete_t)func;
+
+  _getspecific = _pthread_getspecific;
 }
 
 void *TLSUtils::pthread_getspecific(pthread_key_t key) {
@@ -77,6 +83,12 @@ int TLSUtils::pthread_key_delete(pthread_key_t key) {
   return instance()._pthread_key_delete(key);
 }
 
+void *TLSUtils::allocate(size_t size) {
+  void *p = _real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
 void TLSUtils::debug(const char *str) {
 }
 
@@ -22,7 +22,62 @@
 #ifndef TLS_H
 #define TLS_H
 
+#include <stddef.h>
 #include <pthread.h>
+
+/* On bionic, a pthread key is an index into the thread's TLS slot array, so
+ * the lookup is a single load off the thread pointer.  Define
+ * DMTCP_TLS_NO_BIONIC_SLOTS to go through pthread_getspecific() instead, as
+ * on glibc (e.g. to build test/dmtcp-tls.cpp on Linux).
+ */
+#if defined(ANDROID) && !defined(DMTCP_TLS_NO_BIONIC_SLOTS)
+# define DMTCP_TLS_BIONIC_SLOTS
+extern "C" {
+#include <libc/private/bionic_tls.h>
+}
+#endif
+
+namespace dmtcp
+{
+  class TLSUtils {
+    public:
+      typedef void *(*pthread_getspecific_t)(pthread_key_t);
+      typedef int (*pthread_setspecific_t)(pthread_key_t, const void *);
+      typedef int (*pthread_key_create_t)(pthread_key_t *,
+                                          void (*dtor)(void *));
+      typedef int (*pthread_key_delete_t)(pthread_key_t);
+
+      static inline void *getSpecific(pthread_key_t key) {
+#ifdef DMTCP_TLS_BIONIC_SLOTS
+        return ((void**)__get_tls())[key];
+#else
+        return _getspecific(key);
+#endif
+      }
+      static void *pthread_getspecific(pthread_key_t key);
+      static int pthread_setspecific(pthread_key_t key, const void *value);
+      static int pthread_key_create(pthread_key_t *key,
+                                    void (*dtor)(void *));
+      static int pthread_key_delete(pthread_key_t key);
+      // Zero-filled memory that does not go through the malloc/mmap
+      // wrappers; never freed.
+      static void *allocate(size_t size);
+      static void debug(const char *str);
+    private:
+      static TLSUtils &instance();
+      TLSUtils();
+
+      // Cached copy of _pthread_getspecific for the fast path.  Set by the
+      // constructor, i.e. before the first TLS<T> key is created.
+      static pthread_getspecific_t _getspecific;
+
+      pthread_getspecific_t _pthread_getspecific;
+      pthread_setspecific_t _pthread_setspecific;
+      pthread_key_create_t _pthread_key_create;
+      pthread_key_delete_t _pthread_key_delete;
+  };
+}
+
 #include "tls_allocator.hpp"
 
 namespace dmtcp
@@ -39,8 +94,9 @@ namespace dmtcp
       operator const T&() const;
       const T &operator=(const T &val) const;
     private:
-      typedef Allocator<T, 2048> TLSAllocator;
+      typedef Allocator<T> TLSAllocator;
       T *get() const;
+      T *allocate() const;
       pthread_key_t _tlsKey;
       T _default;
       static TLSAllocator &allocator();
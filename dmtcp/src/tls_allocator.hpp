@@ -1,16 +1,25 @@
 #include <stdlib.h>
-#include <sys/atomics.h>
-extern "C" {
-#include <libc/private/bionic_atomic_inline.h>
-#include <libc/private/bionic_futex.h>
-}
+
 namespace dmtcp {
-template <class T, size_t Capacity = 1024>
+/*
+ * Backing store for TLS<T>: one Item per thread.
+ *
+ * Items live in chunks of ChunkSize items which are allocated on demand
+ * (there is no limit on the number of threads) and never released, so that
+ * an Item handed out to a thread stays valid for the life of the process.
+ * Everything is lock-free, since alloc() runs the first time a thread enters
+ * a DMTCP wrapper:
+ *   - alloc() claims an Item by a CAS on its _inUse flag;
+ *   - when all chunks are full, a new chunk is pushed on the list by a CAS;
+ *   - free() (the pthread key destructor) just clears _inUse.
+ * Because Items are never unlinked, there is no ABA problem.
+ */
+template <class T, size_t ChunkSize = 256>
 class Allocator {
   public:
     class Item {
       public:
-        Item *_next;
+        volatile int _inUse;
         T _obj;
     };
   public:
@@ -18,68 +27,50 @@ class Allocator {
     Item *alloc();
     void free(Item *item);
   private:
-    Item _item[Capacity];
-    Item *_freeHead;
-    volatile int _lock;
-
-    void lock();
-    void unlock();
+    class Chunk {
+      public:
+        Chunk *_next;
+        Item _item[ChunkSize];
+    };
+    Chunk * volatile _chunks;
 };
 
-template <class T, size_t Capacity>
-Allocator<T, Capacity>::Allocator()
-  : _freeHead(&_item[0])
-  , _lock(0)
+template <class T, size_t ChunkSize>
+Allocator<T, ChunkSize>::Allocator()
+  : _chunks(NULL)
 {
-  size_t i;
-  for (i = 0;i<Capacity-1;++i) {
-    _item[i]._next = &_item[i+1];
-  }
-  _item[i]._next = NULL;
 }
 
-template <class T, size_t Capacity>
-typename Allocator<T, Capacity>::Item *Allocator<T, Capacity>::alloc() {
-  lock();
-  Item *item = _freeHead;
-  if (item != NULL) {
-    _freeHead = _freeHead->_next;
+template <class T, size_t ChunkSize>
+typename Allocator<T, ChunkSize>::Item *Allocator<T, ChunkSize>::alloc() {
+  for (Chunk *chunk = _chunks; chunk != NULL; chunk = chunk->_next) {
+    for (size_t i = 0; i < ChunkSize; i++) {
+      Item *item = &chunk->_item[i];
+      if (item->_inUse == 0 &&
+          __sync_bool_compare_and_swap(&item->_inUse, 0, 1)) {
+        return item;
+      }
+    }
   }
-  unlock();
-  return item;
-}
 
-template <class T, size_t Capacity>
-void Allocator<T, Capacity>::free(Item *item) {
-  int *crash = NULL;
-  lock();
-  /* Not in our _item ? */
-  if (item < &_item[0] && item >= &_item[Capacity]) {
-    /* Just crash now !! */
-    *crash = 0xdeaddead;
+  /* All Items are taken; grow.  The new chunk is zero-filled, so all of its
+   * Items are free, and nobody else can see it before the push.
+   */
+  Chunk *chunk = (Chunk *) TLSUtils::allocate(sizeof(Chunk));
+  if (chunk == NULL) {
+    return NULL;
   }
-  item->_next = _freeHead;
-  _freeHead = item;
-  unlock();
+  chunk->_item[0]._inUse = 1;
+  do {
+    chunk->_next = _chunks;
+  } while (!__sync_bool_compare_and_swap(&_chunks, chunk->_next, chunk));
+  return &chunk->_item[0];
 }
 
-template <class T, size_t Capacity>
-void Allocator<T, Capacity>::lock() {
-  /* Grab from _normal_lock in Android/bionic */
-  if (__atomic_cmpxchg( 0, 1, &_lock ) != 0) {
-    while (__atomic_swap(2, &_lock ) != 0)
-    __futex_wait_ex(&_lock, 0, 2, 0);
-  }
-  ANDROID_MEMBAR_FULL();
-}
-
-template <class T, size_t Capacity>
-void Allocator<T, Capacity>::unlock() {
-  /* Grab from _normal_unlock in Android/bionic */
-  if (__atomic_dec(&_lock) != 1) {
-    _lock = 0;
-    __futex_wake_ex(&_lock, 0, 1);
-  }
+template <class T, size_t ChunkSize>
+void Allocator<T, ChunkSize>::free(Item *item) {
+  __sync_synchronize();
+  item->_inUse = 0;
 }
 
 }
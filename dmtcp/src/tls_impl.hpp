@@ -1,34 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
-extern "C" {
-ssize_t tls_write(int fd, const void *buf, size_t count);
-}
-
-namespace dmtcp {
-  class TLSUtils {
-    public:
-      typedef void *(*pthread_getspecific_t)(pthread_key_t);
-      typedef int (*pthread_setspecific_t)(pthread_key_t, const void *);
-      typedef int (*pthread_key_create_t)(pthread_key_t *,
-                                          void (*dtor)(void *));
-      typedef int (*pthread_key_delete_t)(pthread_key_t);
-
-      static void *pthread_getspecific(pthread_key_t key);
-      static int pthread_setspecific(pthread_key_t key, const void *value);
-      static int pthread_key_create(pthread_key_t *key,
-                                    void (*dtor)(void *));
-      static int pthread_key_delete(pthread_key_t key);
-      static void debug(const char *str);
-    private:
-      static TLSUtils &instance();
-      TLSUtils();
-
-      pthread_getspecific_t _pthread_getspecific;
-      pthread_setspecific_t _pthread_setspecific;
-      pthread_key_create_t _pthread_key_create;
-      pthread_key_delete_t _pthread_key_delete;
-  };
-}
 
 namespace dmtcp {
   template<class T>
@@ -67,14 +39,24 @@ namespace dmtcp {
   }
 
   template<class T>
-  T *TLS<T>::get() const {
+  inline T *TLS<T>::get() const {
     typename TLSAllocator::Item *data =
-      (typename TLSAllocator::Item *)TLSUtils::pthread_getspecific(_tlsKey);
+      (typename TLSAllocator::Item *)TLSUtils::getSpecific(_tlsKey);
+    if (__builtin_expect(data == NULL, 0)) {
+      return allocate();
+    }
+    return &data->_obj;
+  }
+
+  template<class T>
+  T *TLS<T>::allocate() const {
+    typename TLSAllocator::Item *data = allocator().alloc();
     if (data == NULL) {
-      data = allocator().alloc();
-      data->_obj = _default;
-      TLSUtils::pthread_setspecific(_tlsKey, (void*)data);
+      TLSUtils::debug("TLS: out of memory\n");
+      abort();
     }
+    data->_obj = _default;
+    TLSUtils::pthread_setspecific(_tlsKey, (void*)data);
     return &data->_obj;
   }
 
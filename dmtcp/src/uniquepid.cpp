@@ -238,16 +238,6 @@ void dmtcp::UniquePid::updateCkptDir()
   setCkptDir(o.str().c_str());
 }
 
-dmtcp::string dmtcp::UniquePid::dmtcpTableFilename()
-{
-  static int count = 0;
-  dmtcp::ostringstream os;
-
-  os << getTmpDir() << "/dmtcpConTable." << ThisProcess()
-     << '_' << jalib::XToString ( count++ );
-  return os.str();
-}
-
 dmtcp::string dmtcp::UniquePid::pidTableFilename()
 {
   static int count = 0;
@@ -61,7 +61,6 @@ namespace dmtcp
     static void setTmpDir(const char * envVarTmpDir);
     static dmtcp::string getTmpDir();
 
-    static dmtcp::string dmtcpTableFilename();
     static dmtcp::string pidTableFilename();
 
     static void serialize( jalib::JBinarySerializer& o );
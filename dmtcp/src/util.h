@@ -27,6 +27,7 @@
 #include <string>
 #include <sstream>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/syscall.h>
 #include "constants.h"
 #include "dmtcpalloc.h"
@@ -60,6 +61,10 @@ namespace dmtcp
     ssize_t writeAll(int fd, const void *buf, size_t count);
     ssize_t readAll(int fd, void *buf, size_t count);
 
+    int createAnonymousFile(const char *name);
+    int copyFileData(int srcFd, int destFd, off_t size);
+    int hashFileData(int fd, off_t size, uint64_t *hash);
+
     int safeMkdir(const char *pathname, mode_t mode);
     int safeSystem(const char *command);
 
@@ -85,6 +90,10 @@ namespace dmtcp
     void prepareDlsymWrapper();
     void adjustRlimitStack();
 
+    void startupTraceBegin();
+    void startupTraceStep(const char *name);
+    void startupTraceReport(const char *what, const dmtcp::string& procname);
+
     char readDec (int fd, VA *value);
     char readHex (int fd, VA *value);
     char readChar (int fd);
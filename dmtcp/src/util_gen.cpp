@@ -26,9 +26,12 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <linux/limits.h>
 #include "constants.h"
 #include  "util.h"
+#include  "uniquepid.h"
 #include  "syscallwrappers.h"
 #include  "dmtcpplugin.h"
 #include  "../jalib/jassert.h"
@@ -149,6 +152,147 @@ ssize_t dmtcp::Util::readAll(int fd, void *buf, size_t count)
   return num_read;
 }
 
+#ifndef FICLONE
+# define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#define COPY_FILE_CHUNK_SIZE (1024 * 1024)
+
+// Copies the first 'size' bytes of srcFd into the empty file destFd without
+// moving the file offset of srcFd; the offset of destFd is left at the end
+// of the data copied.  A reflink (FICLONE) is tried first
+// since it costs nothing on btrfs/xfs, then the in-kernel copy_file_range(),
+// and finally a plain pread()/write() loop.
+// Returns 0 on success, -1 on error (with errno set).
+// NOTE: It uses neither JASSERT nor the JALLOC allocator, so that it may be
+// called from the helper processes that save open files in parallel at
+// checkpoint time.
+int dmtcp::Util::copyFileData(int srcFd, int destFd, off_t size)
+{
+  if (_real_syscall(SYS_ioctl, destFd, FICLONE, srcFd) == 0) {
+    return 0;
+  }
+
+  off_t offset = 0;
+#ifdef SYS_copy_file_range
+  int64_t inOff = 0; // loff_t
+  while (offset < size) {
+    long rc = _real_syscall(SYS_copy_file_range, srcFd, &inOff, destFd, NULL,
+                            (size_t) (size - offset), 0);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    } else if (rc <= 0) {
+      break;
+    }
+    offset += rc;
+  }
+  if (offset >= size) {
+    return 0;
+  }
+  // Unsupported (ENOSYS, EXDEV, EINVAL) or partially done.  With a NULL
+  // out-offset, copy_file_range() advanced destFd's offset by what it
+  // copied; set it explicitly anyway and continue with the slow path.
+  if (lseek(destFd, offset, SEEK_SET) == -1) {
+    return -1;
+  }
+#endif
+
+  char *buf = (char*) _real_mmap(NULL, COPY_FILE_CHUNK_SIZE,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return -1;
+  }
+  int ret = 0;
+  while (offset < size) {
+    size_t count = size - offset;
+    if (count > COPY_FILE_CHUNK_SIZE) count = COPY_FILE_CHUNK_SIZE;
+    ssize_t rc = pread(srcFd, buf, count, offset);
+    if (rc == -1 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    } else if (rc <= 0) {
+      // EOF before 'size': the file was truncated under us.
+      ret = rc == 0 ? 0 : -1;
+      break;
+    }
+    ssize_t written = 0;
+    while (written < rc) {
+      ssize_t wc = _real_write(destFd, buf + written, rc - written);
+      if (wc == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+      if (wc <= 0) { ret = -1; break; }
+      written += wc;
+    }
+    if (ret == -1) break;
+    offset += rc;
+  }
+  _real_munmap(buf, COPY_FILE_CHUNK_SIZE);
+  return ret;
+}
+
+// 64-bit FNV-1a hash of the first 'size' bytes of fd into *hash; the fd
+// offset is not moved.  Used to detect unchanged files between checkpoints.
+// Returns 0 on success, -1 (with errno set) on failure.  Same restrictions
+// as copyFileData() above.
+int dmtcp::Util::hashFileData(int fd, off_t size, uint64_t *hash)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int ret = 0;
+  unsigned char *buf = (unsigned char*) _real_mmap(NULL, COPY_FILE_CHUNK_SIZE,
+                                                   PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS,
+                                                   -1, 0);
+  if (buf == MAP_FAILED) {
+    return -1;
+  }
+  off_t offset = 0;
+  while (offset < size) {
+    size_t count = size - offset;
+    if (count > COPY_FILE_CHUNK_SIZE) count = COPY_FILE_CHUNK_SIZE;
+    ssize_t rc = pread(fd, buf, count, offset);
+    if (rc == -1 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    } else if (rc == -1) {
+      ret = -1;
+      break;
+    } else if (rc == 0) {
+      break;
+    }
+    for (ssize_t i = 0; i < rc; i++) {
+      h = (h ^ buf[i]) * 1099511628211ULL;
+    }
+    offset += rc;
+  }
+  _real_munmap(buf, COPY_FILE_CHUNK_SIZE);
+  // Mix in the length so that a truncated read never matches a full one.
+  *hash = h ^ (uint64_t) offset;
+  return ret;
+}
+
+// Returns a read-write fd on an anonymous, memory-backed file, to pass state
+// to another process (across exec() or fork()) without going through
+// $DMTCP_TMPDIR.  The fd is not close-on-exec.  'name' only shows up in
+// /proc/PID/fd.  Falls back to an already unlinked file in $DMTCP_TMPDIR on
+// kernels without memfd_create(); either way nothing is left behind if the
+// processes crash.  Returns -1 on error (with errno set).
+int dmtcp::Util::createAnonymousFile(const char *name)
+{
+#ifdef SYS_memfd_create
+  int fd = _real_syscall(SYS_memfd_create, name, 0);
+  if (fd != -1 || errno != ENOSYS) {
+    return fd;
+  }
+#endif
+  dmtcp::string path = dmtcp::UniquePid::getTmpDir() + "/" + name + ".XXXXXX";
+  char *buf = (char*) JALLOC_HELPER_MALLOC(path.length() + 1);
+  strcpy(buf, path.c_str());
+  int tmpfd = mkstemp(buf);
+  if (tmpfd != -1) {
+    unlink(buf);
+  }
+  JALLOC_HELPER_FREE(buf);
+  return tmpfd;
+}
+
 /* Begin miscellaneous/helper functions. */
 // Reads from fd until count bytes are read, or newline encountered.
 // Returns NULL at EOF.
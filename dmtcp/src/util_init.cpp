@@ -25,18 +25,17 @@
 #include <sstream>
 #include <errno.h>
 #include <dlfcn.h>
+#include <sys/time.h>
 #include "constants.h"
 #include  "util.h"
 #include  "uniquepid.h"
+#include  "protectedfds.h"
 #include  "../jalib/jassert.h"
 #include  "../jalib/jfilesystem.h"
-#include "protectedfds.h"
 
 void dmtcp::Util::initializeLogFile(dmtcp::string procname, dmtcp::string prevLogPath)
 {
   dmtcp::UniquePid::ThisProcess(true);
-#ifdef DEBUG
-  // Initialize JASSERT library here
   dmtcp::ostringstream o;
   o << dmtcp::UniquePid::getTmpDir() << "/jassertlog."
     << dmtcp::UniquePid::ThisProcess()
@@ -47,6 +46,11 @@ void dmtcp::Util::initializeLogFile(dmtcp::string procname, dmtcp::string prevLo
     o << procname;
   }
 
+  if (getenv(ENV_VAR_BINARY_LOG) != NULL) {
+    JASSERT_SET_BINARY_LOGFILE(o.str() + ".bin", PROTECTED_JASSERTBINLOG_FD);
+  }
+#ifdef DEBUG
+  // Initialize JASSERT library here
   JASSERT_INIT(o.str());
 
   dmtcp::ostringstream a;
@@ -83,3 +87,60 @@ void dmtcp::Util::initializeLogFile(dmtcp::string procname, dmtcp::string prevLo
     jassert_quiet = 0;
   }
 }
+
+/* Opt-in (DMTCP_STARTUP_TRACE) timeline of the phases of the startup of a
+ * process (DmtcpWorker) or of a restart (dmtcp_restart).  Only timestamps are
+ * taken while the steps run; the summary is printed at the end, once jalib is
+ * usable.  The steps recorded before a fork are inherited by the child.
+ */
+#define MAX_STARTUP_STEPS 16
+static bool startupTraceEnabled = false;
+static int numStartupSteps = 0;
+static struct timeval startupTraceStart;
+static struct {
+  const char *name;
+  struct timeval end;
+} startupSteps[MAX_STARTUP_STEPS];
+
+void dmtcp::Util::startupTraceBegin()
+{
+  startupTraceEnabled = getenv(ENV_VAR_STARTUP_TRACE) != NULL;
+  numStartupSteps = 0;
+  if (startupTraceEnabled) {
+    gettimeofday(&startupTraceStart, NULL);
+  }
+}
+
+void dmtcp::Util::startupTraceStep(const char *name)
+{
+  if (startupTraceEnabled && numStartupSteps < MAX_STARTUP_STEPS) {
+    startupSteps[numStartupSteps].name = name;
+    gettimeofday(&startupSteps[numStartupSteps].end, NULL);
+    numStartupSteps++;
+  }
+}
+
+static double msecBetween(const struct timeval& a, const struct timeval& b)
+{
+  return (b.tv_sec - a.tv_sec) * 1000.0 + (b.tv_usec - a.tv_usec) / 1000.0;
+}
+
+void dmtcp::Util::startupTraceReport(const char *what,
+                                     const dmtcp::string& procname)
+{
+  if (!startupTraceEnabled || numStartupSteps == 0) return;
+
+  dmtcp::ostringstream o;
+  o.setf(std::ios::fixed);
+  o.precision(3);
+  o << "[" << getpid() << "] DMTCP " << what << " of " << procname << " (ms):";
+  const struct timeval *prev = &startupTraceStart;
+  for (int i = 0; i < numStartupSteps; i++) {
+    o << " " << startupSteps[i].name << "="
+      << msecBetween(*prev, startupSteps[i].end);
+    prev = &startupSteps[i].end;
+  }
+  o << " total=" << msecBetween(startupTraceStart, *prev) << "\n";
+  JASSERT_STDERR << o.str();
+  startupTraceEnabled = false;
+}
@@ -51,6 +51,9 @@ void dmtcp::DmtcpWorker::resetOnFork(jalib::JSocket& coordSock)
   new ( &theInstance ) DmtcpWorker ( false );
 
   dmtcp::DmtcpWorker::_exitInProgress = false;
+  // The child has its own coordinator connection; any exec() ack belongs to
+  // the parent's.
+  dmtcp::DmtcpWorker::_execAckPending = false;
 
   WorkerState::setCurrentState ( WorkerState::RUNNING );
   instance()._coordinatorId = coordinatorId;
@@ -63,10 +66,7 @@ void dmtcp::DmtcpWorker::resetOnFork(jalib::JSocket& coordSock)
   /* Now wait for Checkpoint Thread to finish initialization
    * NOTE: This should be the last thing in this function
    */
-  while (!ThreadSync::isCheckpointThreadInitialized()) {
-    struct timespec sleepTime = {0, 10*1000*1000};
-    nanosleep(&sleepTime, NULL);
-  }
+  ThreadSync::waitForCheckpointThreadInitialized();
 }
 
 //to allow linking without mtcpinterface
@@ -92,7 +92,9 @@
 #include <fenv.h>          // for fegetround, fesetround
 #ifndef ANDROID
 #include <gnu/libc-version.h>
+#include <malloc.h>        // for malloc_trim
 #endif
+#include <alloca.h>
 
 #define MTCP_SYS_STRCPY
 #define MTCP_SYS_STRLEN
@@ -412,6 +414,9 @@ static sem_t sem_start;
 
 typedef struct Thread Thread;
 
+#define MTCP_MAX_CPUS 1024   /* CPU_SETSIZE */
+#define MTCP_CPUMASK_BITS (8 * sizeof(long))
+
 struct Thread { Thread *next;         // next thread in 'threads' list
                 Thread *prev;        // prev thread in 'threads' list
                 int tid;              // this thread's id as returned by
@@ -446,6 +451,12 @@ struct Thread { Thread *next;         // next thread in 'threads' list
                 ucontext_t savctx;     // context saved on suspend
 #endif
 
+                int sched_saved;       // the five fields below are valid
+                int schedpolicy;       // policy, priority and nice value,
+                struct sched_param schedparam; //   saved on suspend;
+                int nice;              //   see save_sched_state()
+                unsigned long cpumask[MTCP_MAX_CPUS / (8 * sizeof(long))];
+
                 mtcp_segreg_t fs, gs;  // thread local storage pointers
 #if MTCP__SAVE_MANY_GDT_ENTRIES
                 struct user_desc gdtentrytls[GDT_ENTRY_TLS_ENTRIES];
@@ -539,6 +550,22 @@ static size_t checkpointsize;
 static int intervalsecs;
 static pid_t motherpid = 0;
 static int showtiming;
+static int trimheap;              /* DMTCP_TRIM_HEAP; see trim_free_heap() */
+static size_t heap_bytes_saved;   /* free heap not written, this checkpoint */
+static int numapages;             /* DMTCP_NUMA_PAGES; see mtcp_internal.h */
+static int skipfilepages;         /* DMTCP_SKIP_FILE_PAGES; see mtcp_internal.h */
+static int pagemapfd = -1;        /* /proc/self/pagemap, while writing areas */
+static size_t file_bytes_skipped; /* clean file pages not written */
+static int dedup;                 /* DMTCP_DEDUP; see mtcp_internal.h */
+static char dedupstore[PATH_MAX]; /* the store, "" if it can't be used */
+static char dedupdir[PATH_MAX];   /* this image's links into the store */
+static size_t dedup_bytes;        /* contents of MTCP_PROT_DEDUP areas */
+static size_t dedup_bytes_found;  /* ... of which already in the store */
+static size_t dedup_bytes_added;  /* ... of which added to the store */
+static int trimstacks;            /* DMTCP_TRIM_STACKS */
+static VA dead_stack_start;       /* see set_dead_stack_range() */
+static VA dead_stack_end;
+static size_t stack_bytes_skipped;
 static int threadenabledefault;
 static int verify_count;  // number of checkpoints to go
 static int verify_total;  // value given by envar
@@ -582,6 +609,7 @@ static void (*callback_restore_virtual_pid_table)() = NULL;
 static void (*callback_holds_any_locks)(int *retval) = NULL;
 static void (*callback_pre_suspend_user_thread)() = NULL;
 static void (*callback_pre_resume_user_thread)(int is_ckpt, int is_restart) = NULL;
+static int  (*callback_ckpt_shared_area)(void *addr) = NULL;
 static void (*callback_send_stop_signal)(pid_t tid, int *retry_signalling,
                                          int *retval) = NULL;
 
@@ -636,6 +664,15 @@ static int test_use_compression(char *compressor, char *command, char *path,
                                 int def);
 static int open_ckpt_to_write(int fd, int pipe_fds[2], char **args);
 static void checkpointeverything (void);
+static void trim_free_heap (void);
+static void read_hugepage_areas (void);
+static int hugepage_state (VA addr);
+static void save_numa_placement (Area *area);
+static int get_suspended_stack_pointers (VA *sps, int max);
+static void set_dead_stack_range (Area *area, int above_guard_page,
+                                  VA *sps, int nsps);
+static void open_dedup_store (void);
+static void remove_stale_dedup_refs (void);
 static void writefiledescrs (int fd, int fdCkptFileOnDisk);
 static void writememoryarea (int fd, Area *area,
 			     int stack_was_seen, int vsyscall_exists);
@@ -648,6 +685,9 @@ static void restore_sig_state (Thread *thisthread);
 static void save_sig_handlers (void);
 static void restore_sig_handlers (Thread *thisthread);
 static void save_tls_state (Thread *thisthread);
+static void save_sched_state (Thread *thisthread);
+static void read_restart_cpus (void);
+static void restore_sched_state (Thread *thisthread);
 static void renametempoverperm (void);
 static Thread *getcurrenthread (void);
 static void lock_threads (void);
@@ -838,6 +878,33 @@ void mtcp_init (char const *checkpointfilename,
   p = getenv ("MTCP_SHOWTIMING");
   showtiming = ((p != NULL) && (*p & 1));
 
+  p = getenv ("DMTCP_TRIM_HEAP");
+  if (p == NULL)
+    p = getenv ("MTCP_TRIM_HEAP");
+  trimheap = ((p != NULL) && (*p & 1));
+
+  p = getenv ("DMTCP_TRIM_STACKS");
+  if (p == NULL)
+    p = getenv ("MTCP_TRIM_STACKS");
+  trimstacks = ((p != NULL) && (*p & 1));
+
+  p = getenv ("DMTCP_NUMA_PAGES");
+  if (p == NULL)
+    p = getenv ("MTCP_NUMA_PAGES");
+  numapages = ((p != NULL) && (*p & 1));
+
+#ifndef FAST_CKPT_RST_VIA_MMAP
+  p = getenv ("DMTCP_SKIP_FILE_PAGES");
+  if (p == NULL)
+    p = getenv ("MTCP_SKIP_FILE_PAGES");
+  skipfilepages = ((p != NULL) && (*p & 1));
+
+  p = getenv ("DMTCP_DEDUP");
+  if (p == NULL)
+    p = getenv ("MTCP_DEDUP");
+  dedup = ((p != NULL) && (*p & 1));
+#endif
+
   /* Maybe dump out some stuff about the TLS */
 
   mtcp_dump_tls (__FILE__, __LINE__);
@@ -1037,12 +1104,14 @@ void mtcp_set_dmtcp_callbacks(void (*restore_virtual_pid_table)(),
                               void (*holds_any_locks)(int *retval),
                               void (*pre_suspend_user_thread)(),
                               void (*pre_resume_user_thread)(int is_ckpt,
-                                                             int is_restart))
+                                                             int is_restart),
+                              int  (*ckpt_shared_area)(void *addr))
 {
   callback_restore_virtual_pid_table = restore_virtual_pid_table;
   callback_holds_any_locks = holds_any_locks;
   callback_pre_suspend_user_thread = pre_suspend_user_thread;
   callback_pre_resume_user_thread = pre_resume_user_thread;
+  callback_ckpt_shared_area = ckpt_shared_area;
 }
 
 /*************************************************************************
@@ -2284,6 +2353,8 @@ again:
 
     if ( dmtcp_checkpoint_filename == NULL ||
          strcmp (dmtcp_checkpoint_filename, "/dev/null") != 0) {
+      if (trimheap)
+        trim_free_heap ();
       checkpointeverything ();
     } else {
       MTCP_PRINTF("received \'/dev/null\' as ckpt filename.\n"
@@ -2528,6 +2599,36 @@ static void checkpointeverything (void)
 
   write_ckpt_to_file(fd, tmpDMTCPHeaderFd, fdCkptFileOnDisk);
 
+  if (trimheap) {
+    DPRINTF("%u bytes of free heap memory written as zero pages\n",
+            (unsigned int) heap_bytes_saved);
+    if (showtiming)
+      MTCP_PRINTF("free heap not saved: %u kilobytes\n",
+                  (unsigned int) (heap_bytes_saved / 1024));
+  }
+  if (dedup && dedupdir[0] != '\0') {
+    /* Bytes of MTCP_PROT_DEDUP areas, over the bytes that this checkpoint
+     * wrote for them (added to the store, or written into the image).
+     */
+    size_t written = dedup_bytes - dedup_bytes_found;
+    unsigned long long ratio =
+      written > 0 ? (unsigned long long) dedup_bytes * 100 / written : 0;
+    MTCP_PRINTF("dedup: %u kilobytes, %u already in %s, %u added to it,"
+                " %u in image; ratio %u.%02u\n",
+                (unsigned int) (dedup_bytes / 1024),
+                (unsigned int) (dedup_bytes_found / 1024), dedupstore,
+                (unsigned int) (dedup_bytes_added / 1024),
+                (unsigned int) ((written - dedup_bytes_added) / 1024),
+                (unsigned int) (ratio / 100), (unsigned int) (ratio % 100));
+  }
+  if (skipfilepages) {
+    DPRINTF("%u bytes of clean file pages not written\n",
+            (unsigned int) file_bytes_skipped);
+    if (showtiming)
+      MTCP_PRINTF("clean file pages not saved: %u kilobytes\n",
+                  (unsigned int) (file_bytes_skipped / 1024));
+  }
+
 #ifndef FAST_CKPT_RST_VIA_MMAP
   if (use_compression) {
     /* IF OUT OF DISK SPACE, REPORT IT HERE. */
@@ -2569,7 +2670,11 @@ static void checkpointeverything (void)
    * So, gzip process can continue to write to file even after renaming.
    */
 
-  else renametempoverperm ();
+  else {
+    renametempoverperm ();
+    if (dedup && dedupdir[0] != '\0')
+      remove_stale_dedup_refs ();
+  }
 
   if (forked_ckpt_status == FORKED_CKPT_CHILD)
     mtcp_sys_exit (0); /* grandchild exits */
@@ -2577,8 +2682,21 @@ static void checkpointeverything (void)
   DPRINTF("checkpoint complete\n");
 }
 
-int perform_callback_write_ckpt_header()
+/* Temp file for the DMTCP header; it is copied into the checkpoint image by
+ * write_ckpt_to_file().  An anonymous, memory-backed file (memfd) is used if
+ * the kernel has one, so that nothing touches a possibly NFS-mounted
+ * $DMTCP_TMPDIR; otherwise, an unlinked file in $DMTCP_TMPDIR.
+ */
+static int open_tmp_header_fd()
 {
+  int tmpfd;
+#ifdef __NR_memfd_create
+  tmpfd = syscall(__NR_memfd_create, "dmtcpHeader", 0);
+  if (tmpfd >= 0 || errno != ENOSYS) {
+    return tmpfd;
+  }
+#endif
+
   char tmpDMTCPHeaderBuf[PATH_MAX];
   char pattern[] = "/dmtcp.XXXXXX";
   char *tmpStr;
@@ -2595,19 +2713,23 @@ int perform_callback_write_ckpt_header()
     mtcp_abort();
   }
 
+  tmpfd = mkstemp(tmpDMTCPHeaderFileName);
+  if (tmpfd >= 0 && unlink(tmpDMTCPHeaderFileName) == -1) {
+    MTCP_PRINTF("error %d unlinking temp file: %s\n", errno, strerror(errno));
+  }
+  return tmpfd;
+}
+
+int perform_callback_write_ckpt_header()
+{
   int tmpfd = -1;
   if (callback_write_ckpt_header != NULL) {
-    /* Temp file for DMTCP header; will be written into the checkpoint file. */
-    tmpfd = mkstemp(tmpDMTCPHeaderFileName);
+    tmpfd = open_tmp_header_fd();
     if (tmpfd < 0) {
       MTCP_PRINTF("error %d creating temp file: %s\n", errno, strerror(errno));
       mtcp_abort();
     }
 
-    if (unlink(tmpDMTCPHeaderFileName) == -1) {
-      MTCP_PRINTF("error %d unlinking temp file: %s\n", errno, strerror(errno));
-    }
-
     /* Better to do this in parent, not child, for most accurate header info */
     (*callback_write_ckpt_header)(tmpfd);
   }
@@ -2781,19 +2903,21 @@ void write_ckpt_to_file(int fd, int tmpDMTCPHeaderFd, int fdCkptFileOnDisk)
   static void *const frpointer = finishrestore;
 
   if (tmpDMTCPHeaderFd != -1 ) {
-    char tmpBuff[1024];
-    int retval = -1;
-    lseek(tmpDMTCPHeaderFd, 0, SEEK_SET);
-
-    while (retval != 0) {
-      retval = read (tmpDMTCPHeaderFd, tmpBuff, 1024);
-      if (retval == -1 && (errno == EAGAIN || errno == EINTR))
-        continue;
-      if (retval == -1) {
+    /* Copy the DMTCP header into the image with a single write. */
+    struct stat hdrStat;
+    if (fstat(tmpDMTCPHeaderFd, &hdrStat) == -1) {
+      MTCP_PRINTF("Error writing checkpoint file: %s\n", strerror(errno));
+      mtcp_abort();
+    }
+    if (hdrStat.st_size > 0) {
+      void *hdr = mmap(NULL, hdrStat.st_size, PROT_READ, MAP_PRIVATE,
+                       tmpDMTCPHeaderFd, 0);
+      if (hdr == MAP_FAILED) {
         MTCP_PRINTF("Error writing checkpoint file: %s\n", strerror(errno));
         mtcp_abort();
       }
-      mtcp_writefile(fd, tmpBuff, retval);
+      mtcp_writefile(fd, hdr, hdrStat.st_size);
+      munmap(hdr, hdrStat.st_size);
     }
     close(tmpDMTCPHeaderFd);
   }
@@ -2857,6 +2981,30 @@ void write_ckpt_to_file(int fd, int tmpDMTCPHeaderFd, int fdCkptFileOnDisk)
   Area remap_nscd_areas_array[10];
   remap_nscd_areas_array[9].flags = END_OF_NSCD_AREAS;
 
+  /* Saved stack pointers of the suspended threads; see
+   * set_dead_stack_range().  They live on this thread's stack.
+   */
+  Thread *thread;
+  int nsps = 0;
+  for (thread = threads; thread != NULL; thread = thread -> next)
+    nsps++;
+  VA *sps = alloca(nsps * sizeof(VA));
+  nsps = get_suspended_stack_pointers(sps, nsps);
+  VA prev_area_end = NULL;
+  int prev_area_prot = -1;
+  stack_bytes_skipped = 0;
+  file_bytes_skipped = 0;
+  if (dedup)
+    open_dedup_store();
+
+  read_hugepage_areas();
+  if (skipfilepages) {
+    pagemapfd = mtcp_sys_open2 ("/proc/self/pagemap", O_RDONLY);
+    if (pagemapfd < 0)
+      DPRINTF("error %d opening /proc/self/pagemap;"
+              " saving all file pages\n", mtcp_sys_errno);
+  }
+
   int mapsfd = mtcp_sys_open2 ("/proc/self/maps", O_RDONLY);
 #ifdef ANDROID
   Area prop_area;
@@ -2866,6 +3014,10 @@ void write_ckpt_to_file(int fd, int tmpDMTCPHeaderFd, int fdCkptFileOnDisk)
   while (mtcp_readmapsline (mapsfd, &area)) {
     VA area_begin = area.addr;
     VA area_end   = area_begin + area.size;
+    int above_guard_page = (area_begin == prev_area_end && prev_area_prot == 0);
+
+    prev_area_end = area_end;
+    prev_area_prot = area.prot;
 
     /* Original comment:  Skip anything in kernel address space ---
      *   beats me what's at FFFFE000..FFFFFFFF - we can't even read it;
@@ -3015,6 +3167,11 @@ void write_ckpt_to_file(int fd, int tmpDMTCPHeaderFd, int fdCkptFileOnDisk)
     }
 
 
+    set_dead_stack_range(&area, above_guard_page, sps, nsps);
+    area.hugepages = hugepage_state(area.addr);
+    if (area.flags & MAP_ANONYMOUS)
+      save_numa_placement(&area);
+
     /* Only write this image if it is not CS_RESTOREIMAGE.
      * Skip any mapping for this image - it got saved as CS_RESTOREIMAGE
      * at the beginning.
@@ -3061,6 +3218,13 @@ void write_ckpt_to_file(int fd, int tmpDMTCPHeaderFd, int fdCkptFileOnDisk)
       writememoryarea (fd, &area, stack_was_seen, vsyscall_exists);
     }
   }
+  dead_stack_start = dead_stack_end = NULL;
+  DPRINTF("%u bytes below saved thread stack pointers written as zero pages\n",
+          (unsigned int) stack_bytes_skipped);
+  if (pagemapfd >= 0) {
+    mtcp_sys_close (pagemapfd);
+    pagemapfd = -1;
+  }
 #ifdef ANDROID
   if (prop_area.addr != 0)
     writememoryarea (fd, &prop_area, stack_was_seen, vsyscall_exists);
@@ -3216,8 +3380,711 @@ static void writefiledescrs (int fd, int fdCkptFileOnDisk)
 }
 
 /*
- * This function detects if a page is a zero page or not. There is scope of
- * improving this function using some optimizations.
+ * Huge page state of the memory areas, read from /proc/self/smaps before
+ * the areas are written, and saved in Area.hugepages (see mtcp_internal.h).
+ * Only areas with some huge page state are kept.  smaps is read in blocks,
+ * as it is much longer than maps.
+ */
+#define MAX_HUGEPAGE_AREAS 1024
+static struct {
+  VA start;
+  VA end;
+  int hugepages;
+} hugepage_areas[MAX_HUGEPAGE_AREAS];
+static int num_hugepage_areas = 0;
+
+static unsigned long parse_number (char const **s, int base)
+{
+  unsigned long n = 0;
+  int d;
+  for (;; (*s)++) {
+    if (**s >= '0' && **s <= '9') d = **s - '0';
+    else if (base == 16 && **s >= 'a' && **s <= 'f') d = **s - 'a' + 10;
+    else break;
+    n = n * base + d;
+  }
+  return n;
+}
+
+static void add_hugepage_area (VA start, VA end, int hugepages)
+{
+  if (hugepages != 0 && num_hugepage_areas < MAX_HUGEPAGE_AREAS) {
+    hugepage_areas[num_hugepage_areas].start = start;
+    hugepage_areas[num_hugepage_areas].end = end;
+    hugepage_areas[num_hugepage_areas].hugepages = hugepages;
+    num_hugepage_areas++;
+  }
+}
+
+static void parse_smaps_line (char const *line, VA *start, VA *end,
+                              int *hugepages)
+{
+  char const *p = line;
+
+  if ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f')) {
+    /* Header line of the next area: <start>-<end> perms ... */
+    add_hugepage_area(*start, *end, *hugepages);
+    *hugepages = 0;
+    *start = (VA) parse_number(&p, 16);
+    if (*p == '-') p++;
+    *end = (VA) parse_number(&p, 16);
+  } else if (strncmp(p, "AnonHugePages:", 14) == 0) {
+    p += 14;
+    while (*p == ' ') p++;
+    if (parse_number(&p, 10) > 0)
+      *hugepages |= MTCP_HUGEPAGE_THP;
+  } else if (strncmp(p, "VmFlags:", 8) == 0) {
+    for (p += 8; *p != '\0'; p++) {
+      if (p[0] == ' ' && p[1] != '\0' && p[2] != '\0' &&
+          (p[3] == ' ' || p[3] == '\0')) {
+        if (p[1] == 'h' && p[2] == 'g') *hugepages |= MTCP_HUGEPAGE_ADVISED;
+        if (p[1] == 'n' && p[2] == 'h') *hugepages |= MTCP_HUGEPAGE_NEVER;
+        if (p[1] == 'h' && p[2] == 't') *hugepages |= MTCP_HUGEPAGE_HUGETLB;
+      }
+    }
+  }
+}
+
+/*
+ * Without transparent huge pages or hugetlbfs in the kernel (e.g. most
+ * Android kernels), no area can have any huge page state, so smaps is not
+ * read at all.  Not cached: a restarted process may run on another kernel.
+ */
+static int kernel_has_hugepages (void)
+{
+  return mtcp_sys_access("/sys/kernel/mm/transparent_hugepage", F_OK) == 0 ||
+         mtcp_sys_access("/sys/kernel/mm/hugepages", F_OK) == 0;
+}
+
+static void read_hugepage_areas (void)
+{
+  char buf[4096];
+  char line[256];
+  int len = 0;
+  int rc, i;
+  VA start = NULL, end = NULL;
+  int hugepages = 0;
+  int fd;
+
+  num_hugepage_areas = 0;
+  if (!kernel_has_hugepages())
+    return;
+  fd = mtcp_sys_open2("/proc/self/smaps", O_RDONLY);
+  if (fd < 0)
+    return;
+  while ((rc = mtcp_sys_read(fd, buf, sizeof buf)) > 0) {
+    for (i = 0; i < rc; i++) {
+      if (buf[i] != '\n') {
+        if (len < (int) sizeof line - 1)
+          line[len++] = buf[i];
+        continue;
+      }
+      line[len] = '\0';
+      parse_smaps_line(line, &start, &end, &hugepages);
+      len = 0;
+    }
+  }
+  add_hugepage_area(start, end, hugepages);
+  mtcp_sys_close(fd);
+  DPRINTF("%d areas with huge page state\n", num_hugepage_areas);
+}
+
+static int hugepage_state (VA addr)
+{
+  int lo = 0, hi = num_hugepage_areas;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (hugepage_areas[mid].end <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < num_hugepage_areas && hugepage_areas[lo].start <= addr)
+    return hugepage_areas[lo].hugepages;
+  return 0;
+}
+
+/*
+ * NUMA policy of an area and, if DMTCP_NUMA_PAGES is set, the nodes holding
+ * its pages (see mtcp_internal.h).  The pages are looked up with move_pages,
+ * in batches; pages that are not present are not counted.  Areas with a
+ * non-default policy are not looked up, as mtcp_restart places their pages
+ * by that policy.  Without NUMA support in the kernel, nothing is recorded.
+ */
+#define NUMA_PAGES_BATCH 512
+
+static void save_numa_placement (Area *area)
+{
+  void *pages[NUMA_PAGES_BATCH];
+  int status[NUMA_PAGES_BATCH];
+  size_t count[MTCP_MAX_NUMA_NODES];
+  size_t npages, present = 0, i, j, n;
+  unsigned long mask = 0;
+  int mode, node, best = -1;
+
+  if (mtcp_sys_get_mempolicy(&mode, &mask, MTCP_MAX_NUMA_NODES,
+                             area->addr, MPOL_F_ADDR) < 0)
+    return;
+  area->mempolicy = mode;
+  area->nodemask = mask;
+  if (!numapages || (mode & ~MTCP_MPOL_MODE_FLAGS) != MPOL_DEFAULT)
+    return;
+
+  memset(count, 0, sizeof count);
+  npages = area->size / MTCP_PAGE_SIZE;
+  for (i = 0; i < npages; i += n) {
+    n = npages - i < NUMA_PAGES_BATCH ? npages - i : NUMA_PAGES_BATCH;
+    for (j = 0; j < n; j++)
+      pages[j] = area->addr + (i + j) * MTCP_PAGE_SIZE;
+    if (mtcp_sys_move_pages(0, n, pages, NULL, status, 0) < 0) {
+      DPRINTF("move_pages at %p: error %d\n", pages[0], mtcp_sys_errno);
+      return;
+    }
+    for (j = 0; j < n; j++) {
+      if (status[j] >= 0 && status[j] < (int) MTCP_MAX_NUMA_NODES) {
+        count[status[j]]++;
+        present++;
+      }
+    }
+  }
+  for (node = 0; node < (int) MTCP_MAX_NUMA_NODES; node++) {
+    if (count[node] > 0) {
+      area->numa_nodes |= 1UL << node;
+      if (best < 0 || count[node] > count[best])
+        best = node;
+    }
+  }
+  if (best >= 0 && count[best] * 100 >= present * MTCP_NUMA_MAJORITY)
+    area->numa_node = best;
+}
+
+/*
+ * Opt-in (DMTCP_TRIM_HEAP=1):  before the image is written, and while all
+ * user threads are suspended, give free heap memory back to the kernel and
+ * record the pages inside the remaining free chunks, so that they are saved
+ * as zero pages instead of their stale contents.  Under DMTCP, the malloc
+ * wrappers guarantee that no suspended thread is inside malloc here.
+ *
+ * glibc:  malloc_trim(0) releases the top of every arena and the whole free
+ *   pages inside them, which then read back as zero.  The free chunks of the
+ *   main heap are found by walking its chunk headers from the start of
+ *   [heap]; the walk is used only if it ends exactly at the current break.
+ * Bionic:  dlmalloc_trim(0), then dlmalloc_walk_free_pages() reports the
+ *   page-aligned interior of every free chunk.
+ */
+#define MAX_FREE_HEAP_RANGES 4096
+static struct {
+  VA start;
+  VA end;
+} free_heap_ranges[MAX_FREE_HEAP_RANGES];
+static int num_free_heap_ranges = 0;
+
+#ifdef ANDROID
+extern int dlmalloc_trim (size_t pad) __attribute__ ((weak));
+extern void dlmalloc_walk_free_pages (void (*handler)(void *start, void *end,
+                                                      void *arg),
+                                      void *harg) __attribute__ ((weak));
+#endif
+
+static void add_free_heap_range (void *start, void *end, void *arg)
+{
+  VA s = (VA) (((unsigned long) start + MTCP_PAGE_SIZE - 1) & MTCP_PAGE_MASK);
+  VA e = (VA) ((unsigned long) end & MTCP_PAGE_MASK);
+
+  if (s < e && num_free_heap_ranges < MAX_FREE_HEAP_RANGES) {
+    free_heap_ranges[num_free_heap_ranges].start = s;
+    free_heap_ranges[num_free_heap_ranges].end = e;
+    num_free_heap_ranges++;
+  }
+}
+
+#ifndef ANDROID
+/* A glibc chunk starts with prev_size and size (whose low three bits are
+ * flags); while it is free, fd, bk, fd_nextsize and bk_nextsize follow.  It
+ * is free iff the PREV_INUSE bit of the next chunk is clear.  The top chunk
+ * (the last one) is always free.
+ */
+# define CHUNK_SIZE_SZ sizeof(size_t)
+# define CHUNK_FREE_HEADER (6 * CHUNK_SIZE_SZ)
+# define CHUNK_PREV_INUSE 1
+
+static int walk_main_heap (VA heap_start, VA brk, unsigned long align)
+{
+  unsigned long misalign =
+    ((unsigned long) heap_start + 2 * CHUNK_SIZE_SZ) & (align - 1);
+  VA p = misalign == 0 ? heap_start : heap_start + align - misalign;
+  int first_range = num_free_heap_ranges;
+
+  if (p + 2 * CHUNK_SIZE_SZ > brk ||
+      (((size_t*) p)[1] & CHUNK_PREV_INUSE) == 0)
+    return 0;
+  while (p < brk) {
+    size_t size = ((size_t*) p)[1] & ~(size_t) 7;
+    if (size < 4 * CHUNK_SIZE_SZ || (size & (2 * CHUNK_SIZE_SZ - 1)) != 0 ||
+        size > (size_t) (brk - p))
+      break;
+    if (p + size == brk) {
+      add_free_heap_range(p + CHUNK_FREE_HEADER, brk, NULL);
+      return 1;
+    }
+    if ((((size_t*) (p + size))[1] & CHUNK_PREV_INUSE) == 0)
+      add_free_heap_range(p + CHUNK_FREE_HEADER, p + size, NULL);
+    p += size;
+  }
+  num_free_heap_ranges = first_range;
+  return 0;
+}
+#else
+static int compare_free_heap_ranges (const void *a, const void *b)
+{
+  VA x = *(VA const *) a;
+  VA y = *(VA const *) b;
+  return x < y ? -1 : x > y;
+}
+#endif
+
+static void trim_free_heap (void)
+{
+  num_free_heap_ranges = 0;
+  heap_bytes_saved = 0;
+
+#ifndef ANDROID
+  Area area;
+  VA brk;
+  int mapsfd;
+
+  malloc_trim(0);
+  brk = mtcp_sys_brk(NULL);
+  mapsfd = mtcp_sys_open2("/proc/self/maps", O_RDONLY);
+  if (mapsfd < 0)
+    return;
+  while (mtcp_readmapsline(mapsfd, &area)) {
+    if (strcmp(area.name, "[heap]") == 0 &&
+        brk > area.addr && brk <= area.addr + area.size) {
+      /* MALLOC_ALIGNMENT is 2*SIZE_SZ, except 16 on recent i386 glibc. */
+      if (!walk_main_heap(area.addr, brk, 2 * CHUNK_SIZE_SZ) &&
+          2 * CHUNK_SIZE_SZ != 16)
+        walk_main_heap(area.addr, brk, 16);
+      break;
+    }
+  }
+  mtcp_sys_close(mapsfd);
+#else
+  if (dlmalloc_trim != NULL)
+    dlmalloc_trim(0);
+  if (dlmalloc_walk_free_pages != NULL)
+    dlmalloc_walk_free_pages(add_free_heap_range, NULL);
+  qsort(free_heap_ranges, num_free_heap_ranges, sizeof free_heap_ranges[0],
+        compare_free_heap_ranges);
+#endif
+  DPRINTF("%d free heap ranges\n", num_free_heap_ranges);
+}
+
+/* Index of the first free heap range that ends after addr. */
+static int find_free_heap_range (VA addr)
+{
+  int lo = 0, hi = num_free_heap_ranges;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (free_heap_ranges[mid].end <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Bytes of [addr, addr+size) that lie in a free heap range. */
+static size_t free_heap_bytes (VA addr, size_t size)
+{
+  size_t bytes = 0;
+  int i;
+  for (i = find_free_heap_range(addr);
+       i < num_free_heap_ranges && free_heap_ranges[i].start < addr + size;
+       i++) {
+    VA s = free_heap_ranges[i].start > addr ? free_heap_ranges[i].start : addr;
+    VA e = free_heap_ranges[i].end < addr + size ?
+             free_heap_ranges[i].end : addr + size;
+    bytes += e - s;
+  }
+  return bytes;
+}
+
+/*
+ * Opt-in (DMTCP_TRIM_STACKS=1):  a suspended thread saved its context in
+ * stopthisthread(), and on restart resumes from there; everything below that
+ * stack pointer is dead (whatever deep recursion left behind, plus the
+ * frames of the futex wait).  So for a thread stack, only [SP - red zone,
+ * top] is saved; the pages below are written as zero pages.  A mapping is
+ * taken for a thread stack only if it is anonymous, sits right on top of a
+ * PROT_NONE guard page (glibc and Bionic both create thread stacks that way),
+ * and holds the saved SP of exactly one thread.  That keeps regions with
+ * several thread stacks whole, but it can't tell what else the application
+ * keeps in the mapping: coroutine or green-thread stacks carved out of one
+ * allocation, or data below the stack of a thread started on a user-supplied
+ * stack, would be lost.  Hence opt-in, like DMTCP_TRIM_HEAP.
+ */
+#define MTCP_STACK_REDZONE 128
+
+static int compare_stack_pointers (const void *a, const void *b)
+{
+  VA x = *(VA const *) a;
+  VA y = *(VA const *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Fill sps[] with the saved stack pointers of the suspended threads, sorted.
+ * Returns how many there are.
+ */
+static int get_suspended_stack_pointers (VA *sps, int max)
+{
+  Thread *thread;
+  int n = 0;
+
+  for (thread = threads; thread != NULL && n < max; thread = thread -> next) {
+    if (thread != ckpthread &&
+        mtcp_state_value(&thread -> state) == ST_SUSPENDED)
+      sps[n++] = (VA) thread -> JMPBUF_SP;
+  }
+  qsort(sps, n, sizeof sps[0], compare_stack_pointers);
+  return n;
+}
+
+static void set_dead_stack_range (Area *area, int above_guard_page,
+                                  VA *sps, int nsps)
+{
+  int lo = 0, hi = nsps;
+
+  dead_stack_start = dead_stack_end = NULL;
+  if (!trimstacks || !above_guard_page || area->name[0] != '\0' ||
+      (area->flags & (MAP_ANONYMOUS | MAP_PRIVATE)) !=
+        (MAP_ANONYMOUS | MAP_PRIVATE) ||
+      (area->prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
+    return;
+
+  while (lo < hi) {   /* first sp >= area->addr */
+    int mid = (lo + hi) / 2;
+    if (sps[mid] < area->addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < nsps && sps[lo] < area->addr + area->size &&
+      (lo + 1 == nsps || sps[lo + 1] >= area->addr + area->size)) {
+    VA live = (VA) ((unsigned long) (sps[lo] - MTCP_STACK_REDZONE) &
+                    MTCP_PAGE_MASK);
+    if (live > area->addr) {
+      dead_stack_start = area->addr;
+      dead_stack_end = live;
+      stack_bytes_skipped += live - area->addr;
+    }
+  }
+}
+
+/* Name of the checkpoint image, without its directory. */
+static const char *dedup_image_name (void)
+{
+  const char *slash = strrchr(perm_checkpointfilename, '/');
+  return slash != NULL ? slash + 1 : perm_checkpointfilename;
+}
+
+/* The deduplication store is MTCP_DEDUP_STORE in the directory of the
+ * checkpoint image.  Each checkpoint gets a new directory for its links into
+ * the store (see mtcp_internal.h), named after the image and the time.  Its
+ * path is recorded in the image, so it is made absolute.
+ */
+static void open_dedup_store (void)
+{
+  struct timeval tv;
+  char *slash;
+
+  dedup_bytes = dedup_bytes_found = dedup_bytes_added = 0;
+  dedupstore[0] = dedupdir[0] = '\0';
+  if (perm_checkpointfilename[0] != '/' &&
+      getcwd(dedupstore, sizeof dedupstore - 1) != NULL)
+    strcat(dedupstore, "/");
+  if (strlen(dedupstore) + strlen(perm_checkpointfilename) +
+      sizeof MTCP_DEDUP_STORE + sizeof MTCP_DEDUP_REFS +
+      strlen(dedup_image_name()) + 24 >= sizeof dedupdir) {
+    MTCP_PRINTF("checkpoint path too long; not deduplicating\n");
+    dedupstore[0] = '\0';
+    return;
+  }
+  strcat(dedupstore, perm_checkpointfilename);
+  slash = strrchr(dedupstore, '/');
+  strcpy(slash + 1, MTCP_DEDUP_STORE);
+  strcpy(dedupdir, dedupstore);
+  strcat(dedupdir, "/" MTCP_DEDUP_REFS);
+  if ((mtcp_sys_mkdir(dedupstore, 0755) < 0 && mtcp_sys_errno != EEXIST) ||
+      (mtcp_sys_mkdir(dedupdir, 0755) < 0 && mtcp_sys_errno != EEXIST)) {
+    MTCP_PRINTF("error %d creating %s; not deduplicating\n",
+                mtcp_sys_errno, dedupdir);
+    dedupstore[0] = dedupdir[0] = '\0';
+    return;
+  }
+  mtcp_sys_gettimeofday(&tv, NULL);
+  sprintf(dedupdir + strlen(dedupdir), "/%s.%lx%05lx", dedup_image_name(),
+          (unsigned long) tv.tv_sec, (unsigned long) tv.tv_usec);
+  if (mtcp_sys_mkdir(dedupdir, 0755) < 0) {
+    MTCP_PRINTF("error %d creating %s; not deduplicating\n",
+                mtcp_sys_errno, dedupdir);
+    dedupstore[0] = dedupdir[0] = '\0';
+  }
+}
+
+/* Bytes at the start of an area that can be read without a fault.  Past
+ * the end of its file, a file mapping raises SIGBUS; mtcp_writefile()
+ * copes with those pages, as write() returns EFAULT for them.
+ */
+static size_t dedup_readable_size(Area *area)
+{
+  size_t size;
+
+  if (area->name[0] != '/')
+    return area->size;
+  if (area->filesize <= area->offset)
+    return 0;
+  size = (area->filesize - area->offset + MTCP_PAGE_SIZE - 1) & MTCP_PAGE_MASK;
+  return size < area->size ? size : area->size;
+}
+
+/* Returns true if the contents of the area are to be written to the
+ * deduplication store.  Shared areas are saved once per computation
+ * already (MTCP_PROT_LEADER_SAVED), and special areas such as [vsyscall]
+ * may not be readable.
+ */
+static int dedup_area(Area *area)
+{
+  return dedup && dedupdir[0] != '\0' &&
+         !(area->flags & MAP_SHARED) &&
+         !(area->prot & (MTCP_PROT_ZERO_PAGE | MTCP_PROT_SKIP_PAGE |
+                         MTCP_PROT_LEADER_SAVED)) &&
+         (area->name[0] != '[' || strcmp(area->name, "[heap]") == 0 ||
+          strcmp(area->name, "[stack]") == 0) &&
+         dedup_readable_size(area) >= MTCP_DEDUP_CHUNK_SIZE;
+}
+
+/* Not a cryptographic hash: chunks are compared in full before a stored
+ * one is used.  len is a multiple of MTCP_PAGE_SIZE.
+ */
+static void dedup_hash(const void *data, size_t len,
+                       unsigned long long hash[2])
+{
+  const unsigned long long *w = data;
+  unsigned long long h1 = 0x9e3779b97f4a7c15ULL ^ len;
+  unsigned long long h2 = 0xc2b2ae3d27d4eb4fULL;
+  size_t i;
+
+  for (i = 0; i < len / sizeof *w; i++) {
+    h1 = (h1 ^ w[i]) * 0x100000001b3ULL;
+    h1 ^= h1 >> 29;
+    h2 = (h2 + w[i]) * 0xff51afd7ed558ccdULL;
+    h2 ^= h2 >> 32;
+  }
+  hash[0] = h1;
+  hash[1] = h2;
+}
+
+/* Returns true if the store file path holds exactly data. */
+static int dedup_chunk_equal(const char *path, const char *data, size_t len)
+{
+  static char buf[MTCP_DEDUP_CHUNK_SIZE];
+  int fd = mtcp_sys_open(path, O_RDONLY, 0);
+  int equal;
+
+  if (fd < 0)
+    return 0;
+  equal = mtcp_sys_lseek(fd, 0, SEEK_END) == (off_t) len &&
+          mtcp_sys_lseek(fd, 0, SEEK_SET) == 0 &&
+          mtcp_read_all(fd, buf, len) == (ssize_t) len &&
+          memcmp(buf, data, len) == 0;
+  mtcp_sys_close(fd);
+  return equal;
+}
+
+/* Returns true if the image's directory in the store links to the chunk,
+ * because the store had it already or because it was added now.  No lock is
+ * needed between processes.  A stored chunk is linked before it is compared,
+ * so that it can't be removed meanwhile (see remove_stale_dedup_refs()).  A
+ * new chunk is written to a temporary file, which is then linked to its
+ * names.  link() fails if another process added the chunk first, and never
+ * replaces it, so a chunk is never seen half-written.
+ */
+static int dedup_store_chunk(const char *data, size_t len,
+                             const unsigned long long hash[2])
+{
+  char path[PATH_MAX + 40];
+  char ref[PATH_MAX + 40];
+  char tmp[PATH_MAX + 64];
+  int fd, linked, added = 0;
+
+  mtcp_dedup_chunk_path(path, dedupstore, hash);
+  mtcp_dedup_chunk_path(ref, dedupdir, hash);
+  linked = link(path, ref) == 0;
+  if (linked || errno == EEXIST) {
+    /* EEXIST: an earlier chunk of this image has the same hash. */
+    if (dedup_chunk_equal(ref, data, len)) {
+      dedup_bytes_found += len;
+      return 1;
+    }
+    if (linked)
+      unlink(ref);
+    return 0;
+  }
+
+  sprintf(tmp, "%s.%d.tmp", path, (int) mtcp_sys_getpid());
+  fd = mtcp_sys_open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return 0;
+  if (mtcp_write_all(fd, data, len) == (ssize_t) len &&
+      link(tmp, ref) == 0) {
+    /* If another process added the chunk meanwhile, this image keeps its
+     * own copy.
+     */
+    link(tmp, path);
+    added = 1;
+  }
+  mtcp_sys_close(fd);
+  unlink(tmp);
+  if (added)
+    dedup_bytes_added += len;
+  return added;
+}
+
+/* Writes the contents of an area tagged MTCP_PROT_DEDUP, whose descriptor
+ * was just written, as described in mtcp_internal.h.
+ */
+static void mtcp_write_dedup_contents(int fd, Area *area)
+{
+  int len = strlen(dedupdir);
+  VA end = area->addr + area->size;
+  VA readable_end = area->addr + dedup_readable_size(area);
+  VA chunk;
+
+  mtcp_writefile(fd, &len, sizeof len);
+  mtcp_writefile(fd, dedupdir, len);
+  for (chunk = area->addr; chunk < end; chunk += MTCP_DEDUP_CHUNK_SIZE) {
+    size_t n = end - chunk < MTCP_DEDUP_CHUNK_SIZE ? end - chunk
+                                                   : MTCP_DEDUP_CHUNK_SIZE;
+    DedupChunk c;
+
+    c.hash[0] = c.hash[1] = 0;
+    c.inlined = 1;
+    if (chunk + n <= readable_end) {
+      dedup_hash(chunk, n, c.hash);
+      c.inlined = !dedup_store_chunk(chunk, n, c.hash);
+    }
+    mtcp_writefile(fd, &c, sizeof c);
+    if (c.inlined)
+      mtcp_writefile(fd, chunk, n);
+  }
+  dedup_bytes += area->size;
+}
+
+/* getdents64() records; not the same layout as struct linux_dirent. */
+struct dedup_dirent64 {
+  unsigned long long d_ino;
+  long long d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* Removes the directory dir of an image's links into the store, and the
+ * chunks that it was the last user of: those whose only link left is their
+ * name in the store.  A chunk that another process links meanwhile stays
+ * valid through that link, even if its name in the store is removed.
+ */
+static void remove_dedup_dir (const char *dir)
+{
+  static char dbuf[BUFSIZ];
+  char ref[PATH_MAX + 300];
+  char path[PATH_MAX + 300];
+  struct dedup_dirent64 *dent;
+  struct stat statbuf;
+  int fd, doff, dsiz, removed;
+
+  fd = mtcp_sys_open(dir, O_RDONLY, 0);
+  if (fd < 0)
+    return;
+  /* Entries removed while the directory is read may hide others, so read
+   * it again until nothing is left.
+   */
+  do {
+    removed = 0;
+    mtcp_sys_lseek(fd, 0, SEEK_SET);
+    while ((dsiz = mtcp_sys_getdents64(fd, dbuf, sizeof dbuf)) > 0) {
+      for (doff = 0; doff < dsiz; doff += dent->d_reclen) {
+        dent = (struct dedup_dirent64 *) (dbuf + doff);
+        if (dent->d_name[0] == '.')
+          continue;
+        sprintf(ref, "%s/%s", dir, dent->d_name);
+        sprintf(path, "%s/%s", dedupstore, dent->d_name);
+        if (unlink(ref) == 0)
+          removed++;
+        if (stat(path, &statbuf) == 0 && statbuf.st_nlink == 1)
+          unlink(path);
+      }
+    }
+  } while (removed > 0);
+  mtcp_sys_close(fd);
+  if (rmdir(dir) < 0)
+    DPRINTF("error %d removing %s\n", errno, dir);
+}
+
+/* Called once the image is in place: the images that it replaced (the one
+ * of the previous checkpoint, or a checkpoint that failed) don't use their
+ * directories in the store any more.  Those are the other directories named
+ * after this image; see open_dedup_store().
+ */
+static void remove_stale_dedup_refs (void)
+{
+  static char dbuf[BUFSIZ];
+  char refs[PATH_MAX];
+  char dir[PATH_MAX + 300];
+  const char *image = dedup_image_name();
+  const char *current = strrchr(dedupdir, '/') + 1;
+  size_t len = strlen(image);
+  struct dedup_dirent64 *dent;
+  int fd, doff, dsiz;
+
+  strcpy(refs, dedupdir);
+  *strrchr(refs, '/') = '\0';
+  fd = mtcp_sys_open(refs, O_RDONLY, 0);
+  if (fd < 0)
+    return;
+  while ((dsiz = mtcp_sys_getdents64(fd, dbuf, sizeof dbuf)) > 0) {
+    for (doff = 0; doff < dsiz; doff += dent->d_reclen) {
+      const char *name;
+      dent = (struct dedup_dirent64 *) (dbuf + doff);
+      name = dent->d_name;
+      if (strncmp(name, image, len) != 0 || name[len] != '.' ||
+          name[len + 1] == '\0' ||
+          strspn(name + len + 1, "0123456789abcdef") != strlen(name + len + 1) ||
+          strcmp(name, current) == 0)
+        continue;
+      sprintf(dir, "%s/%s", refs, name);
+      DPRINTF("removing stale deduplication references %s\n", dir);
+      remove_dedup_dir(dir);
+    }
+  }
+  mtcp_sys_close(fd);
+}
+
+/* Writes the contents of an area whose descriptor was just written. */
+static void mtcp_write_area_contents(int fd, Area *area)
+{
+  if (area->prot & MTCP_PROT_DEDUP)
+    mtcp_write_dedup_contents(fd, area);
+  else
+    mtcp_writefile(fd, area->addr, area->size);
+}
+
+/*
+ * This function detects if a page is a zero page or not.  Pages inside a
+ * free heap chunk (see trim_free_heap()) or below the saved stack pointer
+ * of a thread (see set_dead_stack_range()) count as zero without being read.
+ * There is scope of improving this function using some optimizations.
  *
  * TODO: One can use /proc/self/pagemap to detect if the page is backed by a
  * shared zero page.
@@ -3228,6 +4095,14 @@ static int mtcp_is_zero_page(void *addr)
   size_t i;
   size_t end = MTCP_PAGE_SIZE / sizeof (*buf);
   long long res = 0;
+
+  if ((VA) addr >= dead_stack_start && (VA) addr < dead_stack_end)
+    return 1;
+  if (num_free_heap_ranges > 0) {
+    int r = find_free_heap_range(addr);
+    if (r < num_free_heap_ranges && free_heap_ranges[r].start <= (VA) addr)
+      return 1;
+  }
   for (i = 0; i + 7 < end; i += 8) {
     res = buf[i+0] | buf[i+1] | buf[i+2] | buf[i+3] |
           buf[i+4] | buf[i+5] | buf[i+6] | buf[i+7];
@@ -3238,23 +4113,48 @@ static int mtcp_is_zero_page(void *addr)
   return res == 0;
 }
 
+/* Returns true if all pages of [addr, addr+len) are zero pages. */
+static int mtcp_is_zero_range(VA addr, size_t len)
+{
+  VA pg;
+  for (pg = addr; pg < addr + len; pg += MTCP_PAGE_SIZE) {
+    if (!mtcp_is_zero_page(pg)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 /* This function returns a range of zero or non-zero pages. If the first page
  * is non-zero, it searches for all contiguous non-zero pages and returns them.
  * If the first page is all-zero, it searches for contiguous zero pages and
- * returns them.
+ * returns them.  In areas backed by transparent huge pages, the unit is a
+ * huge page instead (a unit is zero only if all of its pages are), so that
+ * on restart every run is mapped in full before its huge pages are touched.
  */
 static void mtcp_get_next_page_range(Area *area, size_t *size, int *is_zero)
 {
-  char *pg;
-  *size = MTCP_PAGE_SIZE;
-  *is_zero = mtcp_is_zero_page(area->addr);
-  for (pg = area->addr + MTCP_PAGE_SIZE;
-       pg < area->addr + area->size;
-       pg += MTCP_PAGE_SIZE) {
-    if (*is_zero != mtcp_is_zero_page(pg)) {
+  unsigned long unit =
+    (area->hugepages & (MTCP_HUGEPAGE_ADVISED | MTCP_HUGEPAGE_THP)) ?
+      MTCP_HUGEPAGE_SIZE : MTCP_PAGE_SIZE;
+  VA end = area->addr + area->size;
+  VA pg = area->addr;
+  VA next;
+
+  *size = 0;
+  *is_zero = -1;
+  while (pg < end) {
+    next = (VA) (((unsigned long) pg + unit) & ~(unit - 1));
+    if (next > end) {
+      next = end;
+    }
+    if (*is_zero == -1) {
+      *is_zero = mtcp_is_zero_range(pg, next - pg);
+    } else if (*is_zero != mtcp_is_zero_range(pg, next - pg)) {
       break;
     }
-    *size += MTCP_PAGE_SIZE;
+    *size += next - pg;
+    pg = next;
   }
 }
 
@@ -3272,7 +4172,7 @@ static void mtcp_write_non_rwx_pages(int fd, Area *orig_area)
    * code and that should reset the /proc/self/maps files to its original
    * condition.
    */
-  if (orig_area->name[0] != '\0') {
+  if (orig_area->name[0] != '\0' && strcmp(orig_area->name, "[heap]") != 0) {
     MTCP_PRINTF("NOTREACHED\n");
     mtcp_abort();
   }
@@ -3293,6 +4193,9 @@ static void mtcp_write_non_rwx_pages(int fd, Area *orig_area)
 
   if (is_zero == 1 && size == orig_area->size) {
     area.prot |= MTCP_PROT_ZERO_PAGE;
+    if (trimheap)
+      heap_bytes_saved += strcmp(area.name, "[heap]") == 0 ?
+                            size : free_heap_bytes(area.addr, size);
   }
   fastckpt_write_mem_region(fd, &area);
 #else
@@ -3305,13 +4208,22 @@ static void mtcp_write_non_rwx_pages(int fd, Area *orig_area)
 
     a.prot |= is_zero ? MTCP_PROT_ZERO_PAGE : 0;
     a.size = size;
+    if (dedup_area(&a))
+      a.prot |= MTCP_PROT_DEDUP;
+
+    /* [heap] used to be written in full; other areas were already scanned
+     * for zero pages, so only their free heap chunks are new savings.
+     */
+    if (is_zero && trimheap)
+      heap_bytes_saved += strcmp(a.name, "[heap]") == 0 ?
+                            size : free_heap_bytes(a.addr, size);
 
     mtcp_writecs (fd, CS_AREADESCRIP);
     mtcp_writefile (fd, &a, sizeof a);
     mtcp_writecs(fd, CS_AREACONTENTS);
 
     if (!is_zero) {
-      mtcp_writefile(fd, a.addr, a.size);
+      mtcp_write_area_contents(fd, &a);
     }
 
     area.addr += size;
@@ -3331,6 +4243,92 @@ static void mtcp_write_non_rwx_pages(int fd, Area *orig_area)
   }
 }
 
+/* Returns a run of pages of a private file mapping that are all dirty
+ * (copied on write, so now anonymous: present without PM_FILE, or swapped
+ * out), or all clean (still the file's pages, or never touched).  If
+ * /proc/self/pagemap can't be read, the rest of the area counts as dirty.
+ * Kernels before 3.5 don't report PM_FILE; there, only pages that were
+ * never touched count as clean.
+ */
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAP    (1ULL << 62)
+#define PAGEMAP_FILE    (1ULL << 61)
+#define PAGEMAP_BATCH   512
+static void mtcp_get_next_file_page_range(Area *area, size_t *size,
+                                          int *is_dirty)
+{
+  unsigned long long entries[PAGEMAP_BATCH];
+  VA end = area->addr + area->size;
+  VA pg = area->addr;
+
+  *size = 0;
+  *is_dirty = -1;
+  while (pg < end) {
+    size_t i, n = (end - pg) / MTCP_PAGE_SIZE;
+    off_t off = ((unsigned long) pg / MTCP_PAGE_SIZE) * sizeof entries[0];
+    if (n > PAGEMAP_BATCH)
+      n = PAGEMAP_BATCH;
+    if (pagemapfd < 0 ||
+        mtcp_sys_lseek(pagemapfd, off, SEEK_SET) != off ||
+        mtcp_sys_read(pagemapfd, entries, n * sizeof entries[0]) !=
+          (ssize_t) (n * sizeof entries[0])) {
+      if (*is_dirty != 0) {
+        *is_dirty = 1;
+        *size += end - pg;
+      }
+      return;
+    }
+    for (i = 0; i < n; i++, pg += MTCP_PAGE_SIZE) {
+      int dirty = (entries[i] & PAGEMAP_SWAP) ||
+                  ((entries[i] & PAGEMAP_PRESENT) &&
+                   !(entries[i] & PAGEMAP_FILE));
+      if (*is_dirty == -1) {
+        *is_dirty = dirty;
+      } else if (*is_dirty != dirty) {
+        return;
+      }
+      *size += MTCP_PAGE_SIZE;
+    }
+  }
+}
+
+/* With DMTCP_SKIP_FILE_PAGES, writes a private file mapping as runs of
+ * clean pages, tagged MTCP_PROT_SKIP_PAGE and without contents, and runs
+ * of dirty pages, with contents.  On restart, both are mapped from the
+ * file, and the dirty pages are read in over it.
+ */
+static void mtcp_write_file_pages(int fd, Area *orig_area)
+{
+  Area area = *orig_area;
+
+  while (area.size > 0) {
+    size_t size;
+    int is_dirty;
+    Area a = area;
+
+    mtcp_get_next_file_page_range(&a, &size, &is_dirty);
+
+    a.prot |= is_dirty ? 0 : MTCP_PROT_SKIP_PAGE;
+    a.size = size;
+    if (!is_dirty)
+      file_bytes_skipped += size;
+    else if (dedup_area(&a))
+      a.prot |= MTCP_PROT_DEDUP;
+
+    mtcp_writecs (fd, CS_AREADESCRIP);
+    mtcp_writefile (fd, &a, sizeof a);
+    mtcp_writecs(fd, CS_AREACONTENTS);
+
+    if (is_dirty) {
+      mtcp_write_area_contents(fd, &a);
+    }
+
+    area.addr += size;
+    area.size -= size;
+    area.offset += size;
+  }
+}
+
 static void writememoryarea (int fd, Area *area, int stack_was_seen,
 			     int vsyscall_exists)
 {
@@ -3372,12 +4370,21 @@ static void writememoryarea (int fd, Area *area, int stack_was_seen,
   if (area->prot == 0 ||
       (area->name[0] == '\0' &&
        ((area->flags & MAP_ANONYMOUS) != 0) &&
-       ((area->flags & MAP_PRIVATE) != 0))) {
+       ((area->flags & MAP_PRIVATE) != 0)) ||
+      (trimheap && strcmp(area->name, "[heap]") == 0)) {
     /* Detect zero pages and do not write them to ckpt image.
      * Currently, we detect zero pages in non-rwx mapping and anonymous
-     * mappings only
+     * mappings only, and in [heap] if DMTCP_TRIM_HEAP is set.
      */
     mtcp_write_non_rwx_pages(fd, area);
+  } else if (skipfilepages && area->name[0] == '/' &&
+             (area->flags & MAP_PRIVATE) && (area->prot & PROT_READ) &&
+             area->filesize > 0 &&
+             !mtcp_strendswith(area->name, DELETED_FILE_SUFFIX)) {
+    /* Private mapping of a regular file (MAP_ANONYMOUS was forced on it);
+     * only the pages that were copied on write are saved.
+     */
+    mtcp_write_file_pages(fd, area);
   } else if ( 0 != strcmp(area -> name, "[vsyscall]")
          && ( ((   0 != strcmp(area -> name, "[vdso]")
                 && 0 != strcmp(area -> name, "[vectors]"))
@@ -3433,6 +4440,17 @@ static void writememoryarea (int fd, Area *area, int stack_was_seen,
     }
 #endif
 #ifndef FAST_CKPT_RST_VIA_MMAP
+    /* Under DMTCP, one process saves the contents of a shared file area
+     * for all processes that map it.
+     */
+    if ((area -> flags & MAP_SHARED) && callback_ckpt_shared_area != NULL &&
+        !(*callback_ckpt_shared_area)(area -> addr)) {
+      DPRINTF("contents of %p bytes at %p (%s) saved by another process\n",
+              area -> size, area -> addr, area -> name);
+      area -> prot |= MTCP_PROT_LEADER_SAVED;
+    }
+    if ((area -> flags & MAP_ANONYMOUS) && dedup_area(area))
+      area -> prot |= MTCP_PROT_DEDUP;
     mtcp_writecs (fd, CS_AREADESCRIP);
     mtcp_writefile (fd, area, sizeof *area);
 #endif
@@ -3448,11 +4466,12 @@ static void writememoryarea (int fd, Area *area, int stack_was_seen,
 #else
       mtcp_writecs (fd, CS_AREACONTENTS);
 #ifdef ANDROID
-      if ((area->prot & MTCP_PROT_SKIP_PAGE) == 0) {
-        mtcp_writefile (fd, area -> addr, area -> size);
+      if ((area->prot & (MTCP_PROT_SKIP_PAGE | MTCP_PROT_LEADER_SAVED)) == 0) {
+        mtcp_write_area_contents (fd, area);
       }
 #else
-      mtcp_writefile (fd, area -> addr, area -> size);
+      if ((area -> prot & MTCP_PROT_LEADER_SAVED) == 0)
+        mtcp_write_area_contents (fd, area);
 #endif
 #endif
     } else {
@@ -3626,6 +4645,7 @@ static void stopthisthread (int signum)
 
     save_sig_state (thread);   // save signal state (and block signal delivery)
     save_tls_state (thread);   // save thread local storage state
+    save_sched_state (thread); // save CPU affinity and scheduling policy
 
     /* Grow stack only on first ckpt.  Kernel agrees this is main stack and
      * will mmap it.  On second ckpt and later, we would segfault if we tried
@@ -3937,6 +4957,107 @@ static void restore_sig_state (Thread *thisthread)
   }
 }
 
+/*****************************************************************************
+ *
+ *  Save and restore CPU affinity, scheduling policy and priority, and nice
+ *  value of a thread.  Raw system calls, as these run in the signal handler
+ *  and during restart.  On restart, the saved CPU mask is intersected with
+ *  the CPUs available to the restarted process; with DMTCP_REMAP_CPUS=1, CPU
+ *  n is instead mapped to the (n mod N)-th of the N available CPUs, for a
+ *  host with a different core count.  If nothing is left, the thread is not
+ *  pinned.
+ *
+ *****************************************************************************/
+
+static int restart_remap_cpus = 0;     /* DMTCP_REMAP_CPUS, set on restart */
+static int restart_cpus[MTCP_MAX_CPUS]; /* CPUs available on restart */
+static int num_restart_cpus = 0;
+
+#define CPUMASK_ISSET(mask, n) \
+  (((mask)[(n) / MTCP_CPUMASK_BITS] >> ((n) % MTCP_CPUMASK_BITS)) & 1)
+#define CPUMASK_SET(mask, n) \
+  ((mask)[(n) / MTCP_CPUMASK_BITS] |= 1UL << ((n) % MTCP_CPUMASK_BITS))
+
+static void save_sched_state (Thread *thisthread)
+{
+  int rc;
+
+  memset(thisthread -> cpumask, 0, sizeof thisthread -> cpumask);
+  thisthread -> schedpolicy = mtcp_sys_sched_getscheduler(0);
+  rc = mtcp_sys_getpriority(PRIO_PROCESS, 0);
+  /* The system call returns 20 - nice, so that it is never negative. */
+  thisthread -> nice = 20 - rc;
+  thisthread -> sched_saved =
+    thisthread -> schedpolicy != -1 && rc != -1 &&
+    mtcp_sys_sched_getparam(0, &thisthread -> schedparam) != -1 &&
+    mtcp_sys_sched_getaffinity(0, sizeof thisthread -> cpumask,
+                               thisthread -> cpumask) > 0;
+}
+
+static void read_restart_cpus (void)
+{
+  unsigned long mask[MTCP_MAX_CPUS / MTCP_CPUMASK_BITS];
+  int n;
+
+  num_restart_cpus = 0;
+  memset(mask, 0, sizeof mask);
+  if (mtcp_sys_sched_getaffinity(0, sizeof mask, mask) <= 0)
+    return;
+  for (n = 0; n < MTCP_MAX_CPUS; n++) {
+    if (CPUMASK_ISSET(mask, n))
+      restart_cpus[num_restart_cpus++] = n;
+  }
+}
+
+static void restore_sched_state (Thread *thisthread)
+{
+  static int warned_affinity = 0;
+  static int warned_scheduler = 0;
+  unsigned long mask[MTCP_MAX_CPUS / MTCP_CPUMASK_BITS];
+  int n, i, empty = 1;
+
+  if (!thisthread -> sched_saved || num_restart_cpus == 0)
+    return;
+
+  memset(mask, 0, sizeof mask);
+  for (n = 0; n < MTCP_MAX_CPUS; n++) {
+    if (!CPUMASK_ISSET(thisthread -> cpumask, n))
+      continue;
+    if (restart_remap_cpus) {
+      CPUMASK_SET(mask, restart_cpus[n % num_restart_cpus]);
+      empty = 0;
+    } else {
+      for (i = 0; i < num_restart_cpus; i++) {
+        if (restart_cpus[i] == n) {
+          CPUMASK_SET(mask, n);
+          empty = 0;
+          break;
+        }
+      }
+    }
+  }
+  if (empty) {
+    if (!warned_affinity++)
+      MTCP_PRINTF("WARNING: saved CPU affinity of thread %d uses no CPU of"
+                  " this host;\n  not pinning it.  (Set DMTCP_REMAP_CPUS=1"
+                  " to remap CPUs.)\n", thisthread -> virtual_tid);
+  } else if (mtcp_sys_sched_setaffinity(0, sizeof mask, mask) < 0) {
+    DPRINTF("sched_setaffinity: error %d\n", mtcp_sys_errno);
+  }
+
+  if (mtcp_sys_sched_setscheduler(0, thisthread -> schedpolicy,
+                                  &thisthread -> schedparam) < 0) {
+    if (!warned_scheduler++)
+      MTCP_PRINTF("WARNING: could not restore scheduling policy %d of"
+                  " thread %d: error %d\n", thisthread -> schedpolicy,
+                  thisthread -> virtual_tid, mtcp_sys_errno);
+  }
+  if (mtcp_sys_setpriority(PRIO_PROCESS, 0, thisthread -> nice) < 0) {
+    DPRINTF("setpriority(%d): error %d\n", thisthread -> nice,
+            mtcp_sys_errno);
+  }
+}
+
 /*****************************************************************************
  *
  *  Save all signal handlers
@@ -4288,6 +5409,11 @@ int mtcp_readmapsline (int mapsfd, Area *area)
   if (wflag == 'w') area -> prot |= PROT_WRITE;
   if (xflag == 'x') area -> prot |= PROT_EXEC;
   area -> flags = MAP_FIXED;
+  area -> hugepages = 0;
+  area -> mempolicy = -1;
+  area -> nodemask = 0;
+  area -> numa_node = -1;
+  area -> numa_nodes = 0;
   if (sflag == 's') area -> flags |= MAP_SHARED;
   if (sflag == 'p') area -> flags |= MAP_PRIVATE;
   if (area -> name[0] == '\0') area -> flags |= MAP_ANONYMOUS;
@@ -4360,6 +5486,15 @@ static void mtcp_restore_start (int fd, int verify, pid_t gzip_child_pid,
   mtcp_restore_cpfd   = fd;
   mtcp_restore_verify = verify;
   mtcp_restore_gzip_child_pid = gzip_child_pid;
+  /* Restart-time option, from the environment of mtcp_restart */
+  {
+    int j;
+    restart_remap_cpus = 0;
+    for (j = 0; envp[j] != NULL; j++) {
+      if (mtcp_strstartswith(envp[j], "DMTCP_REMAP_CPUS=1"))
+        restart_remap_cpus = 1;
+    }
+  }
   // Copy newname to save it too
   {
     int i;
@@ -4528,6 +5663,11 @@ static int restarthread (void *threadv)
 #endif
 
   if (thread == motherofall) {
+    /* Before any restored thread changes its affinity (and so that of the
+     * threads it clones).
+     */
+    read_restart_cpus ();
+
     // Compute the set of signals which was pending for all the threads at the
     // time of checkpoint. This is a heuristic to compute the set of signals
     // which were pending for the entire process at the time of checkpoint.
@@ -4616,6 +5756,9 @@ static int restarthread (void *threadv)
     DPRINTF("Parent:%d, tid of newly created thread:%d\n", thread->tid, tid);
   }
 
+  /* After the children are created, so that they don't inherit it. */
+  restore_sched_state (thread);
+
   /* All my children have been created, jump to the stopthisthread routine just
    * after sigsetjmp/getcontext call.
    * Note that if this is the restored checkpointhread, it jumps to the
@@ -61,7 +61,8 @@ void mtcp_set_dmtcp_callbacks(void (*restore_virtual_pid_table)(),
                               void (*holds_any_locks)(int *retval),
                               void (*pre_suspend_user_thread)(),
                               void (*pre_resume_user_thread)(int is_ckpt,
-                                                             int is_restart));
+                                                             int is_restart),
+                              int  (*ckpt_shared_area)(void *addr));
 
 #ifdef __cplusplus
 }
@@ -221,17 +221,91 @@ typedef unsigned int mtcp_segreg_t;
  * This assumes: PROT_READ == 0x1, PROT_WRITE == 0x2, and PROT_EXEC == 0x4
  */
 #define MTCP_PROT_ZERO_PAGE (PROT_EXEC << 1)
-#ifdef ANDROID
 /* MTCP_PROT_SKIP_PAGE used for tag a file-mapped memory region
  * is unchanged, just read from original file.
+ * In Android, whole read-only regions are compared with the file.  With
+ * DMTCP_SKIP_FILE_PAGES, private file mappings are written in runs of pages:
+ * pages never copied on write (not anonymous in /proc/self/pagemap) are
+ * tagged and mapped from the file on restart, the others are saved.  The
+ * file must not change in between; restart aborts if its size did.
  */
 #define MTCP_PROT_SKIP_PAGE (MTCP_PROT_ZERO_PAGE << 1)
+/* MTCP_PROT_LEADER_SAVED tags a MAP_SHARED file area whose contents were
+ * saved by another process of the computation, the one elected to save it
+ * (see callback_ckpt_shared_area).  Only the descriptor is in this image.
+ * On restart, that process writes the contents into the file through its
+ * own mapping, before any user thread runs.
+ */
+#define MTCP_PROT_LEADER_SAVED (MTCP_PROT_ZERO_PAGE << 2)
+
+/* MTCP_PROT_DEDUP tags an area whose contents are in the deduplication
+ * store (DMTCP_DEDUP), the directory MTCP_DEDUP_STORE next to the image.
+ * It is shared by all images written there: each MTCP_DEDUP_CHUNK_SIZE
+ * chunk of an area is stored once, in a file named after its hash (see
+ * mtcp_dedup_chunk_path).  Each image has its own directory under
+ * MTCP_DEDUP_REFS in the store, with a hard link to each chunk it uses.
+ * Instead of the contents, the image holds that directory (an int length,
+ * then the characters) and a DedupChunk for each chunk.  A chunk that is not
+ * in the store (a hash collision, an I/O error, or pages that can't be read
+ * safely) follows its DedupChunk.  Once a new image replaces an old one, the
+ * directory of the old one is removed, and so are the chunks that no other
+ * image links to.
+ */
+#define MTCP_PROT_DEDUP (MTCP_PROT_ZERO_PAGE << 3)
+#define MTCP_DEDUP_CHUNK_SIZE (64 * 1024)
+#define MTCP_DEDUP_STORE "dmtcp_dedup_store"
+#define MTCP_DEDUP_REFS "refs"
+
+/* Huge page state of an area (Area.hugepages), restored by mtcp_restart:
+ *   ADVISED:  madvise(MADV_HUGEPAGE) was in effect (VmFlags "hg")
+ *   NEVER:    madvise(MADV_NOHUGEPAGE) was in effect (VmFlags "nh")
+ *   THP:      backed by transparent huge pages (AnonHugePages > 0)
+ *   HUGETLB:  mapped with MAP_HUGETLB (VmFlags "ht")
+ * ADVISED and THP areas are saved in runs aligned to MTCP_HUGEPAGE_SIZE, so
+ * that each run is mapped in full before it is populated on restart.
+ */
+#define MTCP_HUGEPAGE_ADVISED 1
+#define MTCP_HUGEPAGE_NEVER   2
+#define MTCP_HUGEPAGE_THP     4
+#define MTCP_HUGEPAGE_HUGETLB 8
+#define MTCP_HUGEPAGE_SIZE (2 * 1024 * 1024)
+#ifndef MADV_HUGEPAGE
+# define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_NOHUGEPAGE
+# define MADV_NOHUGEPAGE 15
+#endif
+#ifndef MAP_HUGETLB
+# define MAP_HUGETLB 0x40000
 #endif
 
+/* NUMA placement of an area (Area.mempolicy etc.), restored by mtcp_restart:
+ * a non-default policy is set again with mbind before the contents are read.
+ * Otherwise, if DMTCP_NUMA_PAGES was set at checkpoint time, the contents
+ * are read in with the pages preferring the node that held most of them
+ * (or interleaved over the nodes that held them, if no node held at least
+ * MTCP_NUMA_MAJORITY percent), and the policy is then reset to the default.
+ * Nodes beyond MTCP_MAX_NUMA_NODES, or not allowed on restart, are ignored.
+ */
+#define MTCP_MAX_NUMA_NODES (8 * sizeof(unsigned long))
+#define MTCP_NUMA_MAJORITY  75
+#ifndef MPOL_DEFAULT
+# define MPOL_DEFAULT    0
+# define MPOL_PREFERRED  1
+# define MPOL_BIND       2
+# define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_F_ADDR
+# define MPOL_F_ADDR         (1 << 1)
+# define MPOL_F_MEMS_ALLOWED (1 << 2)
+#endif
+#define MTCP_MPOL_MODE_FLAGS (0xff00)   /* MPOL_F_STATIC_NODES, etc. */
+
 #define STACKSIZE 2048      // size of temporary stack (in quadwords)
 //#define MTCP_MAX_PATH 256   // maximum path length for mtcp_find_executable
 
 typedef struct Area Area;
+typedef struct DedupChunk DedupChunk;
 typedef struct Jmpbuf Jmpbuf;
 
 struct Area { char *addr;   // args required for mmap to restore memory area
@@ -240,12 +314,21 @@ struct Area { char *addr;   // args required for mmap to restore memory area
               int prot;
               int flags;
               off_t offset;
+              int hugepages;  // MTCP_HUGEPAGE_* bits, from /proc/self/smaps
+              int mempolicy;  // NUMA policy from get_mempolicy, -1 if none
+              unsigned long nodemask;  // nodes of mempolicy
+              int numa_node;  // node holding most pages, -1 if none or mixed
+              unsigned long numa_nodes;  // nodes holding any page
               char name[FILENAMESIZE];
 #ifdef FAST_CKPT_RST_VIA_MMAP
               size_t mem_region_offset;
 #endif
             };
 
+struct DedupChunk { unsigned long long hash[2];
+                    unsigned long long inlined;  // contents follow in image
+                  };
+
 #ifdef FAST_CKPT_RST_VIA_MMAP
 # define MTCP_CKPT_IMAGE_VERSION 1.3
 typedef struct mtcp_ckpt_image_header {
@@ -455,6 +538,8 @@ int mtcp_strncmp (const char *s1, const char *s2, size_t n);
 int mtcp_strcmp (const char *s1, const char *s2);
 int mtcp_strstartswith (const char *s1, const char *s2);
 int mtcp_strendswith (const char *s1, const char *s2);
+void mtcp_dedup_chunk_path(char *path, const char *dir,
+                           const unsigned long long hash[2]);
 int mtcp_atoi(const char *nptr);
 int mtcp_get_controlling_term(char* ttyName, size_t len);
 const char* mtcp_getenv(const char* name);
@@ -87,6 +87,7 @@ static void readfiledescrs (void);
 static void readmemoryareas (void);
 static void mmapfile(void *buf, size_t size, int prot, int flags);
 static void skipfile(size_t size);
+static void read_dedup_contents(Area *area, int skip);
 static void read_shared_memory_area_from_file(Area* area, int flags);
 static VA highest_userspace_address (VA *vdso_addr, VA *vsyscall_addr,
                                      VA * stack_end_addr);
@@ -94,6 +95,9 @@ static char* fix_filename_if_new_cwd(char* filename);
 static int open_shared_file(char* filename);
 static void lock_file(int fd, char* name, short l_type);
 static void adjust_for_smaller_file_size(Area *area, int fd);
+static void restore_hugepage_advice(Area *area);
+static int restore_numa_placement(Area *area);
+static void reset_numa_placement(Area *area);
 // These will all go away when we use a linker to reserve space.
 static VA global_vdso_addr = 0;
 
@@ -426,7 +430,7 @@ static void readmemoryareas (void)
 {
   Area area;
   char cstype;
-  int flags, imagefd;
+  int flags, imagefd, numa_placed;
   void *mmappedat;
   // make check:  stale-fd and forkexec fail (and others?) with this turned on.
 #if 0
@@ -474,6 +478,10 @@ static void readmemoryareas (void)
                 mtcp_sys_errno, area.size, area.addr);
         mtcp_abort ();
       }
+      restore_hugepage_advice(&area);
+      /* No pages are read in here; only a non-default policy is kept. */
+      if ((area.mempolicy & ~MTCP_MPOL_MODE_FLAGS) != MPOL_DEFAULT)
+        restore_numa_placement(&area);
       /* Read saved area contents */
       mtcp_readcs (mtcp_restore_cpfd, CS_AREACONTENTS);
 #endif // FAST_CKPT_RST_VIA_MMAP
@@ -508,6 +516,14 @@ static void readmemoryareas (void)
         if (imagefd >= 0)
           area.flags ^= MAP_ANONYMOUS;
       }
+      if ((area.prot & MTCP_PROT_SKIP_PAGE) &&
+          (imagefd < 0 ||
+           mtcp_sys_lseek(imagefd, 0, SEEK_END) != area.filesize)) {
+        MTCP_PRINTF("%s is missing or changed since checkpoint;\n"
+                    "  can't restore %p bytes at %p from it\n",
+                    area.name, area.size, area.addr);
+        mtcp_abort ();
+      }
 
       /* Create the memory area */
 
@@ -515,8 +531,20 @@ static void readmemoryareas (void)
        * are valid.  Can we unmap vdso and vsyscall in Linux?  Used to use
        * mtcp_safemmap here to check for address conflicts.
        */
-      mmappedat = mtcp_sys_mmap (area.addr, area.size, area.prot | PROT_WRITE,
-				 area.flags, imagefd, area.offset);
+      mmappedat = MAP_FAILED;
+      if ((area.hugepages & MTCP_HUGEPAGE_HUGETLB) && imagefd < 0) {
+        mmappedat = mtcp_sys_mmap (area.addr, area.size,
+                                   area.prot | PROT_WRITE,
+                                   area.flags | MAP_HUGETLB, -1, 0);
+        if (mmappedat == MAP_FAILED)
+          DPRINTF("no huge pages for %p bytes at %p (error %d);"
+                  " using normal pages\n",
+                  area.size, area.addr, mtcp_sys_errno);
+      }
+      if (mmappedat == MAP_FAILED)
+        mmappedat = mtcp_sys_mmap (area.addr, area.size,
+                                   area.prot | PROT_WRITE,
+                                   area.flags, imagefd, area.offset);
 
       if (mmappedat == MAP_FAILED) {
         DPRINTF("error %d mapping %p bytes at %p\n",
@@ -535,6 +563,12 @@ static void readmemoryareas (void)
         mtcp_abort ();
       }
 
+      if (mmappedat == area.addr && imagefd < 0)
+        restore_hugepage_advice(&area);
+      numa_placed = 0;
+      if (mmappedat == area.addr)
+        numa_placed = restore_numa_placement(&area);
+
       if (imagefd >= 0)
         adjust_for_smaller_file_size(&area, imagefd);
 
@@ -544,7 +578,14 @@ static void readmemoryareas (void)
       /* Read saved area contents */
       mtcp_readcs (mtcp_restore_cpfd, CS_AREACONTENTS);
 
-      if (try_skipping_existing_segment) {
+      if (try_skipping_existing_segment &&
+          (area.prot & MTCP_PROT_SKIP_PAGE)) {
+        DPRINTF("no contents saved for %p bytes at %p\n",
+                area.size, area.addr);
+      } else if (try_skipping_existing_segment &&
+                 (area.prot & MTCP_PROT_DEDUP)) {
+        read_dedup_contents(&area, 1);
+      } else if (try_skipping_existing_segment) {
 #ifdef BUG_64BIT_2_6_9
 # if 0
         // This fails on teracluster.  Presumably extra symbols cause overflow.
@@ -597,34 +638,30 @@ static void readmemoryareas (void)
             && mtcp_strstr(area.name, "[vsyscall]")) {
           mmapfile (area.addr, area.size, area.prot | PROT_WRITE, area.flags);
         } else {
-#ifdef ANDROID
-          /* In Android port, we don't save file-mapped region
-           * without write permission and unchanged file.
+          /* We don't save file-mapped regions (Android), or pages
+           * (DMTCP_SKIP_FILE_PAGES), that are unchanged from the file.
            */
           if ((area.prot & MTCP_PROT_SKIP_PAGE) != 0) {
-            MTCP_PRINTF("skip restore content for [%s] + %x\n",
-                        area.name, area.offset);
+            DPRINTF("skip restore content for [%s] + %x\n",
+                    area.name, area.offset);
+          } else if ((area.prot & MTCP_PROT_DEDUP) != 0) {
+            read_dedup_contents(&area, 0);
           } else {
             mtcp_readfile(mtcp_restore_cpfd, area.addr, area.size);
           }
-#else
-          mtcp_readfile(mtcp_restore_cpfd, area.addr, area.size);
-#endif
         }
         if (!(area.prot & PROT_WRITE)) {
-#ifdef ANDROID
           int prot_mask = PROT_READ | PROT_WRITE | PROT_EXEC;
           if (mtcp_sys_mprotect (area.addr, area.size,
                                  area.prot & prot_mask) < 0)
-#else
-          if (mtcp_sys_mprotect (area.addr, area.size, area.prot) < 0)
-#endif
           {
             MTCP_PRINTF("error %d write-protecting %p bytes at %p\n",
                         mtcp_sys_errno, area.size, area.addr);
             mtcp_abort ();
           }
         }
+        if (numa_placed)
+          reset_numa_placement(&area);
       }
 #endif // FAST_CKPT_RST_VIA_MMAP
     }
@@ -733,6 +770,93 @@ static void readmemoryareas (void)
   }
 }
 
+/* Re-apply MADV_HUGEPAGE or MADV_NOHUGEPAGE to a freshly mapped anonymous
+ * area before its contents are read in, so that transparent huge pages are
+ * allocated directly instead of being collapsed later by khugepaged.
+ */
+static void restore_hugepage_advice(Area *area)
+{
+  int advice;
+
+  if (area->hugepages & MTCP_HUGEPAGE_ADVISED)
+    advice = MADV_HUGEPAGE;
+  else if (area->hugepages & MTCP_HUGEPAGE_NEVER)
+    advice = MADV_NOHUGEPAGE;
+  else
+    return;
+  if (mtcp_sys_madvise(area->addr, area->size, advice) < 0)
+    DPRINTF("madvise(%d) of %p bytes at %p failed: error %d\n",
+            advice, area->size, area->addr, mtcp_sys_errno);
+}
+
+/* NUMA nodes this process may allocate on; 0 without NUMA support. */
+static unsigned long numa_nodes_allowed(void)
+{
+  static int checked = 0;
+  static unsigned long allowed = 0;
+  int mode;
+
+  if (!checked) {
+    checked = 1;
+    if (mtcp_sys_get_mempolicy(&mode, &allowed, MTCP_MAX_NUMA_NODES,
+                               NULL, MPOL_F_MEMS_ALLOWED) < 0)
+      allowed = 0;
+  }
+  return allowed;
+}
+
+/* Re-apply the NUMA policy of an anonymous area (see mtcp_internal.h) before
+ * its contents are read in, so that pages are allocated on the saved nodes no
+ * matter which CPU this process runs on.  Areas with the default policy get a
+ * temporary one that places pages where they were at checkpoint time; then
+ * 1 is returned, and reset_numa_placement() must be called after the
+ * contents are read.  Saved nodes not allowed here are dropped, so this does
+ * nothing on a host with fewer nodes, or without NUMA support.
+ */
+static int restore_numa_placement(Area *area)
+{
+  int mode = area->mempolicy & ~MTCP_MPOL_MODE_FLAGS;
+  int policy;
+  unsigned long mask;
+
+  if (area->mempolicy < 0 || numa_nodes_allowed() == 0)
+    return 0;
+  if (mode != MPOL_DEFAULT) {
+    policy = area->mempolicy;
+    mask = area->nodemask & numa_nodes_allowed();
+    if (mask == 0 && area->nodemask != 0) {
+      DPRINTF("NUMA nodes %p of area at %p not allowed; using default\n",
+              area->nodemask, area->addr);
+      return 0;
+    }
+  } else if (area->numa_node >= 0 &&
+             ((numa_nodes_allowed() >> area->numa_node) & 1)) {
+    policy = MPOL_PREFERRED;
+    mask = 1UL << area->numa_node;
+  } else {
+    policy = MPOL_INTERLEAVE;
+    mask = area->numa_nodes & numa_nodes_allowed();
+    if ((mask & (mask - 1)) == 0)   /* at most one node */
+      return 0;
+  }
+  /* mbind reads maxnode - 1 bits of the mask */
+  if (mtcp_sys_mbind(area->addr, area->size, policy, mask == 0 ? NULL : &mask,
+                     MTCP_MAX_NUMA_NODES + 1, 0) < 0) {
+    DPRINTF("mbind(%d, %p) of %p bytes at %p failed: error %d\n",
+            policy, mask, area->size, area->addr, mtcp_sys_errno);
+    return 0;
+  }
+  return mode == MPOL_DEFAULT;
+}
+
+/* The pages stay where they are; only later allocations use the default. */
+static void reset_numa_placement(Area *area)
+{
+  if (mtcp_sys_mbind(area->addr, area->size, MPOL_DEFAULT, NULL, 0, 0) < 0)
+    DPRINTF("mbind(MPOL_DEFAULT) of %p bytes at %p failed: error %d\n",
+            area->size, area->addr, mtcp_sys_errno);
+}
+
 static void adjust_for_smaller_file_size(Area *area, int fd)
 {
   off_t curr_size = mtcp_sys_lseek(fd, 0, SEEK_END);
@@ -878,6 +1002,9 @@ static void read_shared_memory_area_from_file(Area* area, int flags)
   int areaContentsAlreadyRead = 0;
   int imagefd, rc;
   char *area_name = area->name; /* Modified in fix_filename_if_new_cwd below. */
+  int leader_saved = (area->prot & MTCP_PROT_LEADER_SAVED) != 0;
+
+  area->prot &= ~MTCP_PROT_LEADER_SAVED;
 
 #ifdef ANDROID
   if (mtcp_strstr(area->name, "/dev/__properties__")) {
@@ -905,6 +1032,27 @@ static void read_shared_memory_area_from_file(Area* area, int flags)
     mtcp_abort();
   }
 
+  if (imagefd < 0 && leader_saved) {
+    /* The contents are in the image of another process (see
+     * MTCP_PROT_LEADER_SAVED).  Only create the file, large enough for this
+     * mapping, and map it as an existing file below.
+     */
+    DPRINTF("Shared file %s not found. Creating it for %p bytes\n",
+            area_name, area->offset + area->size);
+    area_name = fix_filename_if_new_cwd(area_name);
+    imagefd = open_shared_file(area_name);
+    lock_file(imagefd, area_name, F_WRLCK);
+    if (mtcp_sys_lseek(imagefd, 0, SEEK_END) <
+        (off_t)(area->offset + area->size))
+      mtcp_sys_ftruncate(imagefd, area->offset + area->size);
+    mtcp_sys_close(imagefd);
+    imagefd = mtcp_sys_open (area_name, flags, 0);
+    if (imagefd < 0) {
+      MTCP_PRINTF("error %d opening mmap file %s\n", mtcp_sys_errno, area_name);
+      mtcp_abort ();
+    }
+  }
+
   if (imagefd < 0) {
 #ifdef ANDROID
     DPRINTF("Shared file %s not found. "
@@ -956,6 +1104,8 @@ static void read_shared_memory_area_from_file(Area* area, int flags)
 
     areaContentsAlreadyRead = 1;
 
+    /* At the offset of the mapping, where other processes will look. */
+    mtcp_sys_lseek(imagefd, area->offset, SEEK_SET);
     if ( mtcp_sys_write(imagefd, area->addr,area->size) < 0 ){
       MTCP_PRINTF("error %d creating mmap file %s\n",
                   mtcp_sys_errno, area_name);
@@ -1010,6 +1160,13 @@ static void read_shared_memory_area_from_file(Area* area, int flags)
     DPRINTF("After Acquiring lock on shared file :%s\n", area_name);
   }
 
+  if (leader_saved) {
+#ifndef FAST_CKPT_RST_VIA_MMAP
+    mtcp_readcs (mtcp_restore_cpfd, CS_AREACONTENTS);
+#endif
+    areaContentsAlreadyRead = 1;
+  }
+
 #ifdef ANDROID
   /* Memory region size always use file size rather in Android port */
   int file_size = mtcp_sys_lseek(imagefd, 0, SEEK_END);
@@ -1149,6 +1306,50 @@ static void mmapfile(void *buf, size_t size, int prot, int flags)
   }
 }
 
+/* Reads the contents of an area tagged MTCP_PROT_DEDUP (see
+ * mtcp_internal.h), from the deduplication store and from the image.  With
+ * skip, only moves past them in the image.
+ */
+static void read_dedup_contents(Area *area, int skip)
+{
+  static char dir[PATH_MAX];
+  static char path[PATH_MAX + 40];
+  DedupChunk c;
+  VA end = area->addr + area->size;
+  VA chunk;
+  int len, fd;
+
+  mtcp_readfile(mtcp_restore_cpfd, &len, sizeof len);
+  if (len < 0 || len >= PATH_MAX) {
+    MTCP_PRINTF("bad deduplication store path length %d\n", len);
+    mtcp_abort ();
+  }
+  mtcp_readfile(mtcp_restore_cpfd, dir, len);
+  dir[len] = '\0';
+  for (chunk = area->addr; chunk < end; chunk += MTCP_DEDUP_CHUNK_SIZE) {
+    size_t n = end - chunk < MTCP_DEDUP_CHUNK_SIZE ? end - chunk
+                                                   : MTCP_DEDUP_CHUNK_SIZE;
+    mtcp_readfile(mtcp_restore_cpfd, &c, sizeof c);
+    if (c.inlined) {
+      if (skip)
+        skipfile (n);
+      else
+        mtcp_readfile(mtcp_restore_cpfd, chunk, n);
+      continue;
+    }
+    if (skip)
+      continue;
+    mtcp_dedup_chunk_path(path, dir, c.hash);
+    fd = mtcp_sys_open(path, O_RDONLY, 0);
+    if (fd < 0 || mtcp_read_all(fd, chunk, n) != (ssize_t) n) {
+      MTCP_PRINTF("error %d reading %p bytes at %p from %s\n",
+                  mtcp_sys_errno, n, chunk, path);
+      mtcp_abort ();
+    }
+    mtcp_sys_close(fd);
+  }
+}
+
 static void skipfile(size_t size)
 {
 #if 1
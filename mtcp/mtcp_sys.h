@@ -399,6 +399,23 @@ struct linux_dirent {
 #define mtcp_sys_mremap(args...)  (void *)mtcp_inline_syscall(mremap,4,args)
 #define mtcp_sys_munmap(args...)  mtcp_inline_syscall(munmap,2,args)
 #define mtcp_sys_mprotect(args...)  mtcp_inline_syscall(mprotect,3,args)
+#define mtcp_sys_madvise(args...)  mtcp_inline_syscall(madvise,3,args)
+#define mtcp_sys_get_mempolicy(args...) \
+  mtcp_inline_syscall(get_mempolicy,5,args)
+#define mtcp_sys_mbind(args...)  mtcp_inline_syscall(mbind,6,args)
+#define mtcp_sys_move_pages(args...)  mtcp_inline_syscall(move_pages,6,args)
+#define mtcp_sys_sched_getaffinity(args...) \
+  mtcp_inline_syscall(sched_getaffinity,3,args)
+#define mtcp_sys_sched_setaffinity(args...) \
+  mtcp_inline_syscall(sched_setaffinity,3,args)
+#define mtcp_sys_sched_getscheduler(args...) \
+  mtcp_inline_syscall(sched_getscheduler,1,args)
+#define mtcp_sys_sched_setscheduler(args...) \
+  mtcp_inline_syscall(sched_setscheduler,3,args)
+#define mtcp_sys_sched_getparam(args...) \
+  mtcp_inline_syscall(sched_getparam,2,args)
+#define mtcp_sys_getpriority(args...)  mtcp_inline_syscall(getpriority,2,args)
+#define mtcp_sys_setpriority(args...)  mtcp_inline_syscall(setpriority,3,args)
 #define mtcp_sys_brk(args...)  (void *)(mtcp_inline_syscall(brk,1,args))
 #define mtcp_sys_rt_sigaction(args...) mtcp_inline_syscall(rt_sigaction,4,args)
 #define mtcp_sys_set_tid_address(args...) \
@@ -188,6 +188,25 @@ int mtcp_strendswith (const char *s1, const char *s2)
   return mtcp_strncmp(s1, s2, len2) == 0;
 }
 
+/* Name of a chunk in the deduplication store (see MTCP_PROT_DEDUP):
+ * dir, then '/' and the hash as 32 hex digits.
+ */
+__attribute__ ((visibility ("hidden")))
+void mtcp_dedup_chunk_path(char *path, const char *dir,
+                           const unsigned long long hash[2])
+{
+  static char const hexdigits[] = "0123456789abcdef";
+  int i, j;
+
+  while (*dir != '\0')
+    *path++ = *dir++;
+  *path++ = '/';
+  for (i = 0; i < 2; i++)
+    for (j = 60; j >= 0; j -= 4)
+      *path++ = hexdigits[(hash[i] >> j) & 0xf];
+  *path = '\0';
+}
+
 __attribute__ ((visibility ("hidden")))
 int mtcp_memcmp(char *dest, const char *src, size_t n)
 {
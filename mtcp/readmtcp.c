@@ -15,6 +15,7 @@ int mtcp_restore_cpfd = -1; // '= -1' puts it in regular data instead of common
 
 static void readcs (int fd, char cs);
 static void skipfile (int fd, size_t size);
+static void skipdedup (int fd, Area *area);
 static ssize_t readall(int fd, void *buf, size_t count);
 
 static const char* theUsage =
@@ -164,11 +165,16 @@ int main(int argc, char **argv) {
 
     readall(fd, &area, sizeof area);
     readcs (fd, CS_AREACONTENTS);
-#ifdef ANDROID
     if ((area.prot & MTCP_PROT_SKIP_PAGE) != 0) {
       printf("%p-%p %s skipped\n", area.addr, area.addr + area.size, area.name);
     } else
-#endif
+    if ((area.prot & MTCP_PROT_LEADER_SAVED) != 0) {
+      printf("%p-%p %s saved by another process\n",
+             area.addr, area.addr + area.size, area.name);
+    } else
+    if ((area.prot & MTCP_PROT_DEDUP) != 0) {
+      skipdedup (fd, &area);
+    } else
     if ((area.prot & MTCP_PROT_ZERO_PAGE) == 0) {
       skipfile (fd, area.size);
     }
@@ -202,6 +208,34 @@ static void readcs (int fd, char cs)
   }
 }
 
+/* Skips the contents of an MTCP_PROT_DEDUP area (see mtcp_internal.h). */
+static void skipdedup(int fd, Area *area)
+{
+  char dir[PATH_MAX];
+  DedupChunk c;
+  size_t off, n, stored = 0;
+  int len;
+
+  readall(fd, &len, sizeof len);
+  if (len < 0 || len >= PATH_MAX) {
+    printf("readmtcp: bad deduplication store path length %d\n", len);
+    exit(1);
+  }
+  readall(fd, dir, len);
+  dir[len] = '\0';
+  for (off = 0; off < area->size; off += n) {
+    n = area->size - off < MTCP_DEDUP_CHUNK_SIZE ? area->size - off
+                                                 : MTCP_DEDUP_CHUNK_SIZE;
+    readall(fd, &c, sizeof c);
+    if (c.inlined)
+      skipfile (fd, n);
+    else
+      stored += n;
+  }
+  printf("%p-%p %s %zu of %zu bytes in %s\n", area->addr,
+         area->addr + area->size, area->name, stored, area->size, dir);
+}
+
 static void skipfile(int fd, size_t size)
 {
   ssize_t rc;
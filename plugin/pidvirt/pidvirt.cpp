@@ -58,13 +58,13 @@ void pidVirt_ResetOnFork(void *data)
 
 void pidVirt_PrepareForExec(void *data)
 {
-  jalib::JBinarySerializeWriter *wr = (jalib::JBinarySerializeWriter*) data;
+  jalib::JBinarySerializer *wr = (jalib::JBinarySerializer*) data;
   dmtcp::VirtualPidTable::instance().serialize ( *wr );
 }
 
 void pidVirt_PostExec(void *data)
 {
-  jalib::JBinarySerializeReader *rd = (jalib::JBinarySerializeReader*) data;
+  jalib::JBinarySerializer *rd = (jalib::JBinarySerializer*) data;
   dmtcp::VirtualPidTable::instance().serialize ( *rd );
   dmtcp::VirtualPidTable::instance().refresh();
 }
@@ -106,24 +106,9 @@ void pidVirt_ThreadExit(void *data)
   dmtcp::VirtualPidTable::instance().erase(tid);
 }
 
-extern "C" void dmtcp_process_event(DmtcpEvent_t event, void* data)
+static void pidVirt_EventHandler(DmtcpEvent_t event, void* data)
 {
   switch (event) {
-    case DMTCP_EVENT_INIT:
-    case DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG:
-    case DMTCP_EVENT_GOT_SUSPEND_MSG:
-    case DMTCP_EVENT_START_PRE_CKPT_CB:
-    case DMTCP_EVENT_PRE_SUSPEND_USER_THREAD:
-    case DMTCP_EVENT_RESUME_USER_THREAD:
-    case DMTCP_EVENT_WRITE_CKPT_PREFIX:
-    case DMTCP_EVENT_PRE_EXIT:
-    case DMTCP_EVENT_PRE_CKPT:
-    case DMTCP_EVENT_POST_LEADER_ELECTION:
-    case DMTCP_EVENT_POST_DRAIN:
-    case DMTCP_EVENT_POST_CKPT:
-    case DMTCP_EVENT_POST_CKPT_RESUME:
-      break;
-
     case DMTCP_EVENT_RESET_ON_FORK:
       pidVirt_ResetOnFork(data);
       break;
@@ -156,7 +141,17 @@ extern "C" void dmtcp_process_event(DmtcpEvent_t event, void* data)
     default:
       break;
   }
+}
 
-  NEXT_DMTCP_PROCESS_EVENT(event, data);
-  return;
+static void __attribute__ ((constructor)) pidVirt_RegisterEventHandler()
+{
+  dmtcp_register_event_handler("pidvirt", pidVirt_EventHandler,
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_RESET_ON_FORK) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_PREPARE_FOR_EXEC) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_POST_EXEC) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_POST_RESTART) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_POST_RESTART_REFILL) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_POST_RESTART_RESUME) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_PTHREAD_RETURN) |
+                               DMTCP_EVENT_MASK(DMTCP_EVENT_PTHREAD_EXIT));
 }
@@ -24,6 +24,7 @@
 #include <string>
 #include <sstream>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/syscall.h>
 #include "constants.h"
 #include "util.h"
@@ -51,15 +52,220 @@ static void _do_unlock_tbl()
 }
 
 dmtcp::VirtualPidTable::VirtualPidTable()
+  : _hashSeq(0)
+  , _hashValid(false)
+  , _hashBits(0)
+  , _numSharedRealPids(0)
 {
   _do_lock_tbl();
   _pidMapTable.clear();
   //_pidMapTable[getpid()] = _real_getpid();
   //_pidMapTable[getppid()] = _real_getppid();
+  rebuildHash();
   _do_unlock_tbl();
 
 }
 
+/* Loads are not reordered with other loads on x86, so the read side of the
+ * sequence lock only needs to stop the compiler from reordering them.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+# define READ_BARRIER() __asm__ __volatile__ ("" : : : "memory")
+#else
+# define READ_BARRIER() __sync_synchronize()
+#endif
+
+static inline unsigned pidHash(pid_t pid, unsigned bits)
+{
+  return ((uint32_t) pid * 2654435761U) >> (32 - bits);
+}
+
+/* Returns the value that key had, or 0 if key is new. */
+pid_t dmtcp::VirtualPidTable::insertHash(PidHashEntry *table, unsigned bits,
+                                         pid_t key, pid_t value, bool replace)
+{
+  unsigned mask = (1U << bits) - 1;
+  for (unsigned i = pidHash(key, bits); ; i = (i + 1) & mask) {
+    if (table[i].key == 0) {
+      table[i].key = key;
+      table[i].value = value;
+      return 0;
+    }
+    if (table[i].key == key) {
+      pid_t old = table[i].value;
+      if (replace) table[i].value = value;
+      return old;
+    }
+  }
+}
+
+/* Removes key, and moves back the entries after it that would no longer be
+ * found (there are no tombstones).
+ */
+void dmtcp::VirtualPidTable::removeHash(PidHashEntry *table, unsigned bits,
+                                        pid_t key)
+{
+  unsigned mask = (1U << bits) - 1;
+  unsigned i = pidHash(key, bits);
+  while (table[i].key != key) {
+    if (table[i].key == 0) return;
+    i = (i + 1) & mask;
+  }
+  for (unsigned j = (i + 1) & mask; table[j].key != 0; j = (j + 1) & mask) {
+    unsigned home = pidHash(table[j].key, bits);
+    // Leave the entry if its home slot is cyclically in (i, j].
+    if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+      continue;
+    }
+    table[i] = table[j];
+    i = j;
+  }
+  table[i].key = 0;
+  table[i].value = 0;
+}
+
+/* Called with the table lock held after _pidMapTable was replaced or
+ * pruned.  The tables are at most half full; the real->virtual table keeps
+ * the smallest virtual pid for a real pid, as the linear search of the map
+ * used to do.
+ */
+void dmtcp::VirtualPidTable::rebuildHash()
+{
+  _hashSeq++;
+  __sync_synchronize();
+
+  unsigned bits = 4;
+  while ((1U << bits) < 2 * _pidMapTable.size()) {
+    bits++;
+  }
+  if (bits > PID_HASH_BITS_MAX) {
+    _hashValid = false;
+  } else {
+    _hashBits = bits;
+    _numSharedRealPids = 0;
+    memset(_virtualToRealHash, 0, sizeof(PidHashEntry) << bits);
+    memset(_realToVirtualHash, 0, sizeof(PidHashEntry) << bits);
+    for (pid_iterator i = _pidMapTable.begin(); i != _pidMapTable.end(); ++i) {
+      if (i->first > 0) {
+        insertHash(_virtualToRealHash, bits, i->first, i->second, true);
+      }
+      if (i->second > 0 &&
+          insertHash(_realToVirtualHash, bits, i->second, i->first, false)) {
+        _numSharedRealPids++;
+      }
+    }
+    _hashValid = true;
+  }
+
+  __sync_synchronize();
+  _hashSeq++;
+}
+
+/* Called with the table lock held after _pidMapTable[virtualPid] was set to
+ * realPid (and, if it was set before, removeFromHash() was called for the
+ * old mapping).
+ */
+void dmtcp::VirtualPidTable::addToHash(pid_t virtualPid, pid_t realPid)
+{
+  if (!_hashValid || 2 * _pidMapTable.size() > (1U << _hashBits)) {
+    rebuildHash();
+    return;
+  }
+
+  _hashSeq++;
+  __sync_synchronize();
+  if (virtualPid > 0) {
+    insertHash(_virtualToRealHash, _hashBits, virtualPid, realPid, true);
+  }
+  if (realPid > 0) {
+    pid_t old = insertHash(_realToVirtualHash, _hashBits, realPid, virtualPid,
+                           false);
+    if (old != 0) {
+      _numSharedRealPids++;
+      if (virtualPid < old) {
+        insertHash(_realToVirtualHash, _hashBits, realPid, virtualPid, true);
+      }
+    }
+  }
+  __sync_synchronize();
+  _hashSeq++;
+}
+
+/* Called with the table lock held after virtualPid, which was mapped to
+ * realPid, was erased from _pidMapTable.  If realPid has other virtual
+ * pids, the smallest of them must be found in the map; as that is rare, the
+ * tables are rebuilt then.
+ */
+void dmtcp::VirtualPidTable::removeFromHash(pid_t virtualPid, pid_t realPid)
+{
+  if (!_hashValid) {
+    rebuildHash();
+    return;
+  }
+
+  pid_t current = 0;
+  if (realPid > 0) {
+    unsigned mask = (1U << _hashBits) - 1;
+    for (unsigned i = pidHash(realPid, _hashBits);
+         _realToVirtualHash[i].key != 0; i = (i + 1) & mask) {
+      if (_realToVirtualHash[i].key == realPid) {
+        current = _realToVirtualHash[i].value;
+        break;
+      }
+    }
+    if (current == virtualPid && _numSharedRealPids > 0) {
+      rebuildHash();
+      return;
+    }
+  }
+
+  _hashSeq++;
+  __sync_synchronize();
+  if (virtualPid > 0) {
+    removeHash(_virtualToRealHash, _hashBits, virtualPid);
+  }
+  if (current == virtualPid) {
+    removeHash(_realToVirtualHash, _hashBits, realPid);
+  } else if (current != 0) {
+    _numSharedRealPids--;
+  }
+  __sync_synchronize();
+  _hashSeq++;
+}
+
+/* Lock-free lookup.  Returns false if a writer got in the way (or the map is
+ * too big for the tables) and the caller must search the map instead;
+ * otherwise *value is the value found, or 0 if key is not in the table.
+ */
+bool dmtcp::VirtualPidTable::lookupHash(const PidHashEntry *table, pid_t key,
+                                        pid_t *value)
+{
+  unsigned seq = _hashSeq;
+  READ_BARRIER();
+  if ((seq & 1) != 0 || !_hashValid) {
+    return false;
+  }
+  unsigned bits = _hashBits;
+  unsigned mask = (1U << bits) - 1;
+  unsigned i = pidHash(key, bits);
+  pid_t result = 0;
+  for (unsigned n = 0; n <= mask; n++, i = (i + 1) & mask) {
+    if (table[i].key == key) {
+      result = table[i].value;
+      break;
+    }
+    if (table[i].key == 0) {
+      break;
+    }
+  }
+  READ_BARRIER();
+  if (_hashSeq != seq) {
+    return false;
+  }
+  *value = result;
+  return true;
+}
+
 static dmtcp::VirtualPidTable *inst = NULL;
 dmtcp::VirtualPidTable& dmtcp::VirtualPidTable::instance()
 {
@@ -79,6 +285,7 @@ void dmtcp::VirtualPidTable::postRestart()
   _do_lock_tbl();
   _pidMapTable.clear();
   _pidMapTable[getpid()] = _real_getpid();
+  rebuildHash();
   _do_unlock_tbl();
 }
 
@@ -110,6 +317,7 @@ void dmtcp::VirtualPidTable::refresh()
       _pidMapTable.erase(i);
     }
   }
+  rebuildHash();
   _do_unlock_tbl();
   printPidMaps();
 }
@@ -151,6 +359,8 @@ void dmtcp::VirtualPidTable::resetOnFork()
   tblLock = newlock;
   _nextVirtualTid = INITIAL_VIRTUAL_TID;
   _numTids = 1;
+  // Another thread may have been in the middle of rebuildHash().
+  _hashSeq = 0;
   _pidMapTable[getpid()] = _real_getpid();
   refresh();
   printPidMaps();
@@ -164,6 +374,14 @@ pid_t dmtcp::VirtualPidTable::virtualToReal(pid_t virtualPid)
     return virtualPid;
   }
 
+  if (lookupHash(_virtualToRealHash, virtualPid < -1 ? abs(virtualPid)
+                                                     : virtualPid, &retVal)) {
+    if (retVal == 0) {
+      return virtualPid;
+    }
+    return virtualPid < -1 ? -retVal : retVal;
+  }
+
   /* This code is called from MTCP while the checkpoint thread is holding
      the JASSERT log lock. Therefore, don't call JTRACE/JASSERT/JINFO/etc. in
      this function. */
@@ -188,6 +406,16 @@ pid_t dmtcp::VirtualPidTable::realToVirtual(pid_t realPid)
     return realPid;
   }
 
+  pid_t virtualPid;
+  if (lookupHash(_realToVirtualHash, realPid, &virtualPid)) {
+    if (virtualPid != 0) {
+      return virtualPid;
+    }
+    if (dmtcp_is_ptracing == 0 || !dmtcp_is_ptracing()) {
+      return realPid;
+    }
+  }
+
   /* This code is called from MTCP while the checkpoint thread is holding
      the JASSERT log lock. Therefore, don't call JTRACE/JASSERT/JINFO/etc. in
      this function. */
@@ -200,7 +428,7 @@ pid_t dmtcp::VirtualPidTable::realToVirtual(pid_t realPid)
   }
 
   if (dmtcp_is_ptracing != 0 && dmtcp_is_ptracing()) {
-    pid_t virtualPid = readVirtualTidFromFileForPtrace(gettid());
+    virtualPid = readVirtualTidFromFileForPtrace(gettid());
     if (virtualPid != -1) {
       _do_unlock_tbl();
       updateMapping(virtualPid, realPid);
@@ -217,14 +445,29 @@ pid_t dmtcp::VirtualPidTable::realToVirtual(pid_t realPid)
 void dmtcp::VirtualPidTable::erase( pid_t virtualPid )
 {
   _do_lock_tbl();
-  _pidMapTable.erase( virtualPid );
+  pid_iterator i = _pidMapTable.find(virtualPid);
+  if (i != _pidMapTable.end()) {
+    pid_t realPid = i->second;
+    _pidMapTable.erase(i);
+    removeFromHash(virtualPid, realPid);
+  }
   _do_unlock_tbl();
 }
 
 void dmtcp::VirtualPidTable::updateMapping( pid_t virtualPid, pid_t realPid )
 {
   _do_lock_tbl();
-  _pidMapTable[virtualPid] = realPid;
+  pid_iterator i = _pidMapTable.find(virtualPid);
+  if (i == _pidMapTable.end()) {
+    _pidMapTable[virtualPid] = realPid;
+    addToHash(virtualPid, realPid);
+  } else if (i->second != realPid) {
+    pid_t oldRealPid = i->second;
+    _pidMapTable.erase(i);
+    removeFromHash(virtualPid, oldRealPid);
+    _pidMapTable[virtualPid] = realPid;
+    addToHash(virtualPid, realPid);
+  }
   _do_unlock_tbl();
 }
 
@@ -241,6 +484,10 @@ dmtcp::vector< pid_t > dmtcp::VirtualPidTable::getPidVector( )
 bool dmtcp::VirtualPidTable::realPidExists( pid_t pid )
 {
   bool retval = false;
+  pid_t virtualPid;
+  if (pid > 0 && lookupHash(_realToVirtualHash, pid, &virtualPid)) {
+    return virtualPid != 0;
+  }
   _do_lock_tbl();
   for (pid_iterator i = _pidMapTable.begin(); i != _pidMapTable.end(); ++i) {
     if (i->second == pid) {
@@ -255,6 +502,10 @@ bool dmtcp::VirtualPidTable::realPidExists( pid_t pid )
 bool dmtcp::VirtualPidTable::pidExists( pid_t pid )
 {
   bool retVal = false;
+  pid_t realPid;
+  if (pid > 0 && lookupHash(_virtualToRealHash, pid, &realPid)) {
+    return realPid != 0;
+  }
   _do_lock_tbl();
   pid_iterator j = _pidMapTable.find ( pid );
   if ( j != _pidMapTable.end() )
@@ -322,27 +573,27 @@ void dmtcp::VirtualPidTable::serialize ( jalib::JBinarySerializer& o )
   JSERIALIZE_ASSERT_POINT ( "dmtcp::VirtualPidTable:" );
   o.serializeMap(_pidMapTable);
   JSERIALIZE_ASSERT_POINT( "EOF" );
+  _do_lock_tbl();
+  rebuildHash();
+  _do_unlock_tbl();
   printPidMaps();
 }
 
 
 void dmtcp::VirtualPidTable::writePidMapsToFile()
 {
-  //size_t numMaps = 0;
-  dmtcp::string mapFile;
-  mapFile = jalib::Filesystem::ResolveSymlink(
-              "/proc/self/fd/" + jalib::XToString(PROTECTED_PIDMAP_FD));
-  JASSERT (mapFile.length() > 0) (mapFile);
-  JTRACE ("Write PidMaps to file") (mapFile);
+  JTRACE ("Write PidMaps to file") (PROTECTED_PIDMAP_FD);
 
-  // Lock fileset before any operations
-  Util::lockFile(PROTECTED_PIDMAP_FD);
+  // Serialize before taking the file lock, and write with a single write.
+  jalib::JBinarySerializeWriterMem mapwr("dmtcpPidMap");
   _do_lock_tbl();
-
-  jalib::JBinarySerializeWriterRaw mapwr(mapFile, PROTECTED_PIDMAP_FD);
   mapwr.serializeMap(_pidMapTable);
-
   _do_unlock_tbl();
+
+  // Lock fileset before any operations
+  Util::lockFile(PROTECTED_PIDMAP_FD);
+  JASSERT(Util::writeAll(PROTECTED_PIDMAP_FD, mapwr.data(), mapwr.size())
+          == (ssize_t) mapwr.size()) (mapwr.size()) (JASSERT_ERRNO);
   Util::unlockFile(PROTECTED_PIDMAP_FD);
 }
 
@@ -366,11 +617,16 @@ void dmtcp::VirtualPidTable::readPidMapsFromFile()
   while (!maprd.isEOF()) {
     maprd.serializeMap(_pidMapTable);
   }
+  rebuildHash();
 
   _do_unlock_tbl();
   Util::unlockFile(PROTECTED_PIDMAP_FD);
 
   printPidMaps();
   close(PROTECTED_PIDMAP_FD);
-  unlink(mapFile.c_str());
+  // A restart split across several dmtcp_restart's shares a named map file
+  // (see dmtcp_restart.cpp); anonymous map files need no cleanup.
+  if (!Util::strEndsWith(mapFile, " (deleted)")) {
+    unlink(mapFile.c_str());
+  }
 }
@@ -88,8 +88,37 @@ namespace dmtcp
       pid_t getNewVirtualTid();
 
     private:
+      /* _pidMapTable is the authoritative map; it is only touched with the
+       * table lock held.  Every change to it is mirrored into two open
+       * addressing hash tables (virtual->real and real->virtual) guarded by
+       * a sequence lock, so that translations need no lock at all.  Single
+       * mappings are added and removed in place; the tables are rebuilt
+       * from the map when it is replaced or pruned, or when they fill up.
+       * If the map grows too big for the tables, lookups fall back to it.
+       */
+      enum { PID_HASH_BITS_MAX = 12,
+             PID_HASH_SIZE_MAX = 1 << PID_HASH_BITS_MAX };
+      struct PidHashEntry {
+        pid_t key;
+        pid_t value;
+      };
+      bool lookupHash(const PidHashEntry *table, pid_t key, pid_t *value);
+      static pid_t insertHash(PidHashEntry *table, unsigned bits, pid_t key,
+                              pid_t value, bool replace);
+      static void removeHash(PidHashEntry *table, unsigned bits, pid_t key);
+      void rebuildHash();
+      void addToHash(pid_t virtualPid, pid_t realPid);
+      void removeFromHash(pid_t virtualPid, pid_t realPid);
+
       typedef dmtcp::map<pid_t, pid_t>::iterator pid_iterator;
       dmtcp::map<pid_t, pid_t> _pidMapTable;
+
+      volatile unsigned _hashSeq;
+      bool _hashValid;
+      unsigned _hashBits;
+      size_t _numSharedRealPids;  // virtual pids beyond the first of a real pid
+      PidHashEntry _virtualToRealHash[PID_HASH_SIZE_MAX];
+      PidHashEntry _realToVirtualHash[PID_HASH_SIZE_MAX];
   };
 }
 
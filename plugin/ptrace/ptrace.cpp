@@ -53,7 +53,7 @@ void ptraceProcessResumeUserThread(void *data)
   JNOTE("") (GETTID());
 }
 
-extern "C" void dmtcp_process_event(DmtcpEvent_t event, void* data)
+static void ptraceEventHandler(DmtcpEvent_t event, void* data)
 {
   switch (event) {
     case DMTCP_EVENT_INIT:
@@ -76,20 +76,17 @@ extern "C" void dmtcp_process_event(DmtcpEvent_t event, void* data)
       originalStartup = 1;
       break;
 
-    case DMTCP_EVENT_THREAD_CREATED:
-    case DMTCP_EVENT_THREAD_START:
-    case DMTCP_EVENT_GOT_SUSPEND_MSG:
-    case DMTCP_EVENT_START_PRE_CKPT_CB:
-    case DMTCP_EVENT_POST_RESTART_REFILL:
-    case DMTCP_EVENT_PRE_CKPT:
-    case DMTCP_EVENT_POST_LEADER_ELECTION:
-    case DMTCP_EVENT_POST_DRAIN:
-    case DMTCP_EVENT_POST_CKPT:
-    case DMTCP_EVENT_POST_RESTART:
     default:
       break;
   }
+}
 
-  NEXT_DMTCP_PROCESS_EVENT(event, data);
-  return;
+static void __attribute__ ((constructor)) ptraceRegisterEventHandler()
+{
+  dmtcp_register_event_handler("ptrace", ptraceEventHandler,
+                           DMTCP_EVENT_MASK(DMTCP_EVENT_INIT) |
+                           DMTCP_EVENT_MASK(DMTCP_EVENT_WAIT_FOR_SUSPEND_MSG) |
+                           DMTCP_EVENT_MASK(DMTCP_EVENT_PRE_SUSPEND_USER_THREAD) |
+                           DMTCP_EVENT_MASK(DMTCP_EVENT_RESUME_USER_THREAD) |
+                           DMTCP_EVENT_MASK(DMTCP_EVENT_RESET_ON_FORK));
 }
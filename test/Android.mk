@@ -12,6 +12,7 @@ LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
 
 include $(CLEAR_VARS)
+LOCAL_C_INCLUDES := external/dmtcp/dmtcp/src
 LOCAL_SRC_FILES := dmtcp-tls.cpp
 LOCAL_CFLAGS+= $(common_C_FLAGS)
 LOCAL_MODULE := dmtcp-tls
@@ -118,6 +119,13 @@ LOCAL_MODULE := dmtcp-shared-memory
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := shared-mmap.c
+LOCAL_CFLAGS+= $(common_C_FLAGS)
+LOCAL_MODULE := dmtcp-shared-mmap
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES := shared-fd.c
 LOCAL_CFLAGS+= $(common_C_FLAGS)
@@ -641,6 +641,8 @@ os.environ['DMTCP_GZIP'] = "0"
 
 runTest("shared-memory", 2, ["./test/shared-memory"])
 
+runTest("shared-mmap",   2, ["./test/shared-mmap"])
+
 # This is arguably a bug in the Linux kernel 3.2 for ARM.
 if sys.version_info[0] == 2 and sys.version_info[0:2] >= (2,7):
   if subprocess.check_output(['uname', '-p'])[0:3] == 'arm':
@@ -0,0 +1,58 @@
+#!/bin/sh
+
+# Measures how long a blocking checkpoint (dmtcp_command --bcheckpoint) takes
+# for a small job:  test/dmtcp1 alone, and test/dmtcp1 with a second process
+# from test/dmtcp_fork.  Prints one JSON document with the time of each
+# checkpoint, so that coordinator protocol changes can be compared.
+#
+# Usage (from the top-level directory):  test/ckpt-latency.sh [NUM_CKPTS]
+
+TOP=`cd \`dirname $0\`/.. && pwd`
+NUM=${1:-10}
+PORT=${DMTCP_PORT:-7781}
+TMP=`mktemp -d /tmp/ckpt-latency.XXXXXX`
+COORD="$TOP/bin/dmtcp_coordinator --port $PORT --background --quiet"
+CHECKPOINT="$TOP/bin/dmtcp_checkpoint --port $PORT --quiet --quiet"
+COMMAND="$TOP/bin/dmtcp_command --port $PORT --quiet"
+
+for t in dmtcp1 dmtcp_fork; do
+  if [ ! -x $TOP/test/$t ]; then
+    echo "$TOP/test/$t not found; run 'make tests' first." >&2
+    exit 1
+  fi
+done
+
+now_ns() {
+  date +%s%N
+}
+
+run() {
+  label=$1
+  shift
+  $COORD --ckptdir $TMP || exit 1
+  (cd $TMP && $CHECKPOINT --ckptdir $TMP "$@" > /dev/null 2>&1 &)
+  sleep 2
+  echo "  {\"label\": \"$label\", \"ms_per_checkpoint\": ["
+  sep=""
+  i=0
+  while [ $i -lt $NUM ]; do
+    start=`now_ns`
+    $COMMAND --bcheckpoint > /dev/null || exit 1
+    end=`now_ns`
+    printf '%s    %s' "$sep" `expr \( $end - $start \) / 1000000`
+    sep=",
+"
+    i=`expr $i + 1`
+  done
+  echo
+  echo "  ]}"
+  $COMMAND --quit > /dev/null 2>&1
+  sleep 1
+}
+
+echo '{ "runs": ['
+run uniprocess $TOP/test/dmtcp1
+echo ','
+run two-processes $TOP/test/dmtcp_fork
+echo '] }'
+rm -rf $TMP
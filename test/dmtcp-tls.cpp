@@ -1,54 +1,37 @@
+/* Compile with:  g++ -I../dmtcp/src THIS_FILE -lpthread
+ *
+ * Stand-alone test of dmtcp::TLS<T> (dmtcp/src/tls.h), which DMTCP uses on
+ * Android in place of __thread.  TLSUtils is normally implemented in
+ * dmtcp/src/tls.cpp on top of the real libpthread; here it calls libc
+ * directly.  Starts more threads than the old fixed-size backing store could
+ * hold, all of them alive at once, and checks that every thread sees its own
+ * copy.  Exits with status 0 on success.
+ */
+
 #include <stdio.h>
-#include <stdio.h>
-#include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
-#include <dlfcn.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include "tls.h"
-namespace dmtcp {
-  class TLSUtils {
-    public:
-      typedef void *(*pthread_getspecific_t)(pthread_key_t);
-      typedef int (*pthread_setspecific_t)(pthread_key_t, const void *);
-      typedef int (*pthread_key_create_t)(pthread_key_t *,
-                                          void (*dtor)(void *));
-      typedef int (*pthread_key_delete_t)(pthread_key_t);
-
-      static void *pthread_getspecific(pthread_key_t key);
-      static int pthread_setspecific(pthread_key_t key, const void *value);
-      static int pthread_key_create(pthread_key_t *key,
-                                    void (*dtor)(void *));
-      static int pthread_key_delete(pthread_key_t key);
-      static void debug(const char *str);
-    private:
-      static TLSUtils &instance();
-      TLSUtils();
-
-      pthread_getspecific_t _pthread_getspecific;
-      pthread_setspecific_t _pthread_setspecific;
-      pthread_key_create_t _pthread_key_create;
-      pthread_key_delete_t _pthread_key_delete;
-  };
-}
-
 
 namespace dmtcp {
 
+TLSUtils::pthread_getspecific_t TLSUtils::_getspecific = NULL;
+
 TLSUtils &TLSUtils::instance() {
   static TLSUtils _instance;
   return _instance;
 }
 
 TLSUtils::TLSUtils() {
-  _pthread_getspecific
-    = ::pthread_getspecific;
-  _pthread_setspecific
-    = ::pthread_setspecific;
-  _pthread_key_create
-    = ::pthread_key_create;
-  _pthread_key_delete
-    = ::pthread_key_delete;
+  _pthread_getspecific = ::pthread_getspecific;
+  _pthread_setspecific = ::pthread_setspecific;
+  _pthread_key_create = ::pthread_key_create;
+  _pthread_key_delete = ::pthread_key_delete;
+  _getspecific = _pthread_getspecific;
 }
 
 void *TLSUtils::pthread_getspecific(pthread_key_t key) {
@@ -68,109 +51,88 @@ int TLSUtils::pthread_key_delete(pthread_key_t key) {
   return instance()._pthread_key_delete(key);
 }
 
+void *TLSUtils::allocate(size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
 void TLSUtils::debug(const char *str) {
+  fputs(str, stderr);
 }
 
 }
 
-namespace dmtcp {
-  template<class T>
-  TLS<T>::TLS()
-    : _tlsKey(0)
-    , _default()
-  {
-    TLSUtils::pthread_key_create(&_tlsKey, NULL);
-  }
+#define NUM_THREADS 3000
+#define NUM_INCREMENTS 1000
 
-  template<class T>
-  TLS<T>::TLS(const T &val)
-    : _tlsKey(0)
-    , _default(val)
-  {
-    TLSUtils::pthread_key_create(&_tlsKey, NULL);
-  }
+struct Counter {
+  intptr_t id;
+  long count;
+};
 
-  template<class T>
-  TLS<T>::~TLS() {
-    T *data = get();
-    TLSUtils::pthread_key_delete(_tlsKey);
-  }
+static const Counter defaultCounter = {-1, 0};
+static dmtcp::TLS<Counter> counter = defaultCounter;
+static dmtcp::TLS<int> tint = 10;
 
-  template<class T>
-  T *TLS<T>::get() {
-    T *data = (T *)TLSUtils::pthread_getspecific(_tlsKey);
-    if (data == NULL) {
-      data = TLS<T>::malloc();
-      *data = _default;
-      TLSUtils::pthread_setspecific(_tlsKey, (void*)data);
-    }
-    return data;
-  }
+static pthread_barrier_t barrier;
+static volatile int failures = 0;
 
-  template<class T>
-  T &TLS<T>::operator=(const T &val) {
-    T *data = get();
-    *data = val;
-    return *data;
-  }
+static void *f(void *arg) {
+  intptr_t id = (intptr_t)arg;
+  Counter &c = counter;
 
-  template<class T>
-  TLS<T>::operator T&() {
-    T *data = get();
-    return *data;
+  if (c.id != -1 || c.count != 0 || (int)tint != 10) {
+    __sync_fetch_and_add(&failures, 1);
   }
-
-  template<class T>
-  const T *TLS<T>::get() const {
-    T *data = (T *)TLSUtils::pthread_getspecific(_tlsKey);
-    if (data == NULL) {
-      data = TLS<T>::malloc();
-      *data = _default;
-      TLSUtils::pthread_setspecific(_tlsKey, (void*)data);
-    }
-    return data;
-  }
-
-  template<class T>
-  const T &TLS<T>::operator=(const T &val) const {
-    const T *data = get();
-    *data = val;
-    return *data;
+  c.id = id;
+  // Keep every thread alive until all of them have their TLS data.
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < NUM_INCREMENTS; i++) {
+    ((Counter&)counter).count++;
+    tint = (int)tint + 1;
   }
-
-  template<class T>
-  TLS<T>::operator const T&() const {
-    const T *data = get();
-    return *data;
-  }
-
-  template<class T>
-  T *TLS<T>::malloc() {
-    static int idx = 0;
-    static T tls_storage[1024];
-    return &tls_storage[idx++];
+  pthread_barrier_wait(&barrier);
+  c = counter;
+  if (c.id != id || c.count != NUM_INCREMENTS ||
+      (int)tint != 10 + NUM_INCREMENTS) {
+    __sync_fetch_and_add(&failures, 1);
   }
-}
-
-dmtcp::TLS<int> tint = 10; 
-
-void *f(void *arg) {
-  intptr_t v = (intptr_t)arg;
-  printf("thread %d!\n",v);
-  for (int i=0;i<100000;i++) {
-    tint++;
-  }
-  printf("thread %d!\n", (int)tint);
   return NULL;
 }
 
 int main(int argc, const char * const argv[]) {
-  pthread_t pth[10];
-  for (int i =0 ;i <10;i++) {
-    pthread_create(&pth[i], NULL, f, (void *)(intptr_t)i);
+  static pthread_t pth[NUM_THREADS];
+  pthread_attr_t attr;
+  int numThreads;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+  for (numThreads = 0; numThreads < NUM_THREADS; numThreads++) {
+    int res = pthread_create(&pth[numThreads], &attr, f,
+                             (void *)(intptr_t)numThreads);
+    if (res != 0) {
+      fprintf(stderr, "error creating thread %d: %s\n",
+              numThreads, strerror(res));
+      return 1;
+    }
   }
-  for (int i =0 ;i <10;i++) {
+  for (int i = 0; i < numThreads; i++) {
     pthread_join(pth[i], NULL);
   }
+
+  // Slots of exited threads are reused.
+  pthread_barrier_destroy(&barrier);
+  pthread_barrier_init(&barrier, NULL, 1);
+  pthread_create(&pth[0], &attr, f, (void *)0);
+  pthread_join(pth[0], NULL);
+
+  if (failures != 0) {
+    printf("dmtcp-tls: %d of %d threads saw wrong TLS data\n",
+           failures, numThreads + 1);
+    return 1;
+  }
+  printf("dmtcp-tls: %d threads OK\n", numThreads + 1);
   return 0;
 }
@@ -0,0 +1,95 @@
+/* Built by "make bench"; links against libjalib.a.
+ *
+ * Microbenchmark of jalib::JAllocDispatcher, the allocator behind all of
+ * DMTCP's internal containers.  Each thread keeps LIVE blocks of 24 to 924
+ * bytes (the sizes of the 64-, 256- and 1024-byte classes) and replaces a
+ * random one at every step: one deallocate() and one allocate().  This is
+ * done with 1, 2, 4, ... MAX_THREADS threads; malloc/free is timed the same
+ * way for comparison.  Prints the throughput, in millions of
+ * allocate+deallocate pairs per second over all threads, as JSON on stdout.
+ * On a single CPU the threads never run at the same time, so such a run
+ * shows the cost of the locking but not contention on allocateLock; run it
+ * on a multi-core machine to see how the magazines scale.
+ *
+ * Usage: jalloc-bench [MAX_THREADS [STEPS_PER_THREAD]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "jalloc.h"
+
+#define LIVE 16
+
+static size_t steps;
+static bool useMalloc;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *worker(void *arg)
+{
+  unsigned seed = (unsigned) (unsigned long) arg;
+  void *blocks[LIVE] = { NULL };
+  size_t sizes[LIVE] = { 0 };
+
+  for (size_t i = 0; i < steps; i++) {
+    seed = seed * 1103515245 + 12345;
+    unsigned slot = (seed >> 16) % LIVE;
+    size_t n = 24 + (seed >> 4) % 901;
+    if (useMalloc) {
+      free(blocks[slot]);
+      blocks[slot] = malloc(n);
+    } else {
+      jalib::JAllocDispatcher::deallocate(blocks[slot], sizes[slot]);
+      blocks[slot] = jalib::JAllocDispatcher::allocate(n);
+    }
+    *(char*) blocks[slot] = 1;
+    sizes[slot] = n;
+  }
+  for (int slot = 0; slot < LIVE; slot++) {
+    if (useMalloc) {
+      free(blocks[slot]);
+    } else {
+      jalib::JAllocDispatcher::deallocate(blocks[slot], sizes[slot]);
+    }
+  }
+  return NULL;
+}
+
+static double run(int numThreads)
+{
+  pthread_t threads[numThreads];
+  double t = now();
+  for (int i = 0; i < numThreads; i++) {
+    pthread_create(&threads[i], NULL, worker, (void*) (unsigned long) (i + 1));
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return numThreads * steps / (now() - t) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+  int maxThreads = argc > 1 ? atoi(argv[1]) : 8;
+  steps = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  printf("{\n  \"steps_per_thread\": %lu,\n  \"live_per_thread\": %d,\n"
+         "  \"results\": [\n", (unsigned long) steps, LIVE);
+  for (int n = 1; n <= maxThreads; n *= 2) {
+    useMalloc = false;
+    double jalloc = run(n);
+    useMalloc = true;
+    double libc = run(n);
+    printf("    {\"threads\": %d, \"jalloc_mops\": %.1f, \"malloc_mops\": %.1f}"
+           "%s\n", n, jalloc, libc, n * 2 <= maxThreads ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,147 @@
+/* Built by "make bench"; links against the coordinator's objects.
+ *
+ * Microbenchmark of dmtcp::LookupService, the coordinator's name service
+ * database.  Registers NUM_KEYS keys (16-byte keys and values, like a
+ * connection id and its address), first one at a time and then in batches
+ * of BATCH entries as workers send them, looks all of them up the same two
+ * ways, and repeats the batched registration after reset(), as happens at
+ * every checkpoint.  A std::map of the same data is timed for comparison.
+ * Prints the time per key, in nanoseconds, as JSON on stdout.
+ *
+ * Usage: lookup-service-bench [NUM_KEYS [BATCH]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <map>
+#include <string>
+#include "lookup_service.h"
+
+struct Key { uint64_t a, b; };
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void makeKey(size_t i, Key *k, Key *v)
+{
+  k->a = i * 0x9e3779b97f4a7c15ULL;
+  k->b = i;
+  v->a = ~i;
+  v->b = i + 1;
+}
+
+// Entries [first, first+n) as one DMT_REGISTER_NAME_SERVICE_DATA or
+// DMT_NAME_SERVICE_QUERY message would carry them.
+static void makeBatch(dmtcp::vector<char>& buf, size_t first, size_t n,
+                      bool withValues)
+{
+  buf.clear();
+  for (size_t i = first; i < first + n; i++) {
+    Key k, v;
+    makeKey(i, &k, &v);
+    dmtcp::DmtcpNameServiceEntry e;
+    e.keyLen = sizeof(k);
+    e.valLen = withValues ? sizeof(v) : 0;
+    buf.insert(buf.end(), (char*) &e, (char*) (&e + 1));
+    buf.insert(buf.end(), (char*) &k, (char*) (&k + 1));
+    if (withValues) {
+      buf.insert(buf.end(), (char*) &v, (char*) (&v + 1));
+    }
+  }
+}
+
+static void report(const char *name, double secs, size_t n, bool last = false)
+{
+  printf("    {\"benchmark\": \"%s\", \"ns_per_key\": %.1f}%s\n",
+         name, secs * 1e9 / n, last ? "" : ",");
+}
+
+int main(int argc, char *argv[])
+{
+  size_t numKeys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t batch = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+  dmtcp::LookupService db;
+  dmtcp::vector<char> buf, reply;
+  double t;
+
+  printf("{\n  \"keys\": %lu,\n  \"batch\": %lu,\n  \"results\": [\n",
+         (unsigned long) numKeys, (unsigned long) batch);
+
+  t = now();
+  for (size_t i = 0; i < numKeys; i++) {
+    Key k, v;
+    makeKey(i, &k, &v);
+    db.addKeyValue(&k, sizeof(k), &v, sizeof(v));
+  }
+  report("register", now() - t, numKeys);
+
+  t = now();
+  for (size_t i = 0; i < numKeys; i++) {
+    Key k, v;
+    void *val;
+    size_t valLen;
+    makeKey(i, &k, &v);
+    if (db.query(&k, sizeof(k), &val, &valLen) == NULL ||
+        memcmp(val, &v, sizeof(v)) != 0) {
+      fprintf(stderr, "lookup-service-bench: wrong value for key %lu\n",
+              (unsigned long) i);
+      return 1;
+    }
+  }
+  report("query", now() - t, numKeys);
+
+  // Batches are built outside of the timed sections.
+  double regTime = 0, queryTime = 0;
+  for (int round = 0; round < 2; round++) {
+    db.reset();
+    regTime = 0;
+    for (size_t i = 0; i < numKeys; i += batch) {
+      size_t n = numKeys - i < batch ? numKeys - i : batch;
+      makeBatch(buf, i, n, true);
+      t = now();
+      db.addEntries(&buf[0], buf.size(), n);
+      regTime += now() - t;
+    }
+    report(round == 0 ? "register_batch" : "register_batch_after_reset",
+           regTime, numKeys);
+  }
+
+  for (size_t i = 0; i < numKeys; i += batch) {
+    size_t n = numKeys - i < batch ? numKeys - i : batch;
+    makeBatch(buf, i, n, false);
+    reply.clear();
+    t = now();
+    db.queryEntries(&buf[0], buf.size(), n, reply);
+    queryTime += now() - t;
+  }
+  report("query_batch", queryTime, numKeys);
+
+  std::map<std::string, std::string> ref;
+  t = now();
+  for (size_t i = 0; i < numKeys; i++) {
+    Key k, v;
+    makeKey(i, &k, &v);
+    ref[std::string((char*) &k, sizeof(k))] = std::string((char*) &v,
+                                                          sizeof(v));
+  }
+  report("std_map_register", now() - t, numKeys);
+  t = now();
+  for (size_t i = 0; i < numKeys; i++) {
+    Key k, v;
+    makeKey(i, &k, &v);
+    if (ref.find(std::string((char*) &k, sizeof(k))) == ref.end()) {
+      return 1;
+    }
+  }
+  report("std_map_query", now() - t, numKeys, true);
+
+  printf("  ]\n}\n");
+  return db.size() == numKeys ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/* Compile with:  gcc THIS_FILE -lpthread
+ *
+ * Measures malloc()/free() throughput for 1, 2, 4, ... up to MAX_THREADS
+ * threads (default: number of online CPUs).  Every call goes through the
+ * DMTCP malloc wrappers and the wrapper-execution lock, so comparing
+ *     ./test/malloc-scalability
+ *     bin/dmtcp_checkpoint ./test/malloc-scalability
+ * shows how well the wrappers scale with the number of threads.
+ *
+ * Usage: malloc-scalability [MAX_THREADS [ITERATIONS_PER_THREAD]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static long iterations = 1000000;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void *start_routine(void *arg)
+{
+  long i;
+  void *ptrs[16];
+  memset(ptrs, 0, sizeof(ptrs));
+  for (i = 0; i < iterations; i++) {
+    int slot = i % 16;
+    free(ptrs[slot]);
+    ptrs[slot] = malloc(16 + (i % 8) * 16);
+  }
+  for (i = 0; i < 16; i++) {
+    free(ptrs[i]);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  int maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int numThreads;
+
+  if (argc > 1) maxThreads = atoi(argv[1]);
+  if (argc > 2) iterations = atol(argv[2]);
+  if (maxThreads < 1) maxThreads = 1;
+
+  printf("%8s %14s %14s\n", "threads", "Mops/s", "ns/op/thread");
+  for (numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+    double start = now();
+    int i;
+    for (i = 0; i < numThreads; i++) {
+      int res = pthread_create(&threads[i], NULL, start_routine, NULL);
+      if (res != 0) {
+        fprintf(stderr, "error creating thread: %s\n", strerror(res));
+        return 1;
+      }
+    }
+    for (i = 0; i < numThreads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    double elapsed = now() - start;
+    /* One malloc() and one free() per iteration. */
+    double ops = 2.0 * iterations * numThreads;
+    printf("%8d %14.2f %14.1f\n", numThreads, ops / elapsed / 1e6,
+           elapsed * 1e9 * numThreads / ops);
+    free(threads);
+    if (numThreads < maxThreads && numThreads * 2 > maxThreads) {
+      numThreads = maxThreads / 2;
+    }
+  }
+  return 0;
+}
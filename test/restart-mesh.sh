@@ -0,0 +1,74 @@
+#!/bin/sh
+
+# Measures how long dmtcp_restart takes to bring back a fully connected job
+# of N processes (test/socket-mesh, N*(N-1) socket endpoints), for growing N.
+# The time runs from starting dmtcp_restart until the coordinator reports all
+# N processes RUNNING again; the mesh is then left running for a second, so a
+# connection restored to the wrong peer shows up as fewer peers.  Prints one
+# JSON document with the restart time for each N.
+#
+# Usage (from the top-level directory):  test/restart-mesh.sh [N ...]
+
+TOP=`cd \`dirname $0\`/.. && pwd`
+SIZES=${*:-"2 4 8 16 32"}
+PORT=${DMTCP_PORT:-7782}
+TMP=`mktemp -d /tmp/restart-mesh.XXXXXX`
+COORD="$TOP/bin/dmtcp_coordinator --port $PORT --background --quiet"
+CHECKPOINT="$TOP/bin/dmtcp_checkpoint --port $PORT --quiet --quiet"
+RESTART="$TOP/bin/dmtcp_restart --port $PORT --quiet --quiet"
+COMMAND="$TOP/bin/dmtcp_command --port $PORT --quiet"
+
+if [ ! -x $TOP/test/socket-mesh ]; then
+  echo "$TOP/test/socket-mesh not found; run 'make tests' first." >&2
+  exit 1
+fi
+
+now_ns() {
+  date +%s%N
+}
+
+# True once all $1 processes are connected and RUNNING.
+all_running() {
+  status=`$COMMAND -s 2>/dev/null`
+  echo "$status" | grep -q "^NUM_PEERS=$1\$" &&
+    echo "$status" | grep -q '^RUNNING=yes$'
+}
+
+run() {
+  n=$1
+  rm -f $TMP/ckpt_*.dmtcp
+  $COORD --ckptdir $TMP || exit 1
+  (cd $TMP && $CHECKPOINT --ckptdir $TMP $TOP/test/socket-mesh $n \
+     > /dev/null 2>&1 &)
+  while ! all_running $n; do sleep 1; done
+  $COMMAND --bcheckpoint > /dev/null || exit 1
+  $COMMAND --kill > /dev/null
+  while [ "`$COMMAND -s 2>/dev/null | grep '^NUM_PEERS='`" != NUM_PEERS=0 ]; do
+    sleep 1
+  done
+
+  start=`now_ns`
+  (cd $TMP && $RESTART $TMP/ckpt_*.dmtcp > /dev/null 2>&1 &)
+  while ! all_running $n; do :; done
+  end=`now_ns`
+  sleep 1
+  if all_running $n; then ok=true; else ok=false; fi
+
+  printf '  {"processes": %s, "sockets": %s, "ms_restart": %s, "ok": %s}' \
+    $n `expr $n \* \( $n - 1 \)` `expr \( $end - $start \) / 1000000` $ok
+  $COMMAND --kill > /dev/null 2>&1
+  $COMMAND --quit > /dev/null 2>&1
+  sleep 1
+}
+
+echo '{ "runs": ['
+sep=""
+for n in $SIZES; do
+  printf '%s' "$sep"
+  run $n
+  sep=",
+"
+done
+echo
+echo '] }'
+rm -rf $TMP
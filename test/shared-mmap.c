@@ -0,0 +1,80 @@
+/* Two processes ping-pong a counter through a writable MAP_SHARED mapping
+ * of a regular file (not deleted, unlike shared-memory.c), so that only one
+ * of them saves its contents at checkpoint time.  The rest of the mapping
+ * holds a pattern that is checked on every round.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#define NUM_INTS (4 * 4096 / sizeof(int))
+
+static int *map(int fd)
+{
+  int *ptr = mmap(NULL, NUM_INTS * sizeof(int), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  return ptr;
+}
+
+static void check(int *ptr)
+{
+  size_t j;
+  for (j = 1; j < NUM_INTS; j++) {
+    if (ptr[j] != (int) j) {
+      fprintf(stderr, "shared-mmap: word %d is %d\n", (int) j, ptr[j]);
+      abort();
+    }
+  }
+}
+
+int main()
+{
+  char filename[] = "dmtcp-shared-mmap.XXXXXX";
+  int fd = mkstemp(filename);
+  int *ptr;
+  size_t j;
+  int i;
+
+  if (fd == -1 || ftruncate(fd, NUM_INTS * sizeof(int)) == -1) {
+    perror("shared-mmap");
+    exit(1);
+  }
+  printf("creating file in local directory: %s\n", filename);
+  ptr = map(fd);
+  for (j = 1; j < NUM_INTS; j++)
+    ptr[j] = j;
+  ptr[0] = 0;
+
+  if (fork() == 0) {
+    ptr = map(fd);
+    while (1) {
+      i = ptr[0];
+      if (i > 0) {
+        check(ptr);
+        printf("Client: %d\n", i);
+        fflush(stdout);
+        ptr[0] = -i;
+      } else {
+        usleep(100000);
+      }
+    }
+  }
+
+  for (i = 1; ; i++) {
+    printf("Server: %d\n", i);
+    fflush(stdout);
+    ptr[0] = i;
+    while (ptr[0] != -i)
+      usleep(100000);
+    check(ptr);
+  }
+  return 0;
+}
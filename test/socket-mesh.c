@@ -0,0 +1,131 @@
+/* Used by restart-mesh.sh.
+ *
+ * Starts N processes, each connected to every other one over TCP, so the
+ * job holds N*(N-1) socket endpoints, as a fully connected MPI job would.
+ * Each process then passes a token to every peer and waits for one from
+ * every peer, forever; a connection that is not restored correctly after
+ * restart makes the process exit with an error.
+ *
+ * Usage: socket-mesh N
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static void die(const char *what, int id)
+{
+  fprintf(stderr, "socket-mesh[%d]: %s: %s\n", id, what, strerror(errno));
+  exit(1);
+}
+
+static void xfer(int fd, void *buf, size_t len, int doWrite, int id)
+{
+  char *p = (char *) buf;
+  while (len > 0) {
+    ssize_t rc = doWrite ? write(fd, p, len) : read(fd, p, len);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      die(doWrite ? "write" : "read", id);
+    p += rc;
+    len -= rc;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi(argv[1]) : 4;
+  int *listenFd, *port, *peer;
+  int i, j, id = 0;
+  struct sockaddr_in addr;
+  socklen_t addrlen;
+
+  if (n < 2) {
+    fprintf(stderr, "Usage: socket-mesh N  (N >= 2)\n");
+    return 1;
+  }
+  listenFd = malloc(n * sizeof(int));
+  port = malloc(n * sizeof(int));
+  peer = malloc(n * sizeof(int));
+
+  /* All listeners exist before the fork, so every process knows the ports. */
+  for (i = 0; i < n; i++) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    addrlen = sizeof(addr);
+    listenFd[i] = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd[i] < 0 ||
+        bind(listenFd[i], (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(listenFd[i], n) < 0 ||
+        getsockname(listenFd[i], (struct sockaddr *) &addr, &addrlen) < 0)
+      die("listen", 0);
+    port[i] = ntohs(addr.sin_port);
+  }
+
+  for (i = 1; i < n; i++) {
+    pid_t pid = fork();
+    if (pid < 0)
+      die("fork", 0);
+    if (pid == 0) {
+      id = i;
+      break;
+    }
+  }
+
+  /* Connect to the lower ids (the backlog holds us until they accept), then
+   * accept the higher ones.  The first int on each connection is the id. */
+  for (j = 0; j < id; j++) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port[j]);
+    peer[j] = socket(AF_INET, SOCK_STREAM, 0);
+    if (peer[j] < 0 ||
+        connect(peer[j], (struct sockaddr *) &addr, sizeof(addr)) < 0)
+      die("connect", id);
+    xfer(peer[j], &id, sizeof(id), 1, id);
+  }
+  for (j = id + 1; j < n; j++) {
+    int fd = accept(listenFd[id], NULL, NULL);
+    int from;
+    if (fd < 0)
+      die("accept", id);
+    xfer(fd, &from, sizeof(from), 0, id);
+    if (from <= id || from >= n) {
+      fprintf(stderr, "socket-mesh[%d]: bad peer id %d\n", id, from);
+      return 1;
+    }
+    peer[from] = fd;
+  }
+  for (i = 0; i < n; i++)
+    close(listenFd[i]);
+  peer[id] = -1;
+
+  for (;;) {
+    for (j = 0; j < n; j++)
+      if (j != id)
+        xfer(peer[j], &id, sizeof(id), 1, id);
+    for (j = 0; j < n; j++) {
+      int from;
+      if (j == id)
+        continue;
+      xfer(peer[j], &from, sizeof(from), 0, id);
+      if (from != j) {
+        fprintf(stderr, "socket-mesh[%d]: token %d from peer %d\n",
+                id, from, j);
+        return 1;
+      }
+    }
+    usleep(100000);
+  }
+  return 0;
+}
@@ -0,0 +1,398 @@
+/* Compile with:  gcc THIS_FILE -lpthread
+ *
+ * Microbenchmark of the library calls that DMTCP wraps.  Each benchmark is
+ * run with 1, 2, 4, ... up to MAX_THREADS threads, and the average time per
+ * call (per thread) is printed as JSON on stdout, so that runs with and
+ * without dmtcp_checkpoint can be compared and tracked over time.
+ * See wrapper-overhead.sh, which runs it natively and under DMTCP.
+ *
+ * Usage: wrapper-overhead [-t MAX_THREADS] [-n ITERATIONS] [-l LABEL]
+ *                         [BENCHMARK ...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static long iterations = 200000;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *msg)
+{
+  perror(msg);
+  exit(1);
+}
+
+/* Each benchmark runs 'n' iterations and returns the number of wrapped calls
+ * it made.
+ */
+static long bench_malloc_free(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    void *p = malloc(64 + (i % 8) * 64);
+    free(p);
+  }
+  return 2 * n;
+}
+
+static long bench_mmap_munmap(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    void *p = mmap(NULL, 4096, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) die("mmap");
+    munmap(p, 4096);
+  }
+  return 2 * n;
+}
+
+static long bench_open_close(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    int fd = open("/dev/null", O_RDONLY);
+    if (fd == -1) die("open");
+    close(fd);
+  }
+  return 2 * n;
+}
+
+static long bench_socket_connect_accept(long n)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  long i;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (listener == -1 ||
+      bind(listener, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+      listen(listener, 128) == -1 ||
+      getsockname(listener, (struct sockaddr*) &addr, &len) == -1) {
+    die("listener");
+  }
+  for (i = 0; i < n; i++) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (client == -1 ||
+        connect(client, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+      die("connect");
+    }
+    int server = accept(listener, NULL, NULL);
+    if (server == -1) die("accept");
+    close(server);
+    close(client);
+  }
+  close(listener);
+  return 5 * n;
+}
+
+static long bench_pipe(long n)
+{
+  long i;
+  int fds[2];
+  for (i = 0; i < n; i++) {
+    if (pipe(fds) == -1) die("pipe");
+    close(fds[0]);
+    close(fds[1]);
+  }
+  return 3 * n;
+}
+
+static long bench_dup2(long n)
+{
+  long i;
+  int fd = open("/dev/null", O_RDONLY);
+  int target = dup(fd);
+  if (fd == -1 || target == -1) die("dup");
+  for (i = 0; i < n; i++) {
+    if (dup2(fd, target) == -1) die("dup2");
+  }
+  close(target);
+  close(fd);
+  return n;
+}
+
+static long bench_fork(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    pid_t pid = fork();
+    if (pid == -1) die("fork");
+    if (pid == 0) _exit(0);
+    if (waitpid(pid, NULL, 0) != pid) die("waitpid");
+  }
+  return 2 * n;
+}
+
+/* A short-lived child that exec()s a trivial program; under DMTCP this
+ * covers the exec() wrapper and the startup of the new program.
+ */
+static long bench_fork_exec(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    pid_t pid = fork();
+    if (pid == -1) die("fork");
+    if (pid == 0) {
+      execl("/bin/true", "true", (char *) NULL);
+      _exit(127);
+    }
+    if (waitpid(pid, NULL, 0) != pid) die("waitpid");
+  }
+  return 3 * n;
+}
+
+static void *empty_thread(void *arg)
+{
+  return arg;
+}
+
+static long bench_pthread_create(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    pthread_t thread;
+    int res = pthread_create(&thread, NULL, empty_thread, NULL);
+    if (res != 0) {
+      fprintf(stderr, "error creating thread: %s\n", strerror(res));
+      exit(1);
+    }
+    pthread_join(thread, NULL);
+  }
+  return 2 * n;
+}
+
+static long bench_getpid(long n)
+{
+  long i;
+  volatile pid_t pid;
+  for (i = 0; i < n; i++) {
+    pid = getpid();
+  }
+  (void) pid;
+  return n;
+}
+
+static long bench_gettid(long n)
+{
+  long i;
+  volatile pid_t tid;
+  for (i = 0; i < n; i++) {
+    tid = syscall(SYS_gettid);
+  }
+  (void) tid;
+  return n;
+}
+
+/* Signal 0 to the calling thread: two pid translations per call under
+ * pidvirt, plus the getpid() and gettid() to get the ids.
+ */
+static long bench_tgkill(long n)
+{
+  long i;
+  for (i = 0; i < n; i++) {
+    if (syscall(SYS_tgkill, getpid(), syscall(SYS_gettid), 0) == -1) {
+      die("tgkill");
+    }
+  }
+  return 3 * n;
+}
+
+static long bench_epoll_ctl(long n)
+{
+  long i;
+  int fds[2];
+  int epfd = epoll_create(1);
+  struct epoll_event ev;
+  if (epfd == -1 || pipe(fds) == -1) die("epoll_create");
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  for (i = 0; i < n; i++) {
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) == -1 ||
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], &ev) == -1) {
+      die("epoll_ctl");
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(epfd);
+  return 2 * n;
+}
+
+static long bench_poll(long n)
+{
+  long i;
+  int fds[2];
+  struct pollfd pfd;
+  if (pipe(fds) == -1) die("pipe");
+  pfd.fd = fds[0];
+  pfd.events = POLLIN;
+  for (i = 0; i < n; i++) {
+    if (poll(&pfd, 1, 0) == -1) die("poll");
+  }
+  close(fds[0]);
+  close(fds[1]);
+  return n;
+}
+
+static long bench_ioctl(long n)
+{
+  long i;
+  int fds[2];
+  int avail;
+  if (pipe(fds) == -1) die("pipe");
+  for (i = 0; i < n; i++) {
+    if (ioctl(fds[0], FIONREAD, &avail) == -1) die("ioctl");
+  }
+  close(fds[0]);
+  close(fds[1]);
+  return n;
+}
+
+struct benchmark {
+  const char *name;
+  long (*fn)(long);
+  int divisor;   /* Expensive calls run iterations/divisor times. */
+};
+
+static struct benchmark benchmarks[] = {
+  { "malloc_free",            bench_malloc_free,           1 },
+  { "mmap_munmap",            bench_mmap_munmap,           1 },
+  { "open_close",             bench_open_close,            1 },
+  { "socket_connect_accept",  bench_socket_connect_accept, 20 },
+  { "pipe",                   bench_pipe,                  1 },
+  { "dup2",                   bench_dup2,                  1 },
+  { "fork",                   bench_fork,                  1000 },
+  { "fork_exec",              bench_fork_exec,             2000 },
+  { "pthread_create",         bench_pthread_create,        100 },
+  { "getpid",                 bench_getpid,                1 },
+  { "gettid",                 bench_gettid,                1 },
+  { "tgkill",                 bench_tgkill,                1 },
+  { "epoll_ctl",              bench_epoll_ctl,             1 },
+  { "poll",                   bench_poll,                  1 },
+  { "ioctl",                  bench_ioctl,                 1 },
+  { NULL, NULL, 0 }
+};
+
+struct thread_arg {
+  struct benchmark *bench;
+  long n;
+  long calls;
+  pthread_barrier_t *barrier;
+};
+
+static void *start_routine(void *arg)
+{
+  struct thread_arg *targ = (struct thread_arg*) arg;
+  pthread_barrier_wait(targ->barrier);
+  targ->calls = targ->bench->fn(targ->n);
+  return NULL;
+}
+
+/* Returns the average time in ns per wrapped call, per thread. */
+static double run(struct benchmark *bench, int numThreads)
+{
+  pthread_t threads[numThreads];
+  struct thread_arg args[numThreads];
+  pthread_barrier_t barrier;
+  long calls = 0;
+  long n = iterations / bench->divisor;
+  double start;
+  int i;
+
+  if (n < 1) n = 1;
+  pthread_barrier_init(&barrier, NULL, numThreads + 1);
+  for (i = 0; i < numThreads; i++) {
+    args[i].bench = bench;
+    args[i].n = n;
+    args[i].barrier = &barrier;
+    if (pthread_create(&threads[i], NULL, start_routine, &args[i]) != 0) {
+      die("pthread_create");
+    }
+  }
+  start = now();
+  pthread_barrier_wait(&barrier);
+  for (i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+    calls += args[i].calls;
+  }
+  double elapsed = now() - start;
+  pthread_barrier_destroy(&barrier);
+  return elapsed * 1e9 * numThreads / calls;
+}
+
+static int selected(const char *name, int argc, char *argv[], int first)
+{
+  int i;
+  if (first >= argc) return 1;
+  for (i = first; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0) return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *label = getenv("DMTCP_HIJACK_LIBS") ? "dmtcp" : "native";
+  struct benchmark *bench;
+  int opt, first = 1;
+
+  while ((opt = getopt(argc, argv, "t:n:l:")) != -1) {
+    switch (opt) {
+      case 't': maxThreads = atoi(optarg); break;
+      case 'n': iterations = atol(optarg); break;
+      case 'l': label = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-t MAX_THREADS] [-n ITERATIONS] "
+                "[-l LABEL] [BENCHMARK ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  first = optind;
+  if (maxThreads < 1) maxThreads = 1;
+
+  printf("{\n  \"label\": \"%s\",\n  \"iterations\": %ld,\n"
+         "  \"results\": [", label, iterations);
+  const char *sep = "\n";
+  for (bench = benchmarks; bench->name != NULL; bench++) {
+    int numThreads;
+    if (!selected(bench->name, argc, argv, first)) continue;
+    for (numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+      double ns = run(bench, numThreads);
+      printf("%s    {\"benchmark\": \"%s\", \"threads\": %d, "
+             "\"ns_per_call\": %.1f}", sep, bench->name, numThreads, ns);
+      sep = ",\n";
+      fflush(stdout);
+      if (numThreads < maxThreads && numThreads * 2 > maxThreads) {
+        numThreads = maxThreads / 2;
+      }
+    }
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
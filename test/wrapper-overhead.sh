@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Runs test/wrapper-overhead natively, under dmtcp_checkpoint and, if it was
+# built, under dmtcp_checkpoint with the pidvirt plugin, and prints a single
+# JSON document with all three runs.  Arguments are passed to
+# wrapper-overhead (e.g. -t 8 -n 100000 malloc_free getpid).
+#
+# Usage (from the top-level directory):  test/wrapper-overhead.sh [ARGS]
+#    or:                                 make bench
+
+TOP=`cd \`dirname $0\`/.. && pwd`
+BENCH=$TOP/test/wrapper-overhead
+CHECKPOINT="$TOP/bin/dmtcp_checkpoint --batch --interval 0 --quiet --quiet"
+PIDVIRT=$TOP/lib/dmtcp/pidvirt.so
+
+if [ ! -x $BENCH ]; then
+  echo "$BENCH not found; run 'make tests' first." >&2
+  exit 1
+fi
+
+echo '{ "runs": ['
+$BENCH -l native "$@" || exit 1
+echo ','
+$CHECKPOINT $BENCH -l dmtcp "$@" || exit 1
+if [ -f $PIDVIRT ]; then
+  echo ','
+  $CHECKPOINT --with-plugin $PIDVIRT $BENCH -l dmtcp+pidvirt "$@" || exit 1
+fi
+echo '] }'
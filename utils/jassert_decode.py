@@ -0,0 +1,106 @@
+#!/usr/bin/python
+
+# Render a binary JTRACE/JNOTE log (written when DMTCP_BINARY_LOG is set) in
+# the same format as the text log, with a timestamp in front of each message.
+# See "BINARY LOG" in dmtcp/jalib/jassert.h for the record layout.
+
+import sys
+import struct
+import time
+
+MAGIC = b'JBINLOG1'
+MAX_ARGS = 5
+STR_LEN = 24
+(ENTRY_STRING, ENTRY_RECORDS, ENTRY_DROPPED) = (1, 2, 3)
+(T_INT, T_UINT, T_DOUBLE, T_PTR, T_STR, T_CHAR) = range(1, 7)
+
+def layout(ptrSize, recSize):
+  ptr = ptrSize == 8 and 'Q' or 'I'
+  # int64_t/double are 8-byte aligned on x86_64 and ARM, 4 on i386.
+  for align in (8, 4):
+    argHdr = 4 + ptrSize + 4
+    argHdr = (argHdr + align - 1) // align * align
+    argSize = argHdr + STR_LEN
+    hdrSize = 8 + 4 * ptrSize + 16
+    hdrSize = (hdrSize + align - 1) // align * align
+    if hdrSize + MAX_ARGS * argSize == recSize:
+      return ('<Q' + 4 * ptr + '4i', hdrSize, '<' + ptr + 'II', argHdr, argSize)
+  sys.exit("jassert_decode.py: unknown record layout (pointer size %d, "
+           "record size %d)" % (ptrSize, recSize))
+
+def value(strings, argType, length, raw):
+  if argType == T_INT:
+    return str(struct.unpack('<q', raw[:8])[0])
+  if argType == T_UINT:
+    return str(struct.unpack('<Q', raw[:8])[0])
+  if argType == T_DOUBLE:
+    return repr(struct.unpack('<d', raw[:8])[0])
+  if argType == T_PTR:
+    return hex(struct.unpack('<Q', raw[:8])[0]).rstrip('L')
+  if argType == T_CHAR:
+    return chr(struct.unpack('<q', raw[:8])[0] & 0xff)
+  if argType == T_STR:
+    s = raw[:raw.index(b'\0')].decode('utf-8', 'replace')
+    if length >= STR_LEN:
+      s += '...'
+    return s
+  return '?'
+
+def render(rec, strings, fmt):
+  (hdrFmt, hdrSize, argFmt, argHdr, argSize) = fmt
+  (ts, typ, reason, fname, func, line, pid, tid, nargs) = \
+    struct.unpack(hdrFmt, rec[:struct.calcsize(hdrFmt)])
+  s = lambda p: p and strings.get(p, '<0x%x>' % p) or ''
+  out = time.strftime('%H:%M:%S', time.localtime(ts // 1000000000))
+  out += '.%06d ' % (ts % 1000000000 // 1000)
+  out += '[%d] [%d] %s at %s:%d in %s' % \
+         (pid, tid, s(typ), s(fname).split('/')[-1], line, s(func))
+  out += s(reason)
+  for i in range(min(nargs, MAX_ARGS)):
+    a = rec[hdrSize + i * argSize : hdrSize + (i + 1) * argSize]
+    (name, argType, length) = struct.unpack(argFmt, a[:struct.calcsize(argFmt)])
+    v = value(strings, argType, length, a[argHdr:])
+    if name == 0:
+      out += v
+    else:
+      if not out.endswith('\n'):
+        out += '\n'
+      out += s(name) + v + '\n'
+  if nargs > MAX_ARGS:
+    out += '     ... (%d more values not recorded)\n' % (nargs - MAX_ARGS)
+  if not out.endswith('\n'):
+    out += '\n'
+  return out
+
+def decode(f):
+  if f.read(8) != MAGIC:
+    sys.exit("jassert_decode.py: not a binary JASSERT log")
+  (ptrSize, recSize) = struct.unpack('<II', f.read(8))
+  fmt = layout(ptrSize, recSize)
+  strings = {}
+  while True:
+    hdr = f.read(8)
+    if len(hdr) < 8:
+      break
+    (kind, n) = struct.unpack('<II', hdr)
+    if kind == ENTRY_STRING:
+      ptr = struct.unpack('<Q', f.read(8))[0]
+      strings[ptr] = f.read(n).decode('utf-8', 'replace')
+    elif kind == ENTRY_RECORDS:
+      for i in range(n):
+        rec = f.read(recSize)
+        if len(rec) < recSize:
+          return
+        sys.stdout.write(render(rec, strings, fmt))
+    elif kind == ENTRY_DROPPED:
+      (tid, count) = struct.unpack('<II', f.read(8))
+      sys.stdout.write('*** [%d] %d messages dropped (ring buffer full)\n'
+                       % (tid, count))
+    else:
+      sys.exit("jassert_decode.py: corrupt log (entry type %d)" % kind)
+
+if len(sys.argv) < 2 or sys.argv[1] in ('-h', '--help'):
+  print("USAGE:  jassert_decode.py jassertlog.*.bin ...")
+  sys.exit(1)
+for path in sys.argv[1:]:
+  decode(open(path, 'rb'))